@@ -0,0 +1,102 @@
+/*
+ * CPU used by a program left alone: the viewer open with nothing happening, the case of
+ * workstations keeping it open all day. Linux only, from /proc/<pid>/stat.
+ *
+ * usage: idle_cpu [window seconds] [settle seconds] -- program [arguments ...]
+ * Defaults to a 30 s window, after 5 s for the program to start and draw its first frames.
+ * Prints the CPU time (user + system) over the window, and its share of one core.
+ * The program is killed afterwards.
+ *
+ * Without any display, nor any GPU (Mesa llvmpipe):
+ *     LIBGL_ALWAYS_SOFTWARE=1 xvfb-run -a ./idle_cpu 30 5 -- ./viewer
+ */
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <thread>
+
+#include <signal.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+typedef std::chrono::steady_clock Clock;
+
+/* utime + stime of `pid` in seconds, negative once it exited */
+static double
+cpu_seconds(pid_t pid)
+{
+    std::ifstream file("/proc/" + std::to_string(pid) + "/stat");
+    std::string line;
+    if( !std::getline(file, line) )
+        return -1.0;
+
+    // The command name may hold spaces: fields are counted after its closing parenthesis.
+    size_t end = line.rfind(')');
+    if( end == std::string::npos )
+        return -1.0;
+
+    std::istringstream fields(line.substr(end + 2));
+    std::string field;
+    unsigned long long utime = 0, stime = 0;
+    for(int i=3; i <= 15 && fields >> field; ++i){
+        if( i == 3 && field == "Z" ) return -1.0;
+        if( i == 14 ) utime = std::strtoull(field.c_str(), nullptr, 10);
+        if( i == 15 ) stime = std::strtoull(field.c_str(), nullptr, 10);
+    }
+
+    return double(utime + stime) / double(sysconf(_SC_CLK_TCK));
+}
+
+int main(int argc, char* argv[])
+{
+    int separator = 1;
+    while( separator < argc && std::strcmp(argv[separator], "--") != 0 )
+        ++separator;
+
+    if( separator + 1 >= argc ){
+        std::cerr << "usage: idle_cpu [window seconds] [settle seconds] -- program [arguments ...]" << std::endl;
+        return 1;
+    }
+
+    double window = (separator > 1) ? std::max(1.0, std::atof(argv[1])) : 30.0;
+    double settle = (separator > 2) ? std::max(0.0, std::atof(argv[2])) : 5.0;
+
+    pid_t pid = fork();
+    if( pid < 0 ){
+        std::cerr << "Cannot fork" << std::endl;
+        return 1;
+    }
+
+    if( pid == 0 ){
+        execvp(argv[separator + 1], argv + separator + 1);
+        std::cerr << "Cannot run " << argv[separator + 1] << std::endl;
+        _exit(127);
+    }
+
+    std::this_thread::sleep_for(std::chrono::duration<double>(settle));
+    double start_cpu = cpu_seconds(pid);
+    Clock::time_point start = Clock::now();
+
+    std::this_thread::sleep_for(std::chrono::duration<double>(window));
+    double end_cpu = cpu_seconds(pid);
+    double elapsed = std::chrono::duration<double>(Clock::now() - start).count();
+
+    kill(pid, SIGTERM);
+    waitpid(pid, nullptr, 0);
+
+    if( start_cpu < 0.0 || end_cpu < 0.0 ){
+        std::cerr << argv[separator + 1] << " exited before the end of the window" << std::endl;
+        return 1;
+    }
+
+    double used = end_cpu - start_cpu;
+    std::cout << "window_s,cpu_s,cpu_percent" << std::endl
+              << elapsed << "," << used << "," << 100.0 * used / elapsed << std::endl;
+    return 0;
+}
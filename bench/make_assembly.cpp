@@ -0,0 +1,65 @@
+/*
+ * Stress model for occlusion culling: a dense grid of copies of one mesh,
+ * most of them hidden behind the outer ones, written as a single OBJ.
+ *
+ * usage: make_assembly output.obj [copies per side] [mesh file]
+ * Defaults to 6 x 6 x 6 copies of 3D_OBJECTS/OBJ/B2.obj.
+ * Copies are spaced by 90% of the mesh box: neighbours overlap, leaving no gap to see through.
+ */
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <string>
+
+#include "../include/meshreader.h"
+
+int main(int argc, char* argv[])
+{
+    if( argc < 2 ){
+        std::cerr << "usage: make_assembly output.obj [copies per side] [mesh file]" << std::endl;
+        return 1;
+    }
+
+    int side = (argc > 2) ? std::max(1, std::atoi(argv[2])) : 6;
+    std::string file = (argc > 3) ? argv[3] : std::string(SAMPLES_DIR) + "/OBJ/B2.obj";
+
+    RawMesh raw;
+    if( !MeshReader::read(file, raw) ){
+        std::cerr << "Cannot read " << file << std::endl;
+        return 1;
+    }
+
+    float step[3];
+    for(size_t j=0; j < 3; ++j)
+        step[j] = 0.9f * (raw.bbox.max[j] - raw.bbox.min[j]);
+
+    FILE* out = std::fopen(argv[1], "w");
+    if( out == nullptr ){
+        std::cerr << "Cannot write " << argv[1] << std::endl;
+        return 1;
+    }
+
+    size_t copy = 0;
+    for(int x=0; x < side; ++x)
+    for(int y=0; y < side; ++y)
+    for(int z=0; z < side; ++z, ++copy){
+        const float offset[3] = { x * step[0], y * step[1], z * step[2] };
+
+        const float* p = raw.positions.data();
+        for(size_t v=0; v < raw.nb_vertices(); ++v, p+=3)
+            std::fprintf(out, "v %g %g %g\n", p[0] + offset[0], p[1] + offset[1], p[2] + offset[2]);
+
+        // OBJ indices start at 1, and go on from the previous copies.
+        size_t base = copy * raw.nb_vertices() + 1;
+        for(size_t i=0; i < raw.indices.size(); i+=3)
+            std::fprintf(out, "f %zu %zu %zu\n", base + raw.indices[i], base + raw.indices[i+1], base + raw.indices[i+2]);
+    }
+
+    std::fclose(out);
+
+    std::cout << copy << " copies, " << copy * raw.nb_vertices() << " vertices, "
+              << copy * raw.nb_triangles() << " triangles" << std::endl;
+    return 0;
+}
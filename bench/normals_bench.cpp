@@ -0,0 +1,177 @@
+/*
+ * Parallel normal engine (MeshNormals) against OpenMesh, on the same meshes.
+ *
+ * usage: normals_bench [repetitions] [mesh files ...]
+ * Without files, every OBJ sample of 3D_OBJECTS/ is measured.
+ * Output is CSV: file,weighting,threads,faces,openmesh_ms,engine_ms,face_error_deg,vertex_error_deg
+ * Errors are the largest angles between both results: OpenMesh update_*_normals()
+ * for the uniform weighting, circulators over sector angles/areas for the others.
+ */
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <OpenMesh/Core/Mesh/TriMesh_ArrayKernelT.hh>
+
+#include "../include/meshnormals.h"
+#include "../include/meshreader.h"
+
+struct BenchTraits : public OpenMesh::DefaultTraits {
+    VertexAttributes(OpenMesh::Attributes::Normal);
+    FaceAttributes(OpenMesh::Attributes::Normal);
+};
+
+typedef std::chrono::steady_clock Clock;
+typedef OpenMesh::TriMesh_ArrayKernelT<BenchTraits> BenchMesh;
+
+template<typename Task>
+static double
+best_of(int repetitions, const Task& task)
+{
+    double best = 0.0;
+    for(int i=0; i < repetitions; ++i){
+        Clock::time_point start = Clock::now();
+        task();
+        double ms = std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+        best = (i == 0) ? ms : std::min(best, ms);
+    }
+    return best;
+}
+
+/* Same construction as MeshObject::assign() */
+static void
+build(const RawMesh& raw, BenchMesh& mesh, std::vector<uint32_t>& indices)
+{
+    std::vector<BenchMesh::VertexHandle> handles(raw.nb_vertices());
+    const float* p = raw.positions.data();
+    for(size_t i=0; i < handles.size(); ++i, p+=3)
+        handles[i] = mesh.add_vertex(BenchMesh::Point(p[0], p[1], p[2]));
+
+    BenchMesh::VertexHandle face[3];
+    for(size_t i=0; i < raw.indices.size(); i+=3){
+        for(size_t j=0; j < 3; ++j)
+            face[j] = handles[raw.indices[i+j]];
+
+        if( face[0] == face[1] || face[1] == face[2] || face[0] == face[2] )
+            continue;
+
+        if( !mesh.add_face(face[0], face[1], face[2]).is_valid() ){
+            for(size_t j=0; j < 3; ++j)
+                face[j] = mesh.add_vertex(mesh.point(face[j]));
+            mesh.add_face(face[0], face[1], face[2]);
+        }
+    }
+
+    indices.clear();
+    for(const auto& fh: mesh.faces())
+        for(const auto& vh: mesh.fv_range(fh))
+            indices.push_back(uint32_t(vh.idx()));
+}
+
+/* OpenMesh reference of the area & angle weightings (face normals must be up to date). */
+static void
+weighted_vertex_normals(BenchMesh& mesh, NormalWeighting weighting)
+{
+    for(const auto& vh: mesh.vertices()){
+        BenchMesh::Normal n(0.0f, 0.0f, 0.0f);
+
+        for(const auto& heh: mesh.vih_range(vh)){
+            if( mesh.is_boundary(heh) )
+                continue;
+
+            float weight = (weighting == NormalWeighting::Angle)
+                         ? mesh.calc_sector_angle(heh)
+                         : mesh.calc_sector_area(heh);
+            n += mesh.normal(mesh.face_handle(heh)) * weight;
+        }
+
+        mesh.set_normal(vh, n.normalize_cond());
+    }
+}
+
+/* Largest angle (degrees) between two arrays of unit vectors, zero ones left aside. */
+static double
+max_error(const float* a, const float* b, size_t count)
+{
+    double worst = 0.0;
+    for(size_t i=0; i < count; ++i, a+=3, b+=3){
+        double la = a[0]*a[0] + a[1]*a[1] + a[2]*a[2];
+        double lb = b[0]*b[0] + b[1]*b[1] + b[2]*b[2];
+        if( la == 0.0 || lb == 0.0 )
+            continue;
+
+        double dot = (a[0]*b[0] + a[1]*b[1] + a[2]*b[2]) / std::sqrt(la * lb);
+        worst = std::max(worst, std::acos(std::max(-1.0, std::min(1.0, dot))) * 180.0 / M_PI);
+    }
+    return worst;
+}
+
+int main(int argc, char* argv[])
+{
+    int repetitions = (argc > 1) ? std::max(1, std::atoi(argv[1])) : 5;
+
+    std::vector<std::string> files;
+    for(int i=2; i < argc; ++i)
+        files.push_back(argv[i]);
+
+    if( files.empty() ){
+        const char* samples[] = { "B1BOMBER", "B2", "big_f14" };
+        for(const char* name: samples)
+            files.push_back(std::string(SAMPLES_DIR) + "/OBJ/" + name + ".obj");
+    }
+
+    const NormalWeighting weightings[3] = { NormalWeighting::Uniform, NormalWeighting::Area, NormalWeighting::Angle };
+    const char* names[3] = { "uniform", "area", "angle" };
+    unsigned int hardware = std::max(1u, std::thread::hardware_concurrency());
+
+    std::cout << "file,weighting,threads,faces,openmesh_ms,engine_ms,face_error_deg,vertex_error_deg" << std::endl;
+
+    for(const std::string& file: files){
+        RawMesh raw;
+        if( !MeshReader::read(file, raw) ){
+            std::cerr << "Cannot read " << file << std::endl;
+            continue;
+        }
+
+        BenchMesh mesh;
+        std::vector<uint32_t> indices;
+        build(raw, mesh, indices);
+
+        const size_t nb_vertices = mesh.n_vertices();
+        const size_t nb_faces = mesh.n_faces();
+        const float* positions = reinterpret_cast<const float*>(mesh.points());
+
+        for(size_t w=0; w < 3; ++w){
+            double reference = best_of(repetitions, [&](){
+                mesh.update_face_normals();
+                if( weightings[w] == NormalWeighting::Uniform )
+                    mesh.update_vertex_normals();
+                else
+                    weighted_vertex_normals(mesh, weightings[w]);
+            });
+
+            for(unsigned int threads = 1; threads <= hardware; threads *= 2){
+                std::vector<float> faces(3*nb_faces), vertices(3*nb_vertices);
+
+                double engine = best_of(repetitions, [&](){
+                    MeshNormals::compute(positions, nb_vertices, indices.data(), nb_faces,
+                                         faces.data(), vertices.data(), weightings[w], threads);
+                });
+
+                std::cout << file << "," << names[w] << "," << threads << "," << nb_faces << ","
+                          << reference << "," << engine << ","
+                          << max_error(faces.data(), reinterpret_cast<const float*>(mesh.face_normals()), nb_faces) << ","
+                          << max_error(vertices.data(), reinterpret_cast<const float*>(mesh.vertex_normals()), nb_vertices)
+                          << std::endl;
+            }
+        }
+    }
+
+    return 0;
+}
@@ -0,0 +1,94 @@
+/*
+ * Load time of the fast OBJ/OFF reader against OpenMesh::IO::read_mesh.
+ *
+ * usage: reader_bench [repetitions] [mesh files ...]
+ * Without files, every sample of 3D_OBJECTS/ is measured.
+ * Output is CSV: file,reader,threads,vertices,triangles,best_ms,median_ms
+ */
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <OpenMesh/Core/IO/MeshIO.hh>
+#include <OpenMesh/Core/Mesh/TriMesh_ArrayKernelT.hh>
+
+#include "../include/meshreader.h"
+
+typedef std::chrono::steady_clock Clock;
+typedef OpenMesh::TriMesh_ArrayKernelT<> BenchMesh;
+
+/* Milliseconds spent by each run of `task`, sorted. */
+template<typename Task>
+static std::vector<double>
+measure(int repetitions, const Task& task)
+{
+    std::vector<double> times;
+    for(int i=0; i < repetitions; ++i){
+        Clock::time_point start = Clock::now();
+        task();
+        times.push_back(std::chrono::duration<double, std::milli>(Clock::now() - start).count());
+    }
+    std::sort(times.begin(), times.end());
+    return times;
+}
+
+static void
+report(const std::string& file, const std::string& reader, unsigned int threads,
+       size_t vertices, size_t triangles, const std::vector<double>& times)
+{
+    std::cout << file << "," << reader << "," << threads << ","
+              << vertices << "," << triangles << ","
+              << times.front() << "," << times[times.size()/2] << std::endl;
+}
+
+int main(int argc, char* argv[])
+{
+    int repetitions = (argc > 1) ? std::max(1, std::atoi(argv[1])) : 5;
+
+    std::vector<std::string> files;
+    for(int i=2; i < argc; ++i)
+        files.push_back(argv[i]);
+
+    if( files.empty() ){
+        const char* samples[] = { "B1BOMBER", "B2", "big_f14" };
+        for(const char* name: samples){
+            files.push_back(std::string(SAMPLES_DIR) + "/OBJ/" + name + ".obj");
+            files.push_back(std::string(SAMPLES_DIR) + "/OFF/" + name + ".off");
+        }
+    }
+
+    unsigned int hardware = std::max(1u, std::thread::hardware_concurrency());
+
+    std::cout << "file,reader,threads,vertices,triangles,best_ms,median_ms" << std::endl;
+
+    for(const std::string& file: files){
+        BenchMesh mesh;
+        std::vector<double> times = measure(repetitions, [&](){
+            mesh.clear();
+            OpenMesh::IO::read_mesh(mesh, file);
+        });
+        report(file, "openmesh", 1, mesh.n_vertices(), mesh.n_faces(), times);
+
+        for(unsigned int threads = 1; threads <= hardware; threads *= 2){
+            RawMesh raw;
+            bool ok = true;
+            times = measure(repetitions, [&](){
+                ok = MeshReader::read(file, raw, threads);
+            });
+
+            if( !ok ){
+                std::cerr << "Fast path cannot read " << file << std::endl;
+                break;
+            }
+
+            report(file, "fast", threads, raw.nb_vertices(), raw.nb_triangles(), times);
+        }
+    }
+
+    return 0;
+}
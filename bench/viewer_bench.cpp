@@ -0,0 +1,276 @@
+/*
+ * Rendering without the GUI: an offscreen surface and framebuffer, the shaders of the viewer
+ * and the frame of MeshViewerWidget::paintGL() (Renderer), along a camera path which is
+ * the same every run.
+ *
+ * usage: viewer_bench [frames] [mesh files ...]
+ * Without files, every sample of 3D_OBJECTS/OBJ and 3D_OBJECTS/OFF is measured. Each mesh
+ * is loaded, uploaded and drawn once per vertex layout & format, in a 1280x720 framebuffer,
+ * without then with occlusion culling.
+ * Output is CSV: file,layout,format,occlusion,faces,cache_file,load_ms,upload_ms,frames,triangles,
+ *                chunks,occluded,cpu_p50,cpu_p95,cpu_p99,cpu_max,gpu_p50,gpu_p95,gpu_p99,gpu_max
+ * cache_file tells whether a mesh cache was there before loading (the first load writes it).
+ * triangles and occluded (chunks left out by occlusion queries) are per frame, on average.
+ * Occlusion culling only applies at full detail: coarser levels occlude nothing.
+ * Back faces are drawn, as by default in the viewer: clusters are culled against the frustum only.
+ * A frame ends with glFinish(): its CPU time is the whole frame, GPU included.
+ * GPU columns stay empty without timer queries. The renderer goes to stderr.
+ *
+ * Dense assembly, the case occlusion culling is for (see make_assembly):
+ *     ./make_assembly assembly.obj 6 && ./viewer_bench 300 assembly.obj
+ *
+ * Without any display, nor any GPU (Mesa llvmpipe):
+ *     LIBGL_ALWAYS_SOFTWARE=1 xvfb-run -a ./viewer_bench
+ */
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include <QDir>
+#include <QGuiApplication>
+#include <QOffscreenSurface>
+#include <QOpenGLContext>
+#include <QOpenGLFramebufferObject>
+#include <QOpenGLShaderProgram>
+#include <QSurfaceFormat>
+
+#include "../include/frameprofiler.h"
+#include "../include/meshobject.h"
+#include "../include/renderer.h"
+#include "../include/scene.h"
+
+typedef std::chrono::steady_clock Clock;
+
+static const int frame_width = 1280;
+static const int frame_height = 720;
+
+/* Frames drawn before measuring: shaders compiled, buffers resident */
+static const size_t warmup_frames = 10;
+
+static double
+milliseconds_since(Clock::time_point start)
+{
+    return std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+}
+
+/*
+ * Frame `f` of `n`: one turn around the model, going up and down,
+ * from the default distance of the viewer (1.5) to twice as far and back.
+ */
+static QMatrix4x4
+camera_path(size_t f, size_t n)
+{
+    const float t = float(f) / float(n);
+    const float turn = 2.0f * float(M_PI) * t;
+
+    QMatrix4x4 rotation;
+    rotation.rotate(-90.0f + 20.0f * std::sin(turn), 1.0f, 0.0f, 0.0f);
+    rotation.rotate(360.0f * t, 0.0f, 0.0f, 1.0f);
+
+    QMatrix4x4 view;
+    view.translate(0.0f, 0.0f, -1.5f - 0.75f * (1.0f - std::cos(turn)));
+    view *= rotation;
+    return view;
+}
+
+/*
+ * MeshViewerWidget::paintGL() without the axis, nor any interaction: triangles drawn.
+ * Viewer defaults: back faces drawn (GL_CULL_FACE off), no cluster culled for its orientation.
+ */
+static size_t
+draw_frame(Renderer& renderer, MeshObject* mesh, Scene* scene, const QMatrix4x4& projection, const QMatrix4x4& view)
+{
+    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+
+    // The camera moves every frame.
+    renderer.begin_frame(projection, view, true);
+    renderer.draw(mesh, scene, projection, view, frame_height, 0, false);
+    renderer.end_frame();
+
+    return renderer.triangles();
+}
+
+struct Configuration {
+    const char* name;
+    VertexLayout layout;
+};
+
+struct Format {
+    const char* name;
+    VertexFormat format;
+};
+
+static void
+write_times(const FrameTimes& times)
+{
+    if( times.samples == 0 ){
+        std::cout << ",,,";
+        return;
+    }
+
+    std::cout << times.p50 << "," << times.p95 << "," << times.p99 << "," << times.max;
+}
+
+int main(int argc, char* argv[])
+{
+    QGuiApplication application(argc, argv);
+
+    size_t nb_frames = (argc > 1) ? size_t(std::max(1, std::atoi(argv[1]))) : 300;
+
+    std::vector<std::string> files;
+    for(int i=2; i < argc; ++i)
+        files.push_back(argv[i]);
+
+    // Every sample there is, OBJ then OFF.
+    if( files.empty() ){
+        const char* formats[2][2] = { { "OBJ", "*.obj" }, { "OFF", "*.off" } };
+        for(const auto& format: formats){
+            QDir dir(QString(SAMPLES_DIR) + "/" + format[0]);
+            for(const QString& name: dir.entryList(QStringList(format[1]), QDir::Files, QDir::Name))
+                files.push_back(dir.filePath(name).toStdString());
+        }
+    }
+
+    // Same context as the viewer (see main.cpp), v-sync aside: nothing is shown.
+    QSurfaceFormat format;
+    format.setVersion(3, 0);
+    format.setProfile(QSurfaceFormat::CoreProfile);
+    format.setDepthBufferSize(24);
+    format.setRenderableType(QSurfaceFormat::OpenGL);
+
+    QOffscreenSurface surface;
+    surface.setFormat(format);
+    surface.create();
+
+    QOpenGLContext context;
+    context.setFormat(format);
+    if( !surface.isValid() || !context.create() || !context.makeCurrent(&surface) ){
+        std::cerr << "Failed to create an OpenGL context" << std::endl;
+        return 1;
+    }
+
+    std::cerr << "Renderer: " << reinterpret_cast<const char*>(glGetString(GL_RENDERER))
+              << ", OpenGL " << reinterpret_cast<const char*>(glGetString(GL_VERSION)) << std::endl;
+
+    int status = 0;
+    {
+        QOpenGLFramebufferObject framebuffer(frame_width, frame_height, QOpenGLFramebufferObject::Depth);
+        Renderer renderer;
+        Scene scene;
+        FrameProfiler profiler(nb_frames);
+
+        if( !framebuffer.isValid() || !framebuffer.bind() || !renderer.create(SHADERS_DIR) ){
+            std::cerr << "Failed to set up the framebuffer or the shaders" << std::endl;
+            return 1;
+        }
+
+        profiler.create();
+
+        // Same projection as the viewer
+        QMatrix4x4 projection;
+        projection.perspective(45.0f, float(frame_width) / float(frame_height), 0.001f, 1000.0f);
+
+        glViewport(0, 0, frame_width, frame_height);
+        glClearColor(0.2f, 0.2f, 0.2f, 1.0f);
+        glEnable(GL_DEPTH_TEST);
+        glDepthFunc(GL_LESS);
+
+        const Configuration layouts[3] = {
+            { "planar", VertexLayout::Planar },
+            { "interleaved", VertexLayout::Interleaved },
+            { "hotcold", VertexLayout::HotCold }
+        };
+
+        const Format formats[3] = {
+            { "float", VertexFormat() },
+            { "half", VertexFormat(PositionFormat::Half, NormalFormat::Packed, ColorFormat::Byte) },
+            { "short", VertexFormat(PositionFormat::Short, NormalFormat::Packed, ColorFormat::Uniform) }
+        };
+
+        std::cout << "file,layout,format,occlusion,faces,cache_file,load_ms,upload_ms,frames,triangles,chunks,occluded,"
+                  << "cpu_p50,cpu_p95,cpu_p99,cpu_max,gpu_p50,gpu_p95,gpu_p99,gpu_max" << std::endl;
+
+        for(const std::string& file: files)
+        for(const Configuration& layout: layouts)
+        for(const Format& vertex_format: formats){
+            const bool cache_file = std::ifstream(MeshCache::cache_path(file)).good();
+
+            // Everything the viewer does once a mesh is picked, on this thread.
+            MeshObject* mesh = new MeshObject();
+            Clock::time_point start = Clock::now();
+            if( !mesh->load(file) ){
+                std::cerr << "Cannot read " << file << std::endl;
+                delete mesh;
+                status = 1;
+                continue;
+            }
+            double load_ms = milliseconds_since(start);
+
+            mesh->set_vertex_layout(layout.layout);
+            mesh->set_vertex_format(vertex_format.format);
+
+            start = Clock::now();
+            renderer.get_program()->bind();
+            bool ok = mesh->build(renderer.get_program()) && mesh->update_buffers(renderer.get_program());
+            renderer.get_program()->release();
+            glFinish();
+            double upload_ms = milliseconds_since(start);
+
+            if( !ok ){
+                std::cerr << "Cannot upload " << file << std::endl;
+                delete mesh;
+                status = 1;
+                continue;
+            }
+
+            // Same mesh & buffers, occlusion culling off then on.
+            for(bool occlusion: { false, true }){
+                mesh->set_occlusion_culling(occlusion);
+
+                for(size_t f=0; f < warmup_frames; ++f)
+                    draw_frame(renderer, mesh, &scene, projection, camera_path(f, warmup_frames));
+                glFinish();
+
+                profiler.reset();
+                size_t triangles = 0;
+                size_t occluded = 0;
+                for(size_t f=0; f < nb_frames; ++f){
+                    const QMatrix4x4 view = camera_path(f, nb_frames);
+
+                    profiler.begin_frame();
+                    triangles += draw_frame(renderer, mesh, &scene, projection, view);
+                    glFinish();
+                    profiler.end_frame();
+
+                    if( occlusion )
+                        occluded += mesh->occlusion_stats().occluded;
+                }
+
+                std::cout << file << "," << layout.name << "," << vertex_format.name << ","
+                          << occlusion << "," << mesh->nb_faces() << "," << cache_file << ","
+                          << load_ms << "," << upload_ms << "," << nb_frames << ","
+                          << triangles / nb_frames << ","
+                          << (occlusion ? mesh->occlusion_stats().chunks : 0) << "," << occluded / nb_frames << ",";
+                write_times(profiler.cpu_times());
+                std::cout << ",";
+                write_times(profiler.gpu_times());
+                std::cout << std::endl;
+            }
+
+            // GPU buffers go while the context is current.
+            delete mesh;
+        }
+
+        profiler.destroy();
+        framebuffer.release();
+    }
+
+    context.doneCurrent();
+    return status;
+}
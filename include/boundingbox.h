@@ -0,0 +1,35 @@
+#ifndef BOUNDINGBOX_H
+#define BOUNDINGBOX_H
+
+#include <cstddef>
+
+/*
+ * Axis aligned box of a set of points (x, y, z floats).
+ * Starts empty: min at +max, max at lowest, so that any point extends it.
+ */
+struct BoundingBox {
+    float min[3];
+    float max[3];
+
+    BoundingBox();
+
+    bool is_empty() const;
+
+    void extend(const float* p);
+    void extend(const BoundingBox& box);
+
+    /* Points [0, nb_vertices[, in blocks the compiler can vectorize. */
+    void extend(const float* positions, size_t nb_vertices);
+
+    /* Same, split among threads (0: as many as the hardware runs). */
+    static BoundingBox of(const float* positions, size_t nb_vertices, unsigned int nb_threads=0);
+
+    /* Into the unit box, centered on the origin: p' = (p - center) * scale */
+    void center(float* c) const;
+    float normalization_scale() const;
+
+    /* Rewrite every point into the unit box, split among threads like of(). */
+    void normalize(float* positions, size_t nb_vertices, unsigned int nb_threads=0) const;
+};
+
+#endif // BOUNDINGBOX_H
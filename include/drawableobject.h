@@ -7,8 +7,79 @@
 
 #include <QMatrix4x4>
 
+#include <functional>
+#include <memory>
+#include <vector>
+
+/* How attributes are arranged into the VBO, see DrawableObject::attribute_format() */
+enum class VertexLayout {
+    Planar,
+    Interleaved,
+    HotCold
+};
+
+/* How each attribute is stored into the VBO, see DrawableObject::set_vertex_format() */
+enum class PositionFormat {
+    Float,
+    Half,   // half floats, relative to the bounding box
+    Short   // normalized 16 bits integers, relative to the bounding box
+};
+
+enum class NormalFormat {
+    Float,
+    Packed  // GL_INT_2_10_10_10_REV
+};
+
+enum class ColorFormat {
+    Float,
+    Byte,   // normalized GL_UNSIGNED_BYTE
+    Uniform // constant color: one value for every vertex, nothing into the VBO
+};
+
+struct VertexFormat {
+    PositionFormat positions;
+    NormalFormat normals;
+    ColorFormat colors;
+
+    // Indices are 16 bits below 65536 vertices; above, split them into 16 bits chunks?
+    bool index_chunks;
+
+    VertexFormat(PositionFormat p=PositionFormat::Float,
+                 NormalFormat n=NormalFormat::Float,
+                 ColorFormat c=ColorFormat::Float,
+                 bool chunks=false)
+        :positions(p), normals(n), colors(c), index_chunks(chunks)
+    {}
+};
+
+/* Part of the EBO, in elements */
+struct ElementRange {
+    size_t first;
+    size_t count;
+};
+
+typedef void (QOPENGLF_APIENTRYP DrawElementsBaseVertex)(GLenum, GLsizei, GLenum, const void*, GLint);
+typedef void (QOPENGLF_APIENTRYP MultiDrawElements)(GLenum, const GLsizei*, GLenum, const void* const*, GLsizei);
+typedef void (QOPENGLF_APIENTRYP DrawElementsInstanced)(GLenum, GLsizei, GLenum, const void*, GLsizei);
+typedef void (QOPENGLF_APIENTRYP DrawElementsInstancedBaseVertex)(GLenum, GLsizei, GLenum, const void*, GLsizei, GLint);
+typedef void (QOPENGLF_APIENTRYP VertexAttribDivisor)(GLuint, GLuint);
+
 class DrawableObject {
 private:
+    struct AttributeFormat {
+        size_t offset; // bytes from the beginning of the VBO
+        size_t stride; // bytes between two vertices
+        size_t size;   // bytes per vertex (0: not into the VBO)
+        GLenum type;
+        int components;
+    };
+
+    struct IndexChunk {
+        size_t first;       // first index of the chunk into the EBO
+        size_t count;
+        GLint base_vertex;  // added to every index of the chunk
+    };
+
     size_t nb_vertices; // Number of vertices into our Object
     size_t nb_elements; // Number of elements to draw (IndexBufferObject)
     size_t tuple_size; // How many coordinates per vertices (vertices 2D/3D)
@@ -29,7 +100,84 @@ private:
     GLfloat* raw_vertices_normals;
     GLuint* raw_vertices_indices;
 
-    // Buffers
+    // Owners of the raw arrays, shared with copies: they are never written, but by use_unique_color()
+    // which gets its own array first. Borrowed arrays belong to someone else (e.g.: a mapped cache file),
+    // kept alive through it: counted by their owner, not by cpu_memory().
+    std::shared_ptr<GLfloat> owned_coordinates;
+    std::shared_ptr<GLfloat> owned_colors;
+    std::shared_ptr<GLfloat> owned_normals;
+    std::shared_ptr<GLuint> owned_indices;
+    bool borrowed_geometry;
+    bool borrowed_normals;
+
+    // Render-only: raw arrays are released once on the GPU.
+    bool render_only;
+    bool uploaded;
+    size_t gpu_bytes;
+
+    // Vertices to write again per attribute (positions, colors, normals) by the next update_buffers(),
+    // unless the whole buffers are outdated (new arrays, layout or formats).
+    std::vector<ElementRange> dirty_ranges[3];
+    bool buffers_outdated;
+
+    VertexLayout layout;
+    VertexLayout uploaded_layout;
+
+    // Requested storage, and the one of the last upload (after fallbacks).
+    VertexFormat format;
+    VertexFormat uploaded_format;
+
+    // Quantized positions are relative to this box, undone by show().
+    GLfloat quantization_center[3];
+    GLfloat quantization_extent[3];
+
+    // ColorFormat::Uniform value
+    GLfloat uniform_color[4];
+
+    // Indices width of the last upload, and its chunks when split.
+    GLenum index_type;
+    std::vector<IndexChunk> index_chunks;
+    DrawElementsBaseVertex draw_elements_base_vertex;
+
+    // Levels of detail: consecutive ranges of the EBO over the same vertices, 0 being the full object.
+    // detail_offsets[l] is the first element of level l (and detail_chunks[l] its first chunk), last is the end.
+    std::vector<size_t> detail_offsets;
+    std::vector<size_t> detail_chunks;
+    size_t detail_level;
+
+    // Visible parts of the full object (level 0), ready for the draw calls: offsets in bytes,
+    // base vertices only with index chunks. Whole level when off.
+    bool visible_ranges_on;
+    std::vector<GLsizei> visible_counts;
+    std::vector<const void*> visible_offsets;
+    std::vector<GLint> visible_base_vertices;
+    MultiDrawElements multi_draw_elements;
+
+    // Instances: per instance, its transform then the inverse transpose (column-major, 32 floats).
+    // instance_order groups them by level of detail, instance_counts[l] of them drawn with level l
+    // (nothing when culled). Not instanced when empty.
+    std::vector<GLfloat> instance_transforms;
+    std::vector<GLuint> instance_order;
+    std::vector<size_t> instance_counts;
+    QOpenGLBuffer* instance_vbo;
+    int location_instances;
+    int location_instances_normal;
+    DrawElementsInstanced draw_elements_instanced;
+    DrawElementsInstancedBaseVertex draw_elements_instanced_base_vertex;
+    VertexAttribDivisor vertex_attrib_divisor;
+
+    // Buffers, shared with copies until one of them writes into them (see detach_buffers()).
+    // vao, ebo & vbo point into `buffers`.
+    struct Buffers {
+        QOpenGLVertexArrayObject vao;
+        QOpenGLBuffer ebo;
+        QOpenGLBuffer vbo;
+
+        Buffers(): ebo(QOpenGLBuffer::IndexBuffer) {}
+        ~Buffers() { vao.destroy(); ebo.destroy(); vbo.destroy(); }
+    };
+
+    std::shared_ptr<Buffers> buffers;
     QOpenGLVertexArrayObject* vao;
     QOpenGLBuffer* ebo;
     QOpenGLBuffer* vbo;
@@ -37,11 +185,25 @@ private:
     // Model matrix
     QMatrix4x4* model;
 
+    // What show() gives the shader: the placed model (see placed_model()) and its inverse transpose,
+    // computed again only after the model matrix or the quantization of the last upload changed.
+    mutable QMatrix4x4 placed_matrix;
+    mutable QMatrix4x4 normal_matrix;
+    mutable bool matrices_dirty;
+
+    // Uniform locations into the program of the last upload
+    int location_model;
+    int location_model_inverse;
+    int location_instances_on;
+
 public:
     DrawableObject();
     DrawableObject(const DrawableObject& obj);
+    DrawableObject(DrawableObject&& obj);
     virtual ~DrawableObject();
 
+    DrawableObject& operator=(DrawableObject&& obj);
+
     virtual bool build(QOpenGLShaderProgram* program) =0;
     bool update_buffers(QOpenGLShaderProgram* program);
     virtual void show(QOpenGLShaderProgram* program, GLenum mode) const;
@@ -54,10 +216,54 @@ public:
     const QMatrix4x4& model_matrix() const;
 
     void use_unique_color(float r, float g, float b);
+
+    /* Colors of vertices `first` to `first+count` (3 floats each): the next update_buffers() only writes those. */
+    bool set_colors(size_t first, size_t count, const GLfloat* colors);
     void copy_geometry_to(DrawableObject* obj) const;
     void copy_colors_to(DrawableObject* obj) const;
     void copy_normals_to(DrawableObject* obj) const;
 
+    void set_vertex_layout(VertexLayout layout);
+    inline VertexLayout vertex_layout() const { return layout; }
+
+    void set_vertex_format(const VertexFormat& format);
+    inline const VertexFormat& vertex_format() const { return format; }
+
+    /* Memory mode: drop CPU copies once they are uploaded. */
+    void set_render_only(bool on);
+    inline bool is_render_only() const { return render_only; }
+
+    /* Levels of detail, from the full object (0) to the coarsest one; show() draws the current one. */
+    inline size_t nb_detail_levels() const { return detail_offsets.size() - 1; }
+    inline size_t detail_level_elements(size_t level) const { return detail_offsets[level+1] - detail_offsets[level]; }
+    inline size_t current_detail_level() const { return detail_level; }
+    void set_detail_level(size_t level);
+
+    /* Bytes held on each side, what is shared with copies being split between them. */
+    virtual size_t cpu_memory() const;
+    size_t gpu_memory() const;
+
+    /*
+     * Same geometry drawn at every `transforms` (placed by transform * model),
+     * one instanced draw call per level of detail in use. Needs the OpenGL context, after update_buffers().
+     * Without instanced draws (before OpenGL 3.3), instances are drawn one after the other.
+     */
+    bool set_instances(QOpenGLShaderProgram* program, const std::vector<QMatrix4x4>& transforms);
+    void clear_instances();
+    inline size_t nb_instances() const { return instance_transforms.size() / 32; }
+    size_t instances_drawn() const;
+    size_t instances_elements() const;
+
+    /*
+     * Full object (level 0) streamed out, e.g. into shared buffers:
+     * `stride` floats per vertex, 3 for the position, 3 for the normal then 3 for the color.
+     */
+    void export_vertices(GLfloat* buffer, size_t stride, size_t first, size_t count) const;
+    void export_indices(GLuint* buffer, GLuint base_vertex) const;
+
+    inline size_t get_nb_vertices() const { return nb_vertices; }
+    inline size_t get_nb_elements() const { return detail_level_elements(0); }
+
     const GLfloat* get_vertices_coordinates() const;
     const GLuint* get_vertices_indices() const;
     const GLfloat* get_vertices_colors() const;
@@ -66,9 +272,51 @@ public:
 protected:
     bool initialize(size_t nb_vertices, size_t nb_elements, size_t tuple_size);
 
-    void set_vertices_geometry(int shader_location, GLfloat* coordinates, GLuint* indices);
+    /* After initialize(): elements[l] indices for level l, which must add up to nb_elements. */
+    bool set_detail_levels(const std::vector<size_t>& elements);
+
+    /* Draw only these ranges of level 0 (sorted, disjoint), until cleared or uploaded again. */
+    void set_visible_ranges(const std::vector<ElementRange>& ranges);
+    void clear_visible_ranges();
+
+    /* Attribute of these vertices changed (e.g. into a child class storage), see set_colors(). */
+    void mark_dirty(int shader_location, size_t first, size_t count);
+
+    /* levels[i]: level of detail of instance i, or nb_detail_levels() when culled. */
+    void set_instance_levels(const std::vector<size_t>& levels);
+    inline const GLfloat* instance_transform(size_t instance) const { return &instance_transforms[32 * instance]; }
+
+    /* Arrays from new[], owned from now on, or borrowed from `owner` which frees them. */
+    void set_vertices_geometry(int shader_location, GLfloat* coordinates, GLuint* indices,
+                               const std::shared_ptr<const void>& owner=nullptr);
     void set_vertices_colors(int shader_location, GLfloat* data);
-    void set_vertices_normals(int shader_location, GLfloat* data);
+    void set_vertices_normals(int shader_location, GLfloat* data, const std::shared_ptr<const void>& owner=nullptr);
+
+    /*
+     * Write `count` vertices attributes, starting at vertex `first`,
+     * `stride` floats between two vertices: straight into the mapped GPU buffers
+     * for float formats, into a small staging chunk encoded afterwards otherwise.
+     * Defaults copy the raw arrays, children without raw arrays
+     * can stream from their own storage instead.
+     */
+    virtual void fill_vertices_coordinates(GLfloat* buffer, size_t stride, size_t first, size_t count) const;
+    virtual void fill_vertices_colors(GLfloat* buffer, size_t stride, size_t first, size_t count) const;
+    virtual void fill_vertices_normals(GLfloat* buffer, size_t stride, size_t first, size_t count) const;
+    virtual void fill_vertices_indices(GLuint* buffer, size_t first, size_t count) const;
+
+    /* Box of the positions, used to quantize them. Default goes through every vertex. */
+    virtual void bounding_box(GLfloat* min, GLfloat* max) const;
+
+    /* Same color for every vertex? Then `color` receives it. */
+    virtual bool uniform_colors(GLfloat* color) const;
+
+    static void copy_vertices(GLfloat* buffer, size_t stride, const GLfloat* data, size_t count, size_t tuple_size);
+    static void fill_vertices(GLfloat* buffer, size_t stride, const GLfloat* value, size_t count, size_t tuple_size);
+    static void gather_vertices(GLfloat* buffer, size_t stride, const GLfloat* data, const GLuint* order, size_t count, size_t tuple_size);
+
+    /* Can update_buffers() rebuild the whole buffers from the CPU side? */
+    virtual bool has_cpu_geometry() const;
+    virtual void release_cpu_data();
 
 private:
     void free_vertices_geometry();
@@ -77,6 +325,31 @@ private:
     void free_buffers();
 
     bool create_buffers();
+    bool detach_buffers(QOpenGLShaderProgram* program);
+    void set_attributes(QOpenGLShaderProgram* program) const;
+    void share(const DrawableObject& obj);
+    bool upload_dirty();
+    bool own_colors();
+    AttributeFormat attribute_format(int shader_location) const;
+    AttributeFormat attribute_type(int shader_location) const;
+    VertexFormat resolve_format();
+    void fill_attribute(int shader_location, GLfloat* buffer, size_t stride, size_t first, size_t count) const;
+    void write_attribute(int shader_location, char* buffer) const;
+    void write_attribute_range(int shader_location, char* buffer, size_t first, size_t count) const;
+    GLenum resolve_index_type(bool chunks);
+    bool split_indices();
+    void write_indices(char* buffer) const;
+    const QMatrix4x4& placed_model() const;
+    const QMatrix4x4& normal_model() const;
+    void update_matrices() const;
+    void draw_level(GLenum mode, size_t level, GLsizei instances) const;
+    void show_instances(QOpenGLShaderProgram* program, GLenum mode) const;
+    void quantize(GLfloat* data, size_t count, bool inverse) const;
+    static void encode(const AttributeFormat& f, const GLfloat* data, size_t count, size_t tuple_size, char* buffer);
+    static void decode(const AttributeFormat& f, const char* buffer, size_t count, size_t tuple_size, GLfloat* data);
+    GLfloat* read_back(int shader_location) const;
+    GLuint* read_back_indices() const;
+    static void upload(QOpenGLBuffer* buffer, int bytes, const std::function<void(char*)>& fill);
 };
 
 #endif // DRAWABLEOBJECT_H
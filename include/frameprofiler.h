@@ -0,0 +1,80 @@
+#ifndef FRAMEPROFILER_H
+#define FRAMEPROFILER_H
+
+#include <QOpenGLTimerQuery>
+
+#include <chrono>
+#include <string>
+#include <vector>
+
+/* Percentiles of the frames kept, in milliseconds */
+struct FrameTimes {
+    size_t samples;
+    float p50;
+    float p95;
+    float p99;
+    float max;
+};
+
+/*
+ * How long frames take: paintGL() from start to end on the CPU,
+ * the commands it sent on the GPU (GL_TIME_ELAPSED queries).
+ * Queries go around a small ring: a result is read frames later, once available,
+ * and never waited for. A frame finding its query still busy gets no GPU time.
+ * The last `window` frames are kept, for percentiles and dumps.
+ */
+class FrameProfiler {
+private:
+    struct Frame {
+        size_t index;
+        float cpu;  // ms
+        float gpu;  // ms, negative until known (or if never)
+    };
+
+    struct Query {
+        QOpenGLTimerQuery* query;
+        size_t frame;
+        bool pending;
+    };
+
+    std::vector<Frame> frames;  // ring, frame i at i % window
+    size_t window;
+    size_t nb_frames;
+
+    std::vector<Query> queries;
+    size_t next_query;
+    bool query_running;
+
+    std::chrono::steady_clock::time_point frame_start;
+
+public:
+    explicit FrameProfiler(size_t window=1000);
+    FrameProfiler(const FrameProfiler&) =delete;
+    ~FrameProfiler();
+
+    /* OpenGL context current. False without timer queries: CPU times only. */
+    bool create();
+    void destroy();
+
+    /* Around everything a frame draws, context current */
+    void begin_frame();
+    void end_frame();
+
+    /* Forget the frames kept, e.g. before a measure */
+    void reset();
+
+    /* Percentiles over the window: each call sorts it, keep the result rather than calling again */
+    FrameTimes cpu_times() const;
+    FrameTimes gpu_times() const;
+    inline bool has_gpu_times() const { return !queries.empty(); }
+    inline size_t frames_timed() const { return nb_frames; }
+
+    /* Frames kept: one per line into a .csv, along with their percentiles into a .json */
+    bool dump(const std::string& path) const;
+
+private:
+    void read_results();
+    FrameTimes times(bool gpu) const;
+};
+
+#endif // FRAMEPROFILER_H
@@ -0,0 +1,63 @@
+#ifndef GLSTATS_H
+#define GLSTATS_H
+
+#include <cstddef>
+
+/*
+ * What a frame asked from OpenGL, one per call: binds include unbinding (0),
+ * uniforms only count those sent (Qt skips locations at -1).
+ */
+struct GLCounters {
+    size_t draws;
+    size_t triangles;
+    size_t vao_binds;
+    size_t program_binds;
+    size_t buffer_binds;
+    size_t uniform_sets;
+    size_t bytes_written;   // buffers & textures
+};
+
+/*
+ * Counted only when built with GL_STATS (cmake -DGL_STATS=ON).
+ * Otherwise the GL_STATS_* macros expand to nothing, their arguments are not even evaluated.
+ */
+#ifdef GL_STATS
+
+class GLStats {
+public:
+    /* Frame being drawn */
+    static GLCounters& current()
+    {
+        static GLCounters counters = GLCounters();
+        return counters;
+    }
+
+    /* Last frame drawn */
+    static GLCounters& last()
+    {
+        static GLCounters counters = GLCounters();
+        return counters;
+    }
+
+    static void end_frame()
+    {
+        last() = current();
+        current() = GLCounters();
+    }
+};
+
+#define GL_STATS_ADD(counter, n) (GLStats::current().counter += size_t(n))
+#define GL_STATS_DRAW(mode, elements, instances) \
+    (++GLStats::current().draws, \
+     GLStats::current().triangles += ((mode) == GL_TRIANGLES) ? size_t(elements) / 3 * size_t(instances) : 0)
+#define GL_STATS_END_FRAME() GLStats::end_frame()
+
+#else
+
+#define GL_STATS_ADD(counter, n) ((void)0)
+#define GL_STATS_DRAW(mode, elements, instances) ((void)0)
+#define GL_STATS_END_FRAME() ((void)0)
+
+#endif // GL_STATS
+
+#endif // GLSTATS_H
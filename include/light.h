@@ -4,6 +4,13 @@
 #include <QOpenGLShaderProgram>
 #include <QVector3D>
 
+#include "uniformbuffer.h"
+
+/*
+ * Light of the shaders: position, color, ambient and fixed live into a uniform block
+ * when there is one (use_block()), into plain uniforms otherwise. Either way they are
+ * sent only after they changed. light_on stays a plain uniform, switched between draws.
+ */
 class Light {
 private:
     QVector3D* position;
@@ -18,10 +25,17 @@ private:
     int uniform_location_fixed;
     int uniform_location_is_on;
 
+    UniformBuffer* block;
+    bool dirty;
+
 public:
     Light();
+    Light(const Light&) =delete;
     ~Light();
 
+    /* Before the set_*() ones. False without uniform blocks, plain uniforms then. */
+    bool use_block(QOpenGLShaderProgram* program, GLuint binding);
+
     Light* set_position(float x, float y, float z, int uniform_loc);
     Light* set_color(float r, float g, float b, int uniform_loc);
     Light* set_ambient(float strength, int uniform_loc);
@@ -40,7 +54,7 @@ public:
     bool enabled() const;
     bool is_fixed() const;
 
-    void to_gpu(QOpenGLShaderProgram* program) const;
+    void to_gpu(QOpenGLShaderProgram* program);
     void on(QOpenGLShaderProgram* program=nullptr);
     void off(QOpenGLShaderProgram* program=nullptr);
 };
@@ -16,6 +16,8 @@
 #include <QGroupBox>
 #include <QMenuBar>
 #include <QPushButton>
+#include <QProgressBar>
+#include <QLabel>
 
 #include "ui_mainwindow.h"
 
@@ -26,6 +28,19 @@ private:
     Ui::MainWindow* ui;
     QString save_directory;
 
+    // Mesh loading feedback, into the status bar
+    QProgressBar* loading_progress;
+    QPushButton* loading_cancel;
+
+    // Culled clusters of the last frame, refreshed every second
+    QLabel* culling_stats;
+
+    // Parts, pools & draw calls of the scene
+    QLabel* scene_stats;
+
+    // Percentiles of the CPU & GPU times of the last frames
+    QLabel* frame_stats;
+
 public:
     MainWindow(QWidget *parent=nullptr);
     ~MainWindow() override;
@@ -37,6 +52,11 @@ public:
 
 private:
     void connect_signals_and_slots();
+    void show_loading(bool on);
+    void show_mesh_infos();
+    void show_culling_stats();
+    void show_scene_stats();
+    void show_frame_stats();
 };
 
 #endif // MAINWINDOW_H
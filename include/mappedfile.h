@@ -0,0 +1,32 @@
+#ifndef MAPPEDFILE_H
+#define MAPPEDFILE_H
+
+#include <string>
+#include <cstddef>
+
+/*
+ * Read-only memory mapping of a whole file (POSIX mmap).
+ * The mapping lives as long as the object.
+ */
+class MappedFile {
+private:
+    int fd;
+    char* bytes;
+    size_t length;
+
+public:
+    MappedFile();
+    MappedFile(const MappedFile&) =delete;
+    MappedFile& operator=(const MappedFile&) =delete;
+    ~MappedFile();
+
+    bool open(const std::string& path, bool sequential=true, bool writable=false);
+    void close();
+
+    inline bool is_open() const { return bytes != nullptr; }
+    inline const char* data() const { return bytes; }
+    inline char* data() { return bytes; }
+    inline size_t size() const { return length; }
+};
+
+#endif // MAPPEDFILE_H
@@ -0,0 +1,118 @@
+#ifndef MESHCACHE_H
+#define MESHCACHE_H
+
+#include <cstdint>
+#include <string>
+
+#include "mappedfile.h"
+#include "meshlets.h"
+
+/*
+ * Sidecar binary file (<mesh>.vcache) holding the arrays sent to the GPU:
+ * normalized positions (and their bounding box), normals and triangle indices.
+ *
+ * It is keyed by the source path, size, modification time and content hash.
+ * When only the modification time changed, the content hash decides.
+ * Flags tell how the arrays were prepared: other flags, other content.
+ *
+ * A cache hit maps the file: arrays are used in place, nothing is parsed nor copied.
+ */
+class MeshCache {
+public:
+    enum Flags {
+        VertexCacheOptimized = 1,
+        AreaWeightedNormals = 2,
+        AngleWeightedNormals = 4,
+        ModelNormalized = 8,    // positions kept as read, normalized by the model matrix
+        DetailLevels = 16,      // indices of every level of detail, one after the other
+        Clustered = 32          // full mesh triangles grouped into meshlets
+    };
+
+    static const size_t max_detail_levels = 8;
+
+    /* What write() saves */
+    struct Content {
+        const float* positions;
+        const float* normals;
+        size_t nb_vertices;
+        const uint32_t* indices;
+        size_t nb_indices;
+        size_t nb_faces;
+        const float* bbox_min;
+        const float* bbox_max;
+        uint32_t flags;
+        float acmr[2];  // vertex cache stats, before & after optimization
+        float atvr[2];
+        const size_t* level_elements;   // indices per level of detail (nb_indices in all),
+        size_t nb_levels;               // or nullptr & 0 for a single level
+        const Meshlet* meshlets;        // clusters of the full mesh (level 0), or nullptr & 0
+        size_t nb_meshlets;
+    };
+
+    struct Header {
+        char magic[8];
+        uint32_t version;
+        uint32_t flags;
+        uint64_t path_hash;
+        uint64_t source_size;
+        int64_t source_mtime;       // nanoseconds
+        uint64_t content_hash;
+        uint64_t nb_vertices;
+        uint64_t nb_indices;
+        uint64_t nb_faces;
+        uint64_t positions_offset;  // bytes, from the beginning of the file
+        uint64_t normals_offset;
+        uint64_t indices_offset;
+        float bbox_min[3];
+        float bbox_max[3];
+        float acmr[2];
+        float atvr[2];
+        uint64_t nb_levels;
+        uint64_t level_elements[max_detail_levels];
+        uint64_t nb_meshlets;
+        uint64_t meshlets_offset;
+    };
+
+private:
+    MappedFile file;
+    const Header* header;
+
+public:
+    MeshCache();
+
+    /* Map the cache of `source`, false if there is none, if it is outdated or prepared otherwise. */
+    bool open(const std::string& source, uint32_t flags=0);
+    void close();
+
+    static bool write(const std::string& source, const Content& content);
+
+    static std::string cache_path(const std::string& source);
+    static uint64_t hash(const char* bytes, size_t length);
+
+    inline bool is_open() const { return header != nullptr; }
+    inline size_t mapped_bytes() const { return file.size(); }
+
+    // Copy-on-write pages: writing into these never touches the file.
+    float* positions();
+    float* normals();
+    uint32_t* indices();
+    const Meshlet* meshlets() const;
+
+    inline size_t nb_vertices() const { return size_t(header->nb_vertices); }
+    inline size_t nb_indices() const { return size_t(header->nb_indices); }
+    inline size_t nb_faces() const { return size_t(header->nb_faces); }
+    inline const float* bbox_min() const { return header->bbox_min; }
+    inline const float* bbox_max() const { return header->bbox_max; }
+    inline const float* acmr() const { return header->acmr; }
+    inline const float* atvr() const { return header->atvr; }
+    inline size_t nb_levels() const { return size_t(header->nb_levels); }
+    inline size_t level_elements(size_t level) const { return size_t(header->level_elements[level]); }
+    inline size_t nb_meshlets() const { return size_t(header->nb_meshlets); }
+
+private:
+    static bool source_stats(const std::string& source, uint64_t& size, int64_t& mtime);
+    static bool content_hash(const std::string& source, uint64_t& hash);
+    bool valid() const;
+};
+
+#endif // MESHCACHE_H
@@ -0,0 +1,63 @@
+#ifndef MESHLETS_H
+#define MESHLETS_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+/*
+ * A small cluster of consecutive triangles of the index buffer,
+ * with what culling needs to reject it as a whole.
+ */
+struct Meshlet {
+    uint32_t first;     // first index of the cluster (3 per triangle)
+    uint32_t count;     // number of indices
+    float center[3];    // bounding sphere
+    float radius;
+    float axis[3];      // normal cone: every face normal lies within `angle` of axis,
+    float cone_cos;     // cos(angle), negative when the cone is too wide to ever be back-facing
+    float cone_sin;     // sin(angle)
+};
+
+/* What the last culling did */
+struct CullingStats {
+    size_t clusters;
+    size_t frustum_culled;
+    size_t backface_culled;
+    size_t occlusion_culled;
+    size_t draws;       // ranges of consecutive clusters left
+    size_t triangles;   // triangles left
+};
+
+/*
+ * Load-time clustering of triangle lists, and per-frame culling of the clusters.
+ *
+ * Clusters grow from a seed triangle through shared vertices,
+ * preferring triangles that bring the fewest new vertices, then the closest ones:
+ * they end up small, spatially coherent, and still vertex cache friendly.
+ * Clusters are then sorted along a Morton curve.
+ */
+class Meshlets {
+public:
+    static const size_t max_vertices = 64;
+    static const size_t max_triangles = 124;
+
+    /* order[new triangle] = old triangle; meshlets[] cover the new triangles, in order. */
+    static void build(const float* positions, size_t nb_vertices,
+                      const uint32_t* indices, size_t nb_triangles,
+                      std::vector<uint32_t>& order, std::vector<Meshlet>& meshlets);
+
+    /* Planes (a, b, c, d: inside when ax+by+cz+d >= 0) of a column-major clip matrix, into its source space. */
+    static void frustum_planes(const float* clip, float planes[6][4]);
+
+    static bool outside_frustum(const Meshlet& meshlet, const float planes[6][4]);
+
+    /* Every triangle seen from behind (counter clock-wise front faces) from `camera`. */
+    static bool back_facing(const Meshlet& meshlet, const float* camera);
+
+private:
+    static void sort_spatially(std::vector<uint32_t>& order, std::vector<Meshlet>& meshlets);
+    static void bounds(const float* positions, const uint32_t* indices, const uint32_t* order, Meshlet& meshlet);
+};
+
+#endif // MESHLETS_H
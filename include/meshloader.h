@@ -0,0 +1,58 @@
+#ifndef MESHLOADER_H
+#define MESHLOADER_H
+
+#include <atomic>
+#include <string>
+
+#include <QThread>
+#include <QString>
+
+#include "meshobject.h"
+
+// MeshObject pointers travel through queued connections (worker -> GUI thread).
+Q_DECLARE_METATYPE(MeshObject*)
+
+/*
+ * Worker thread which reads, normalizes and prepares a MeshObject
+ * without blocking the GUI thread.
+ * The OpenGL upload is left to the receiver of the `loaded` signal.
+ */
+class MeshLoader : public QThread
+{
+    Q_OBJECT
+private:
+    std::string path;
+    std::atomic<bool> cancelled;
+    bool vertex_cache_optimization;
+    NormalWeighting normal_weighting;
+    bool model_normalization;
+    bool detail_levels;
+
+public:
+    MeshLoader(const std::string& path, QObject* parent=nullptr);
+    ~MeshLoader() override;
+
+    void cancel();
+    bool is_cancelled() const;
+
+    /* To be set before start() */
+    void set_vertex_cache_optimization(bool on);
+    void set_normal_weighting(NormalWeighting weighting);
+    void set_model_normalization(bool on);
+    void set_detail_levels(bool on);
+
+    inline const std::string& file_path() const { return path; }
+
+signals:
+    void progress(int percent, const QString& stage);
+
+    /* The receiver takes ownership of the mesh. */
+    void loaded(MeshObject* mesh);
+    void failed(const QString& path);
+    void aborted();
+
+protected:
+    void run() override;
+};
+
+#endif // MESHLOADER_H
@@ -0,0 +1,37 @@
+#ifndef MESHNORMALS_H
+#define MESHNORMALS_H
+
+#include <cstddef>
+#include <cstdint>
+
+/* How face normals are weighted around a vertex */
+enum class NormalWeighting {
+    Uniform,    // plain sum of unit face normals, like OpenMesh update_vertex_normals()
+    Area,       // by face area
+    Angle       // by corner angle
+};
+
+/*
+ * Face & vertex normals of a triangle list, computed by several threads
+ * straight from flat arrays (no halfedge circulation).
+ *
+ * Every thread handles a range of triangles and sums its vertex contributions
+ * into its own buffer, which only spans the vertices that range uses:
+ * no atomics, and little memory when triangles are well ordered (see VertexCache).
+ * Partial sums are then gathered per vertex range.
+ */
+class MeshNormals {
+public:
+    /*
+     * positions: x, y, z per vertex; indices: 3 per triangle.
+     * face_normals (3 floats per triangle) can be nullptr.
+     * Normals come out unit length, or zero when degenerated.
+     */
+    static void compute(const float* positions, size_t nb_vertices,
+                        const uint32_t* indices, size_t nb_triangles,
+                        float* face_normals, float* vertex_normals,
+                        NormalWeighting weighting=NormalWeighting::Uniform,
+                        unsigned int nb_threads=0);
+};
+
+#endif // MESHNORMALS_H
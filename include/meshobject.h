@@ -2,10 +2,20 @@
 #define MESHOBJECT_H
 
 #include <string>
+#include <functional>
+#include <memory>
+#include <vector>
 
 #include <OpenMesh/Core/IO/MeshIO.hh>
 #include <OpenMesh/Core/Mesh/TriMesh_ArrayKernelT.hh>
 #include "drawableobject.h"
+#include "meshreader.h"
+#include "meshcache.h"
+#include "vertexcache.h"
+#include "meshnormals.h"
+#include "boundingbox.h"
+#include "meshlets.h"
+#include "occlusionculling.h"
 
 struct MyTraits : public OpenMesh::DefaultTraits {
     VertexAttributes(OpenMesh::Attributes::Normal);
@@ -15,6 +25,13 @@ struct MyTraits : public OpenMesh::DefaultTraits {
 
 typedef OpenMesh::TriMesh_ArrayKernelT<MyTraits> MyMesh;
 
+/*
+ * Called between every loading stage with the progress (0-100)
+ * and a short description of the next stage.
+ * Returning false aborts the loading.
+ */
+typedef std::function<bool(int, const std::string&)> LoadingCallback;
+
 class MeshObject : public DrawableObject
 {
 private:
@@ -23,19 +40,133 @@ private:
     size_t _nb_vertices;
     MyMesh mesh;
 
+    // On a cache hit, arrays are read from there and `mesh` stays empty.
+    // Shared with the arrays borrowed from it: the mapping lives as long as one of them.
+    std::shared_ptr<MeshCache> cache;
+
+    // Triangle indices computed by load(), handed over to DrawableObject by build().
+    GLuint* packed_indices;
+
+    // Render-only mode also frees `mesh` (no more re-upload from CPU).
+    bool drop_halfedge_mesh;
+
+    // Bounding box of the uploaded positions, known since reading (or the cache).
+    BoundingBox bbox;
+
+    // Normalize through the model matrix instead of rewriting every point.
+    bool model_normalization;
+
+    // Vertex cache optimization: asked for, done (here or by the cache), before/after stats.
+    bool vertex_cache_optimization;
+    bool vertex_cache_optimized;
+    VertexCacheStats vertex_cache_stats[2];
+
+    // Optimized orders: face_order[new] = old face, vertex_order[new] = old vertex, vertex_remap[old] = new vertex.
+    // Empty when the halfedge mesh order is used as is.
+    std::vector<GLuint> face_order;
+    std::vector<GLuint> vertex_order;
+    std::vector<GLuint> vertex_remap;
+
+    NormalWeighting normal_weighting;
+
+    // Levels of detail: asked for, indices of levels 1..n (decimated faces over the same vertices)
+    // one after the other, and the number of indices of every level, 0 included.
+    bool detail_levels_generation;
+    std::vector<GLuint> detail_indices;
+    std::vector<size_t> detail_elements;
+
+    // Clusters of the full mesh triangles: asked for, built (or read from the cache),
+    // culled per frame when enabled, and what was left by the last culling.
+    bool meshlets_generation;
+    std::vector<Meshlet> meshlets;
+    bool cluster_culling;
+    CullingStats culling;
+    std::vector<ElementRange> visible_ranges;
+
+    // Occlusion queries over runs of clusters, created by build().
+    bool occlusion_culling;
+    OcclusionCulling* occlusion;
+
 private:
     std::string filename_from_path(const std::string& path) const;
+    void pack();
+    void write_faces(GLuint* buffer, size_t first, size_t count) const;
+    void optimize_vertex_cache();
+    void generate_detail_levels();
+    void build_meshlets();
+    void build_occlusion(QOpenGLShaderProgram* program);
+    void assign(const RawMesh& raw);
+    void free_packed();
+    void normalize_model();
+    size_t detail_level_for(const QMatrix4x4& model_view, const QMatrix4x4& projection, int viewport_height, const float (*planes)[4]) const;
+    void select_instance_levels(const QMatrix4x4& projection, const QMatrix4x4& view, int viewport_height);
 
 public:
+    MeshObject();
     MeshObject(const std::string&);
+    MeshObject(const MeshObject&) =delete;
     ~MeshObject() override;
 
+    /* Read, normalize and prepare the mesh. Does not need any OpenGL context. */
+    bool load(const std::string& path, const LoadingCallback& callback=nullptr);
+
     bool build(QOpenGLShaderProgram* program) override;
     void normalize();
 
+    void set_drop_halfedge_mesh(bool on);
+
+    /* Reorder triangles & vertices for the GPU vertex cache, used by the next load(). */
+    void set_vertex_cache_optimization(bool on);
+    void set_normal_weighting(NormalWeighting weighting);
+    void set_model_normalization(bool on);
+    void set_detail_levels_generation(bool on);
+    void set_meshlets_generation(bool on);
+
+    /* Per frame culling of the clusters, only at the full level of detail and without instances. */
+    void set_cluster_culling(bool on);
+
+    /*
+     * Coarsest level still giving about a triangle per covered pixel (perspective projection).
+     * Instances: one level each, those out of the frustum are culled.
+     */
+    void select_detail_level(const QMatrix4x4& projection, const QMatrix4x4& view, int viewport_height);
+
+    /* Clusters hidden by what was drawn before them, tested by query_occlusion(). */
+    void set_occlusion_culling(bool on);
+
+    /*
+     * Leave out clusters outside the frustum, facing away from the camera if `back_faces` are culled,
+     * or found occluded by the last queries.
+     */
+    void cull_clusters(const QMatrix4x4& projection, const QMatrix4x4& view, bool back_faces);
+
+    /* Once the frame is drawn: occlusion queries, read by the next cull_clusters(). */
+    void query_occlusion(QOpenGLShaderProgram* program);
+
+    size_t cpu_memory() const override;
+
+protected:
+    void fill_vertices_coordinates(GLfloat* buffer, size_t stride, size_t first, size_t count) const override;
+    void fill_vertices_colors(GLfloat* buffer, size_t stride, size_t first, size_t count) const override;
+    void fill_vertices_normals(GLfloat* buffer, size_t stride, size_t first, size_t count) const override;
+    void fill_vertices_indices(GLuint* buffer, size_t first, size_t count) const override;
+
+    void bounding_box(GLfloat* min, GLfloat* max) const override;
+    bool uniform_colors(GLfloat* color) const override;
+
+    bool has_cpu_geometry() const override;
+    void release_cpu_data() override;
+
+public:
     inline size_t nb_faces() const { return _nb_faces; }
     inline size_t nb_vertices() const { return _nb_vertices; }
     inline const std::string& name() const { return _name; }
+    inline bool is_vertex_cache_optimized() const { return vertex_cache_optimized; }
+    inline const VertexCacheStats& vertex_cache_before() const { return vertex_cache_stats[0]; }
+    inline const VertexCacheStats& vertex_cache_after() const { return vertex_cache_stats[1]; }
+    inline size_t nb_meshlets() const { return meshlets.size(); }
+    inline const CullingStats& culling_stats() const { return culling; }
+    inline const OcclusionStats& occlusion_stats() const { return occlusion->statistics(); }
 };
 
 #endif // MESHOBJECT_H
@@ -0,0 +1,45 @@
+#ifndef MESHREADER_H
+#define MESHREADER_H
+
+#include <string>
+#include <vector>
+
+#include "boundingbox.h"
+
+/*
+ * Flat triangle soup: what the GPU wants, without any halfedge structure.
+ */
+struct RawMesh {
+    std::vector<float> positions;       // x, y, z per vertex
+    std::vector<unsigned int> indices;  // 3 per triangle
+    BoundingBox bbox;                   // of the positions, computed while parsing
+
+    inline size_t nb_vertices() const { return positions.size()/3; }
+    inline size_t nb_triangles() const { return indices.size()/3; }
+};
+
+/*
+ * Fast path for ASCII OBJ & OFF files.
+ *
+ * The file is memory mapped, cut into line-aligned chunks,
+ * and every chunk is parsed by its own thread.
+ * Polygons are triangulated as fans.
+ *
+ * read() returns false for anything it does not understand
+ * (binary OFF, broken indices ...), callers should then fall back on OpenMesh::IO.
+ */
+class MeshReader {
+public:
+    static bool can_read(const std::string& path);
+    static bool read(const std::string& path, RawMesh& mesh, unsigned int nb_threads=0);
+
+    /* Locale independent number parsing. Return the position after the number, nullptr on error. */
+    static const char* parse_float(const char* first, const char* last, float& value);
+    static const char* parse_int(const char* first, const char* last, long& value);
+
+private:
+    static bool read_obj(const char* first, const char* last, RawMesh& mesh, unsigned int nb_threads);
+    static bool read_off(const char* first, const char* last, RawMesh& mesh, unsigned int nb_threads);
+};
+
+#endif // MESHREADER_H
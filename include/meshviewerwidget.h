@@ -11,6 +11,7 @@
 #include <QDesktopServices>
 #include <QMessageBox>
 
+#include <QTimer>
 #include <QTimerEvent>
 
 #include <QMouseEvent>
@@ -26,11 +27,17 @@
 #include <QInputDialog>
 
 #include <QProgressBar>
+#include <QLabel>
 
 #include "axis.h"
 #include "light.h"
 #include "arcball.h"
 #include "meshobject.h"
+#include "meshloader.h"
+#include "scene.h"
+#include "renderer.h"
+#include "frameprofiler.h"
+#include "glstats.h"
 
 typedef std::chrono::steady_clock Clock;
 
@@ -43,17 +50,23 @@ class MeshViewerWidget: public QOpenGLWidget
     Q_OBJECT
 /* Private members */
 private:
-    QOpenGLShaderProgram* program;
+    // Program, camera & light, and the mesh part of paintGL() (shared with viewer_bench)
+    Renderer* renderer;
+    QOpenGLShaderProgram* program; // the renderer's
 
     /* Matrix which compose our Model View Projection Matrix -- uniform values */
     QMatrix4x4 view;
     QMatrix4x4 projection;
 
-    // FPS related
+    // Camera uniforms are sent only once view or projection changed.
+    bool camera_dirty;
+
+    // FPS related: frames are drawn on request only (request_frame()),
+    // `frequency` (microseconds) apart at least, the next one waiting on frame_timer.
     Clock::time_point lap;
     long frequency;
     size_t frames;
-    int timer_id_0;
+    QTimer* frame_timer;
 
     // Mouse related
     bool mouse_pressed;
@@ -69,16 +82,73 @@ private:
     float window_ratio;
 
     // User objects into our scene
-    Light* light;
     ArcBall* arcball;
     Axis* axis;
     MeshObject* mesh;
 
+    // Parts drawn along with `mesh`, from shared buffers
+    Scene* scene;
+
+    // Mesh being loaded in background, `mesh` is still rendered meanwhile.
+    // Into the scene: added as a new part instead of replacing `mesh`.
+    MeshLoader* loader;
+    bool loading_into_scene;
+
     // DISPLAY METHODS
     bool wireframe_on;
     bool fill_on;
     bool smooth_on;
     bool axis_on;
+    bool back_faces_on;
+
+    // MEMORY MODE
+    bool render_only_on;
+    bool drop_halfedges_on;
+
+    // Load-time triangle & vertex reordering
+    bool vertex_cache_on;
+    NormalWeighting normal_weighting;
+    bool model_normalization_on;
+
+    // Decimated levels of detail, picked every frame from the mesh size on screen
+    bool detail_levels_on;
+
+    // Clusters outside the frustum (or facing away, back faces culled) left out of full detail frames
+    bool cluster_culling_on;
+
+    // Clusters hidden behind what the previous frames drew, from occlusion queries
+    bool occlusion_culling_on;
+
+    // Copies of the mesh drawn by instancing, 1: the mesh alone
+    size_t nb_instances;
+
+    // Interaction: a coarser level while the camera moves (proxy_level),
+    // chosen to fit into target_frame_time (microseconds), back to full detail after interaction_hold (ms) without input.
+    bool interactive_lod_on;
+    bool progressive_refine_on;
+    bool interacting;
+    long interaction_hold;
+    long target_frame_time;
+    size_t proxy_level;
+    Clock::time_point last_interaction;
+
+    // Triangles drawn by the last frame, and the smoothed time (microseconds) per triangle of frames,
+    // from paintGL() to their swap.
+    Clock::time_point frame_start;
+    size_t frame_triangles;
+    float frame_cost;
+
+    // CPU & GPU time of every frame, for percentiles
+    FrameProfiler* profiler;
+
+#ifdef GL_STATS
+    // GL calls of the last frame, over the top-left corner
+    QLabel* hud;
+#endif
+
+    // VBO layout & attributes formats of the meshes
+    VertexLayout vertex_layout;
+    VertexFormat vertex_format;
 
 /* Public methods */
 public:
@@ -97,9 +167,6 @@ public:
     void mousePressEvent(QMouseEvent*) override;
     void mouseReleaseEvent(QMouseEvent*) override;
 
-    /* QTimerEvent */
-    void timerEvent(QTimerEvent*) override;
-
     /* Wheel */
     void wheelEvent(QWheelEvent*) override;
 
@@ -114,6 +181,9 @@ public:
     /* caps frames per second */
     void set_frames_per_second(size_t fps);
 
+    /* Something to show changed: a frame as soon as the frame rate allows it, never more than one pending */
+    void request_frame();
+
     /* Number of frames drawn during the last second */
     size_t get_computed_frames() const;
 
@@ -132,19 +202,35 @@ public:
     /* Reset view matrix to default */
     void reset_view();
 
+    /* Coarse proxy while the camera moves: full detail after `hold_ms` without input, a frame should take `frame_ms` */
+    void set_interactive_lod(bool on);
+    void set_progressive_refine(bool on);
+    void set_interaction_hold(int hold_ms);
+    void set_target_frame_time(int frame_ms);
+    inline int interaction_hold_ms() const { return int(interaction_hold); }
+    inline int target_frame_time_ms() const { return int(target_frame_time / 1000); }
+
     inline void use_default_bg_color(){
         makeCurrent();
         glClearColor(252.0f/255.0f, 224.0f/255.0f, 239.0f/255.0f, 1.0f);
+        request_frame();
     }
 
     inline void set_bg_color(float r, float g, float b)
     {
         makeCurrent();
         glClearColor(r, g, b, 1.0f);
+        request_frame();
     }
 
-    inline Light* get_light() const { return light; }
+    inline Light* get_light() const { return renderer->get_light(); }
     inline MeshObject* get_mesh() const { return mesh; }
+    inline Scene* get_scene() const { return scene; }
+    inline const FrameProfiler* get_profiler() const { return profiler; }
+
+    /* Overlay of the GL calls counted for the last frame: nothing without GL_STATS */
+    void show_hud(bool on);
+    inline size_t instances() const { return nb_instances; }
 
     /* *********************************************** */
     /* STATIC METHODS */
@@ -153,14 +239,34 @@ public:
     long microseconds_diff(Clock::time_point t1, Clock::time_point t2);
 
     /* ********************************************* */
+signals:
+    void mesh_loading(int percent, const QString& stage);
+    void mesh_loaded();
+    void mesh_loading_failed(const QString& path);
+    void mesh_loading_aborted();
+    void detail_level_changed(size_t level);
+
 public slots:
     void load_mesh_file(const std::string& str);
+    void add_mesh_file(const std::string& str);
+    void clear_scene();
+    void cancel_loading();
     void draw_back_faces(bool mode);
     void take_screenshots(int w, int h, Qt::AspectRatioMode aspect, int nimages, int quality, int format, QString dir, QProgressBar* pb);
     void show_axis(bool mode);
     void draw_wireframe(bool mode);
     void update_mesh_color(float r, float g, float b);
     void flip_back_faces(bool mode);
+    void set_render_only(bool on, bool drop_halfedges);
+    void set_vertex_layout(VertexLayout layout);
+    void set_vertex_format(const VertexFormat& format);
+    void set_vertex_cache_optimization(bool on);
+    void set_normal_weighting(NormalWeighting weighting);
+    void set_model_normalization(bool on);
+    void set_detail_levels(bool on);
+    void set_cluster_culling(bool on);
+    void set_occlusion_culling(bool on);
+    void set_instances(int count);
 
 /* Private methods */
 private:
@@ -173,7 +279,20 @@ private:
 
     void update_lap();
 
+    void interaction();
+    void update_proxy_level();
+    size_t budget_detail_level() const;
+
     void draw_axis(QOpenGLShaderProgram* program);
+    void update_hud();
+    void start_loading(const std::string& path, bool into_scene);
+    void add_to_scene(MeshObject* mesh);
+    bool apply_instances(MeshObject* mesh);
+
+private slots:
+    void frame_swapped();
+    void swap_mesh(MeshObject* mesh);
+    void loader_finished();
 };
 
 #endif // MESHVIEWERWIDGET_H
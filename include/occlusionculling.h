@@ -0,0 +1,98 @@
+#ifndef OCCLUSIONCULLING_H
+#define OCCLUSIONCULLING_H
+
+#include <QOpenGLShaderProgram>
+#include <QOpenGLVertexArrayObject>
+#include <QOpenGLBuffer>
+
+#include <QMatrix4x4>
+
+#include <vector>
+
+#include "meshlets.h"
+
+typedef void (QOPENGLF_APIENTRYP GenQueries)(GLsizei, GLuint*);
+typedef void (QOPENGLF_APIENTRYP DeleteQueries)(GLsizei, const GLuint*);
+typedef void (QOPENGLF_APIENTRYP BeginQuery)(GLenum, GLuint);
+typedef void (QOPENGLF_APIENTRYP EndQuery)(GLenum);
+typedef void (QOPENGLF_APIENTRYP GetQueryObjectuiv)(GLuint, GLenum, GLuint*);
+
+/* What the last frame did */
+struct OcclusionStats {
+    size_t chunks;
+    size_t occluded;    // chunks left out
+    size_t queries;     // boxes tested
+    size_t pending;     // results still on their way, previous visibility kept
+    size_t changed;     // chunks the results came back different for
+};
+
+/*
+ * Hardware occlusion queries over runs of consecutive meshlets (chunks),
+ * in the spirit of coherent hierarchical culling:
+ *  - chunks are drawn or not from the last results known, nothing ever waits for the GPU;
+ *  - once the frame is drawn, the boxes of occluded chunks are tested against its depth,
+ *    visible ones only every few frames (they are likely to stay visible);
+ *  - results are read when available, a chunk keeps its visibility meanwhile.
+ * A chunk that shows up again is drawn one frame late.
+ */
+class OcclusionCulling {
+private:
+    struct Chunk {
+        size_t first_meshlet;
+        size_t nb_meshlets;
+        float min[3];
+        float max[3];
+        GLuint query;
+        bool pending;       // query issued, result not read yet
+        bool visible;
+        bool in_frustum;    // this frame
+    };
+
+    std::vector<Chunk> chunks;
+    std::vector<size_t> meshlet_chunk;
+
+    GLenum target;  // GL_ANY_SAMPLES_PASSED, or GL_SAMPLES_PASSED before OpenGL 3.3
+    GenQueries gen_queries;
+    DeleteQueries delete_queries;
+    BeginQuery begin_query;
+    EndQuery end_query;
+    GetQueryObjectuiv get_query_object;
+
+    // Boxes of the chunks, 36 vertices (12 triangles) each
+    QOpenGLVertexArrayObject* vao;
+    QOpenGLBuffer* vbo;
+    int location_model;
+
+    // Of the last update(), boxes crossing it are not tested
+    float near_plane[4];
+
+    size_t frame;
+    OcclusionStats stats;
+
+public:
+    OcclusionCulling();
+    OcclusionCulling(const OcclusionCulling&) =delete;
+    ~OcclusionCulling();
+
+    /* Needs the OpenGL context. False when queries are not supported. */
+    bool build(const std::vector<Meshlet>& meshlets, QOpenGLShaderProgram* program);
+
+    /* Start of a frame: read the results that came back, test chunks against the frustum. */
+    void update(const float planes[6][4]);
+
+    /* Every chunk visible again (e.g. after frames drawn without the queries). */
+    void reset();
+
+    inline bool is_occluded(size_t meshlet) const { return !chunks[meshlet_chunk[meshlet]].visible; }
+
+    /* End of a frame: test boxes against the depth buffer, `model` places them like the meshlets. */
+    void query(QOpenGLShaderProgram* program, const QMatrix4x4& model);
+
+    inline bool is_built() const { return vao != nullptr; }
+    inline const OcclusionStats& statistics() const { return stats; }
+
+private:
+    void free();
+};
+
+#endif // OCCLUSIONCULLING_H
@@ -0,0 +1,24 @@
+#ifndef PARALLEL_H
+#define PARALLEL_H
+
+#include <cstddef>
+#include <thread>
+#include <vector>
+
+/* Run task(i) for every i in [0, n[, one thread each. The calling thread takes the first one. */
+template<typename Task>
+inline void
+parallel_for(size_t n, const Task& task)
+{
+    std::vector<std::thread> threads;
+    for(size_t i=1; i < n; ++i)
+        threads.emplace_back(task, i);
+
+    if( n > 0 )
+        task(0);
+
+    for(auto& t: threads)
+        t.join();
+}
+
+#endif // PARALLEL_H
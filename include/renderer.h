@@ -0,0 +1,64 @@
+#ifndef RENDERER_H
+#define RENDERER_H
+
+#include <QOpenGLShaderProgram>
+#include <QMatrix4x4>
+
+#include <string>
+
+#include "light.h"
+#include "meshobject.h"
+#include "scene.h"
+#include "uniformbuffer.h"
+
+/*
+ * The frame of the viewer, shared by MeshViewerWidget and viewer_bench:
+ * the shader program with its camera & light, then the mesh (level of detail, culling)
+ * and the scene drawn by it. Everything here needs the OpenGL context current.
+ */
+class Renderer {
+private:
+    QOpenGLShaderProgram* program;
+
+    // Camera block of the shaders (plain uniforms at these locations without it)
+    UniformBuffer* camera_block;
+    int location_view_projection;
+    int location_view;
+    int location_view_inverse;
+
+    Light* light;
+
+    size_t nb_triangles;
+
+public:
+    Renderer();
+    Renderer(const Renderer&) =delete;
+    ~Renderer();
+
+    /* simple.vert.glsl & simple.frag.glsl from `shaders_dir`, camera block and default light. */
+    bool create(const std::string& shaders_dir);
+
+    /* Program bound, light sent when it changed, the camera when `camera_changed`. */
+    void begin_frame(const QMatrix4x4& projection, const QMatrix4x4& view, bool camera_changed);
+
+    /*
+     * The mesh then the scene, either may be null. The mesh level fits a viewport `height` pixels high,
+     * no finer than `min_level` (interaction proxy, 0: none), then its clusters are culled
+     * (against their orientation too when `cull_back_faces`) and the occlusion queries issued.
+     */
+    void draw(MeshObject* mesh, Scene* scene, const QMatrix4x4& projection, const QMatrix4x4& view,
+              int height, size_t min_level, bool cull_back_faces);
+
+    void end_frame();
+
+    /* Camera uniforms: view_projection, view then view_inverse (program bound). */
+    void upload_camera(const QMatrix4x4& projection, const QMatrix4x4& view);
+
+    /* Triangles of the last draw() */
+    inline size_t triangles() const { return nb_triangles; }
+
+    inline QOpenGLShaderProgram* get_program() const { return program; }
+    inline Light* get_light() const { return light; }
+};
+
+#endif // RENDERER_H
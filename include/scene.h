@@ -0,0 +1,92 @@
+#ifndef SCENE_H
+#define SCENE_H
+
+#include <QOpenGLShaderProgram>
+#include <QOpenGLVertexArrayObject>
+#include <QOpenGLBuffer>
+
+#include <QMatrix4x4>
+
+#include <vector>
+
+#include "drawableobject.h"
+
+/*
+ * Many objects (parts) drawn together, each with its own transform.
+ *
+ * Parts are suballocated one after the other into a few large buffers (pools),
+ * their indices already offset to their first vertex: a pool draws every visible part
+ * with a single call. Transforms live into a float texture (one row per part),
+ * fetched by the vertex shader from the part index of each vertex.
+ * Adding a part or moving one only writes what belongs to it.
+ */
+class Scene {
+private:
+    struct Pool {
+        QOpenGLVertexArrayObject* vao;
+        QOpenGLBuffer* vbo;
+        QOpenGLBuffer* ebo;
+        size_t vertex_capacity;
+        size_t index_capacity;
+        size_t nb_vertices;
+        size_t nb_indices;
+
+        // Visible parts of the pool, merged when consecutive, ready for the draw call.
+        std::vector<GLsizei> counts;
+        std::vector<const void*> offsets;
+    };
+
+    struct Part {
+        size_t pool;
+        size_t first;   // first index into the pool EBO
+        size_t count;
+        bool visible;
+    };
+
+    std::vector<Pool> pools;
+    std::vector<Part> parts;
+    bool ranges_dirty;
+
+    // Per part: model matrix then its inverse transpose (for normals), column after column.
+    std::vector<GLfloat> transforms;
+    GLuint transforms_texture;
+    size_t transforms_capacity;
+
+    int location_scene_on;
+    int location_part_transforms;
+
+    MultiDrawElements multi_draw_elements;
+    size_t draw_calls;
+    size_t nb_triangles;
+
+public:
+    Scene();
+    Scene(const Scene&) =delete;
+    ~Scene();
+
+    /*
+     * Upload a built object into the pools (OpenGL context current),
+     * then delete it: the scene keeps nothing else of it. Its part index is nb_parts()-1.
+     */
+    bool add(DrawableObject* object, QOpenGLShaderProgram* program, const QMatrix4x4& transform);
+
+    void set_transform(size_t part, const QMatrix4x4& transform);
+    void set_visible(size_t part, bool visible);
+    void clear();
+
+    void show(QOpenGLShaderProgram* program, GLenum mode);
+
+    inline bool is_empty() const { return parts.empty(); }
+    inline size_t nb_parts() const { return parts.size(); }
+    inline size_t nb_pools() const { return pools.size(); }
+    inline size_t triangles() const { return nb_triangles; }
+    inline size_t last_draw_calls() const { return draw_calls; }
+    size_t gpu_memory() const;
+
+private:
+    bool create_pool(QOpenGLShaderProgram* program, size_t vertices, size_t indices);
+    void upload_transforms(size_t first, size_t count, bool resize);
+    void update_ranges();
+};
+
+#endif // SCENE_H
@@ -0,0 +1,77 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <string>
+#include <vector>
+
+/*
+ * Scoped trace markers written as Chrome trace events (JSON, opened by Perfetto or chrome://tracing).
+ * Nothing is recorded until start() (viewer --trace <file>): a marker then costs a relaxed atomic load.
+ * Events are kept in memory, the file is written by stop().
+ */
+class Trace {
+private:
+    struct Event {
+        const char* name;   // string literal
+        int thread;
+        long long begin;    // microseconds since start()
+        long long duration;
+    };
+
+    static std::atomic<bool> on;
+    static std::mutex mutex;
+    static std::vector<Event> events;
+    static std::vector<std::pair<int, std::string>> thread_names;
+    static std::string file_path;
+    static std::chrono::steady_clock::time_point origin;
+
+public:
+    static bool start(const std::string& path);
+    static bool stop();
+
+    static inline bool enabled() { return on.load(std::memory_order_relaxed); }
+
+    /* Small id of the calling thread, the same for its whole life */
+    static int thread_id();
+
+    /* Name of the calling thread into the trace */
+    static void name_thread(const std::string& name);
+
+    static void record(const char* name, std::chrono::steady_clock::time_point begin,
+                       std::chrono::steady_clock::time_point end);
+};
+
+/* From its construction to the end of its scope, when tracing */
+class TraceScope {
+private:
+    const char* name;
+    bool active;
+    std::chrono::steady_clock::time_point begin;
+
+public:
+    explicit TraceScope(const char* scope_name):
+        name(scope_name), active(Trace::enabled())
+    {
+        if( active )
+            begin = std::chrono::steady_clock::now();
+    }
+
+    TraceScope(const TraceScope&) =delete;
+
+    ~TraceScope()
+    {
+        if( active )
+            Trace::record(name, begin, std::chrono::steady_clock::now());
+    }
+};
+
+#define TRACE_CONCAT_(a, b) a##b
+#define TRACE_CONCAT(a, b) TRACE_CONCAT_(a, b)
+
+/* `name` must be a string literal */
+#define TRACE_SCOPE(name) TraceScope TRACE_CONCAT(trace_scope_, __LINE__)(name)
+
+#endif // TRACE_H
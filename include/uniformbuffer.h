@@ -0,0 +1,51 @@
+#ifndef UNIFORMBUFFER_H
+#define UNIFORMBUFFER_H
+
+#include <QOpenGLShaderProgram>
+
+typedef void (QOPENGLF_APIENTRYP GenBuffers)(GLsizei, GLuint*);
+typedef void (QOPENGLF_APIENTRYP DeleteBuffers)(GLsizei, const GLuint*);
+typedef void (QOPENGLF_APIENTRYP BindBuffer)(GLenum, GLuint);
+typedef void (QOPENGLF_APIENTRYP BufferData)(GLenum, GLsizeiptr, const void*, GLenum);
+typedef void (QOPENGLF_APIENTRYP BufferSubData)(GLenum, GLintptr, GLsizeiptr, const void*);
+typedef void (QOPENGLF_APIENTRYP BindBufferBase)(GLenum, GLuint, GLuint);
+typedef GLuint (QOPENGLF_APIENTRYP GetUniformBlockIndex)(GLuint, const GLchar*);
+typedef void (QOPENGLF_APIENTRYP UniformBlockBinding)(GLuint, GLuint, GLuint);
+
+/*
+ * Uniform block of the shaders (std140 layout) backed by a buffer of its own,
+ * shared by every draw of a frame: it is written when its content changes, not before each draw.
+ * Needs OpenGL 3.1 (or GL_ARB_uniform_buffer_object) and the block to be active into the program,
+ * create() says false otherwise and the block members are plain uniforms.
+ */
+class UniformBuffer {
+private:
+    GLuint buffer;
+    GLuint binding;
+    size_t size;
+
+    GenBuffers gen_buffers;
+    DeleteBuffers delete_buffers;
+    BindBuffer bind_buffer;
+    BufferData buffer_data;
+    BufferSubData buffer_sub_data;
+    BindBufferBase bind_buffer_base;
+
+public:
+    UniformBuffer();
+    UniformBuffer(const UniformBuffer&) =delete;
+    ~UniformBuffer();
+
+    /* OpenGL context current. `bytes` of the block, as laid out by std140. */
+    bool create(QOpenGLShaderProgram* program, const char* block, GLuint binding_point, size_t bytes);
+    void destroy();
+
+    /* Part of the block, `offset` and `bytes` as laid out by std140. */
+    void write(size_t offset, const void* data, size_t bytes);
+
+    inline bool is_created() const { return buffer != 0; }
+
+    static bool is_supported();
+};
+
+#endif // UNIFORMBUFFER_H
@@ -1,12 +1,24 @@
 #version 130
+#extension GL_ARB_uniform_buffer_object : enable
 
 in vec3 fragment_color;
 in vec3 vertex_normal;
 in vec3 position_view;
 in vec3 light_direction;
 
+// Same block as the vertex shader's
+#ifdef GL_ARB_uniform_buffer_object
+layout(std140) uniform LightBlock {
+    vec3 light_position;
+    float light_ambient;
+    vec3 light_color;
+    bool light_fixed;
+};
+#else
 uniform vec3 light_color;
 uniform float light_ambient;
+#endif
+
 uniform bool light_on;
 
 uniform bool smooth_on;
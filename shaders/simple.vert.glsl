@@ -1,39 +1,93 @@
 #version 130
+#extension GL_ARB_uniform_buffer_object : enable
 
 // Get it via Buffer Object
 in vec3 position;
 in vec3 color;
 in vec3 normal;
+in float part;  // index of the part into a Scene
+in mat4 instance_model;     // per instance, see DrawableObject::set_instances()
+in mat4 instance_normal;    // its inverse transpose
 
 // Not via Buffer Object
 uniform mat4 model;
-uniform mat4 view;
-uniform mat4 projection;
 uniform mat4 model_inverse;
+
+// Written when they change, see UniformBuffer (plain uniforms without uniform blocks)
+#ifdef GL_ARB_uniform_buffer_object
+layout(std140) uniform Camera {
+    mat4 view_projection;   // projection * view
+    mat4 view;
+    mat4 view_inverse;
+};
+
+layout(std140) uniform LightBlock {
+    vec3 light_position;
+    float light_ambient;
+    vec3 light_color;
+    bool light_fixed;
+};
+#else
+uniform mat4 view_projection;
+uniform mat4 view;
 uniform mat4 view_inverse;
 
 uniform vec3 light_position;
-uniform vec3 light_color;
 uniform float light_ambient;
-uniform bool light_on;
+uniform vec3 light_color;
 uniform bool light_fixed;
+#endif
+
+uniform bool light_on;
 
 uniform bool flip_bfaces;
 
+// Scene parts: model & model_inverse come from row `part` of the texture
+uniform bool scene_on;
+uniform sampler2D part_transforms;
+
+// Instances: placed by their own matrix, after the model one
+uniform bool instances_on;
+
 // To Fragment Shader
 out vec3 fragment_color;
 out vec3 vertex_normal;
 out vec3 position_view;
 out vec3 light_direction;
 
+mat4 part_matrix(int row, int first)
+{
+    return mat4(
+        texelFetch(part_transforms, ivec2(first, row), 0),
+        texelFetch(part_transforms, ivec2(first + 1, row), 0),
+        texelFetch(part_transforms, ivec2(first + 2, row), 0),
+        texelFetch(part_transforms, ivec2(first + 3, row), 0)
+    );
+}
+
 void main()
 {
+    mat4 m = model;
+    mat4 m_inverse = model_inverse;
+    if( scene_on ){
+        m = part_matrix(int(part + 0.5f), 0);
+        m_inverse = part_matrix(int(part + 0.5f), 4);
+    }
+
+    if( instances_on ){
+        m = instance_model * m;
+        m_inverse = instance_normal * m_inverse;
+    }
+
+    // Matrix times vector only, matrices products are done once on the CPU.
+    vec4 position_world = m * vec4(position, 1.0f);
+
     // vertex position into MVP space
-    gl_Position = projection * view * model * vec4(position, 1.0f);
+    gl_Position = view_projection * position_world;
 
     if( light_on ){
         // vertex position into view space
-        position_view  = vec3(view * model * vec4(position, 1.0f));
+        position_view  = vec3(view * position_world);
 
         // light position into view space
         vec3 light_position_view;
@@ -46,7 +100,7 @@ void main()
         light_direction = light_position_view - position_view;
 
         // vertex normal into view
-        vertex_normal = mat3(view_inverse * model_inverse) * normal;
+        vertex_normal = mat3(view_inverse) * (mat3(m_inverse) * normal);
     }
 
     fragment_color = color;
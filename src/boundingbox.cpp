@@ -0,0 +1,136 @@
+#include "../include/boundingbox.h"
+#include "../include/parallel.h"
+
+#include <algorithm>
+#include <limits>
+#include <thread>
+#include <vector>
+
+/* Below that, a thread costs more than it saves. */
+static const size_t min_vertices_per_thread = 1 << 16;
+
+/* 4 points: 12 floats, every lane always holds the same coordinate. */
+static const size_t block_vertices = 4;
+static const size_t block_floats = 3 * block_vertices;
+
+static size_t
+nb_tasks(size_t nb_vertices, unsigned int nb_threads)
+{
+    if( nb_threads == 0 )
+        nb_threads = std::max(1u, std::thread::hardware_concurrency());
+
+    return std::max(size_t(1), std::min(size_t(nb_threads), nb_vertices / min_vertices_per_thread));
+}
+
+BoundingBox::BoundingBox()
+{
+    for(size_t j=0; j < 3; ++j){
+        min[j] = std::numeric_limits<float>::max();
+        max[j] = std::numeric_limits<float>::lowest();
+    }
+}
+
+bool
+BoundingBox::is_empty() const
+{
+    return min[0] > max[0] || min[1] > max[1] || min[2] > max[2];
+}
+
+void
+BoundingBox::extend(const float* p)
+{
+    for(size_t j=0; j < 3; ++j){
+        min[j] = std::min(min[j], p[j]);
+        max[j] = std::max(max[j], p[j]);
+    }
+}
+
+void
+BoundingBox::extend(const BoundingBox& box)
+{
+    for(size_t j=0; j < 3; ++j){
+        min[j] = std::min(min[j], box.min[j]);
+        max[j] = std::max(max[j], box.max[j]);
+    }
+}
+
+void
+BoundingBox::extend(const float* positions, size_t nb_vertices)
+{
+    float low[block_floats], high[block_floats];
+    for(size_t i=0; i < block_floats; ++i){
+        low[i] = min[i % 3];
+        high[i] = max[i % 3];
+    }
+
+    // Branchless compares on fixed size blocks: plain min/max instructions once vectorized.
+    const size_t nb_blocks = nb_vertices / block_vertices;
+    const float* p = positions;
+    for(size_t b=0; b < nb_blocks; ++b, p += block_floats)
+        for(size_t i=0; i < block_floats; ++i){
+            low[i] = (p[i] < low[i]) ? p[i] : low[i];
+            high[i] = (p[i] > high[i]) ? p[i] : high[i];
+        }
+
+    for(size_t i=0; i < block_floats; ++i){
+        min[i % 3] = std::min(min[i % 3], low[i]);
+        max[i % 3] = std::max(max[i % 3], high[i]);
+    }
+
+    for(size_t v = nb_blocks * block_vertices; v < nb_vertices; ++v)
+        extend(positions + 3*v);
+}
+
+BoundingBox
+BoundingBox::of(const float* positions, size_t nb_vertices, unsigned int nb_threads)
+{
+    size_t n = nb_tasks(nb_vertices, nb_threads);
+
+    std::vector<BoundingBox> boxes(n);
+    parallel_for(n, [&](size_t task){
+        size_t first = nb_vertices * task / n;
+        size_t last = nb_vertices * (task+1) / n;
+        boxes[task].extend(positions + 3*first, last - first);
+    });
+
+    BoundingBox box;
+    for(const BoundingBox& b: boxes)
+        box.extend(b);
+    return box;
+}
+
+void
+BoundingBox::center(float* c) const
+{
+    for(size_t j=0; j < 3; ++j)
+        c[j] = 0.5f * (min[j] + max[j]);
+}
+
+/* 1 / largest side, 1 for a flat (or empty) box. */
+float
+BoundingBox::normalization_scale() const
+{
+    if( is_empty() )
+        return 1.0f;
+
+    float side = std::max(max[0] - min[0], std::max(max[1] - min[1], max[2] - min[2]));
+    return (side > 0.0f) ? 1.0f / side : 1.0f;
+}
+
+void
+BoundingBox::normalize(float* positions, size_t nb_vertices, unsigned int nb_threads) const
+{
+    float c[3];
+    center(c);
+    const float scale = normalization_scale();
+
+    size_t n = nb_tasks(nb_vertices, nb_threads);
+    parallel_for(n, [&](size_t task){
+        float* first = positions + 3 * (nb_vertices * task / n);
+        float* last = positions + 3 * (nb_vertices * (task+1) / n);
+
+        for(float* p = first; p < last; p += 3)
+            for(size_t j=0; j < 3; ++j)
+                p[j] = (p[j] - c[j]) * scale;
+    });
+}
@@ -1,6 +1,82 @@
 #include "../include/drawableobject.h"
+#include "../include/boundingbox.h"
+#include "../include/glstats.h"
+#include "../include/trace.h"
 
+#include <QOpenGLContext>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
 #include <iostream>
+#include <limits>
+#include <numeric>
+#include <utility>
+#include <vector>
+
+#ifndef GL_HALF_FLOAT
+#define GL_HALF_FLOAT 0x140B
+#endif
+
+#ifndef GL_INT_2_10_10_10_REV
+#define GL_INT_2_10_10_10_REV 0x8D9F
+#endif
+
+#ifndef GL_COPY_READ_BUFFER
+#define GL_COPY_READ_BUFFER 0x8F36
+#endif
+
+#ifndef GL_BUFFER_SIZE
+#define GL_BUFFER_SIZE 0x8764
+#endif
+
+typedef void (QOPENGLF_APIENTRYP CopyBufferSubData)(GLenum, GLenum, GLintptr, GLintptr, GLsizeiptr);
+typedef void (QOPENGLF_APIENTRYP BindBuffer)(GLenum, GLuint);
+typedef void (QOPENGLF_APIENTRYP GetBufferParameteriv)(GLenum, GLenum, GLint*);
+
+/* Compressed attributes are encoded through a staging chunk of that many vertices. */
+static const size_t staging_vertices = 4096;
+
+/* Same for 16 bits indices, whole groups of 6 (2 triangles or 3 lines). */
+static const size_t staging_elements = 6 * 4096;
+
+/* Dirty ranges closer than that many vertices are written together: one mapping instead of two. */
+static const size_t dirty_gap = 64;
+
+/* Below that average size, 16 bits chunks cost more draw calls than they save. */
+static const size_t min_chunk_elements = 4096;
+
+/* Owner of an array from new[], none for nullptr */
+template<typename T>
+static std::shared_ptr<T>
+own_array(T* data)
+{
+    if( data == nullptr )
+        return nullptr;
+    return std::shared_ptr<T>(data, std::default_delete<T[]>());
+}
+
+/* Array kept alive by `owner`, which frees it (e.g. a mapped cache file). */
+template<typename T>
+static std::shared_ptr<T>
+borrow_array(T* data, const std::shared_ptr<const void>& owner)
+{
+    if( data == nullptr )
+        return nullptr;
+    return std::shared_ptr<T>(owner, data);
+}
+
+/* glMultiDrawElements: every desktop OpenGL since 1.4, not OpenGL ES. */
+static MultiDrawElements
+resolve_multi_draw_elements()
+{
+    QOpenGLContext* context = QOpenGLContext::currentContext();
+    if( context == nullptr || context->isOpenGLES() )
+        return nullptr;
+
+    return reinterpret_cast<MultiDrawElements>(context->getProcAddress("glMultiDrawElements"));
+}
 
 DrawableObject::DrawableObject():
     nb_vertices(0),
@@ -15,119 +91,1465 @@ DrawableObject::DrawableObject():
     raw_vertices_colors(nullptr),
     raw_vertices_normals(nullptr),
     raw_vertices_indices(nullptr),
+    borrowed_geometry(false),
+    borrowed_normals(false),
+    render_only(false),
+    uploaded(false),
+    gpu_bytes(0),
+    buffers_outdated(true),
+    layout(VertexLayout::Planar),
+    uploaded_layout(VertexLayout::Planar),
+    format(),
+    uploaded_format(),
+    index_type(GL_UNSIGNED_INT),
+    draw_elements_base_vertex(nullptr),
+    detail_offsets(2, 0),
+    detail_chunks(2, 0),
+    detail_level(0),
+    visible_ranges_on(false),
+    multi_draw_elements(nullptr),
+    instance_vbo(nullptr),
+    location_instances(-1),
+    location_instances_normal(-1),
+    draw_elements_instanced(nullptr),
+    draw_elements_instanced_base_vertex(nullptr),
+    vertex_attrib_divisor(nullptr),
     vao(nullptr),
     ebo(nullptr),
     vbo(nullptr),
-    model(new QMatrix4x4())
+    model(new QMatrix4x4()),
+    matrices_dirty(true),
+    location_model(-1),
+    location_model_inverse(-1),
+    location_instances_on(-1)
 {
+    for(size_t i=0; i < 3; ++i){
+        quantization_center[i] = 0.0f;
+        quantization_extent[i] = 1.0f;
+    }
+
+    for(size_t i=0; i < 4; ++i)
+        uniform_color[i] = 0.0f;
+
     reset_model_matrix();
 }
 
 DrawableObject::~DrawableObject()
 {
-    if( model != nullptr ){
-        delete model;
-        model = nullptr;
+    if( model != nullptr ){
+        delete model;
+        model = nullptr;
+    }
+
+    free_vertices_colors();
+    free_vertices_normals();
+    free_vertices_geometry();
+    clear_instances();
+    free_buffers();
+}
+
+/* Nothing is copied: arrays & buffers are shared, whatever their size. Instances are not. */
+DrawableObject::DrawableObject(const DrawableObject& obj)
+    :DrawableObject()
+{
+    share(obj);
+}
+
+DrawableObject::DrawableObject(DrawableObject&& obj)
+    :DrawableObject()
+{
+    *this = std::move(obj);
+}
+
+/* `obj` is left empty, as if just constructed (its model matrix aside). */
+DrawableObject&
+DrawableObject::operator=(DrawableObject&& obj)
+{
+    if( this == &obj )
+        return *this;
+
+    free_vertices_colors();
+    free_vertices_normals();
+    free_vertices_geometry();
+    clear_instances();
+    free_buffers();
+
+    share(obj);
+
+    // Instances go along
+    instance_transforms.swap(obj.instance_transforms);
+    instance_order.swap(obj.instance_order);
+    instance_counts.swap(obj.instance_counts);
+    std::swap(instance_vbo, obj.instance_vbo);
+    location_instances = obj.location_instances;
+    location_instances_normal = obj.location_instances_normal;
+    location_instances_on = obj.location_instances_on;
+    draw_elements_instanced = obj.draw_elements_instanced;
+    draw_elements_instanced_base_vertex = obj.draw_elements_instanced_base_vertex;
+    vertex_attrib_divisor = obj.vertex_attrib_divisor;
+
+    obj.free_vertices_colors();
+    obj.free_vertices_normals();
+    obj.free_vertices_geometry();
+    obj.clear_instances();
+    obj.free_buffers();
+    obj.tuple_size = 0;
+    obj.initialized = false;
+    obj.uploaded = false;
+    obj.gpu_bytes = 0;
+    obj.buffers_outdated = true;
+    for(std::vector<ElementRange>& ranges: obj.dirty_ranges)
+        ranges.clear();
+    obj.location_vertices_coordinates = -1;
+    obj.location_vertices_colors = -1;
+    obj.location_vertices_normals = -1;
+    obj.properties = 0;
+    obj.index_chunks.clear();
+    obj.detail_offsets.assign(2, 0);
+    obj.detail_chunks.assign(2, 0);
+    obj.detail_level = 0;
+    obj.clear_visible_ranges();
+
+    return *this;
+}
+
+/* Same state as `obj`, sharing its arrays (and their owners) & buffers: nothing is copied. */
+void
+DrawableObject::share(const DrawableObject& obj)
+{
+    *model = *obj.model;
+    matrices_dirty = true;
+
+    nb_vertices = obj.nb_vertices;
+    nb_elements = obj.nb_elements;
+    tuple_size = obj.tuple_size;
+    initialized = obj.initialized;
+    location_vertices_coordinates = obj.location_vertices_coordinates;
+    location_vertices_colors = obj.location_vertices_colors;
+    location_vertices_normals = obj.location_vertices_normals;
+    location_model = obj.location_model;
+    location_model_inverse = obj.location_model_inverse;
+    properties = obj.properties;
+
+    raw_vertices_coordinates = obj.raw_vertices_coordinates;
+    raw_vertices_indices = obj.raw_vertices_indices;
+    raw_vertices_colors = obj.raw_vertices_colors;
+    raw_vertices_normals = obj.raw_vertices_normals;
+    owned_coordinates = obj.owned_coordinates;
+    owned_indices = obj.owned_indices;
+    owned_colors = obj.owned_colors;
+    owned_normals = obj.owned_normals;
+    borrowed_geometry = obj.borrowed_geometry;
+    borrowed_normals = obj.borrowed_normals;
+
+    render_only = obj.render_only;
+    uploaded = obj.uploaded;
+    gpu_bytes = obj.gpu_bytes;
+    buffers_outdated = obj.buffers_outdated;
+    for(size_t a=0; a < 3; ++a)
+        dirty_ranges[a] = obj.dirty_ranges[a];
+    layout = obj.layout;
+    uploaded_layout = obj.uploaded_layout;
+    format = obj.format;
+    uploaded_format = obj.uploaded_format;
+    std::copy(obj.quantization_center, obj.quantization_center + 3, quantization_center);
+    std::copy(obj.quantization_extent, obj.quantization_extent + 3, quantization_extent);
+    std::copy(obj.uniform_color, obj.uniform_color + 4, uniform_color);
+
+    index_type = obj.index_type;
+    index_chunks = obj.index_chunks;
+    draw_elements_base_vertex = obj.draw_elements_base_vertex;
+    detail_offsets = obj.detail_offsets;
+    detail_chunks = obj.detail_chunks;
+    detail_level = obj.detail_level;
+
+    visible_ranges_on = obj.visible_ranges_on;
+    visible_counts = obj.visible_counts;
+    visible_offsets = obj.visible_offsets;
+    visible_base_vertices = obj.visible_base_vertices;
+    multi_draw_elements = obj.multi_draw_elements;
+
+    buffers = obj.buffers;
+    vao = obj.vao;
+    ebo = obj.ebo;
+    vbo = obj.vbo;
+}
+
+bool
+DrawableObject::update_buffers(QOpenGLShaderProgram* program)
+{
+    TRACE_SCOPE("update_buffers");
+
+    if( !initialized ){
+        std::cerr << "initialize() function was not called." << std::endl;
+        std::cerr << "Cannot proceed to build()" << std::endl;
+        return false;
+    }
+
+    // Buffers shared with copies are never written.
+    if( !detach_buffers(program) )
+        return false;
+
+    // Only what changed, whenever the buffers are still laid out the same way.
+    // Without raw arrays (render-only), nothing could rebuild them anyway.
+    if( uploaded && (!buffers_outdated || !has_cpu_geometry()) ){
+        if( upload_dirty() )
+            return true;
+
+        if( !has_cpu_geometry() ){
+            std::cerr << "Colors are not uniform anymore: buffers need to be rebuilt." << std::endl;
+            return false;
+        }
+    }
+
+    // Attributes are written in place, where the layout and formats put them.
+    uploaded_layout = layout;
+    uploaded_format = resolve_format();
+    index_type = resolve_index_type(uploaded_format.index_chunks);
+    matrices_dirty = true;
+
+    location_model = program->uniformLocation("model");
+    location_model_inverse = program->uniformLocation("model_inverse");
+    multi_draw_elements = resolve_multi_draw_elements();
+    visible_ranges_on = false;
+
+    // Instances outlive uploads: new index chunks may have no instanced draw, one draw per instance then.
+    if( !index_chunks.empty() && draw_elements_instanced_base_vertex == nullptr )
+        draw_elements_instanced = nullptr;
+
+    size_t index_size = (index_type == GL_UNSIGNED_SHORT) ? sizeof(GLushort) : sizeof(GLuint);
+
+    const int locations[3] = {
+        location_vertices_coordinates, location_vertices_colors, location_vertices_normals
+    };
+
+    size_t vertex_size = 0;
+    for(int location: locations)
+        if( location >= 0 )
+            vertex_size += attribute_type(location).size;
+
+    vao->bind();
+    GL_STATS_ADD(vao_binds, 1);
+    {
+        ebo->bind();
+        GL_STATS_ADD(buffer_binds, 1);
+        ebo->setUsagePattern(QOpenGLBuffer::StaticDraw);
+        upload(ebo, int(index_size * nb_elements), [this](char* buffer){
+            write_indices(buffer);
+        });
+
+        vbo->bind();
+        GL_STATS_ADD(buffer_binds, 1);
+        vbo->setUsagePattern(QOpenGLBuffer::StaticDraw);
+        upload(vbo, int(vertex_size * nb_vertices), [&](char* buffer){
+            for(int location: locations)
+                write_attribute(location, buffer);
+        });
+
+        set_attributes(program);
+    }
+    vao->release();
+    ebo->release();
+    vbo->release();
+    GL_STATS_ADD(vao_binds, 1);
+    GL_STATS_ADD(buffer_binds, 2);
+
+    uploaded = true;
+    gpu_bytes = index_size * nb_elements + vertex_size * nb_vertices;
+
+    buffers_outdated = false;
+    for(std::vector<ElementRange>& ranges: dirty_ranges)
+        ranges.clear();
+
+    if( render_only )
+        release_cpu_data();
+
+    return true;
+}
+
+/* Attributes of the last upload, into the bound VAO. The VBO must be bound. */
+void
+DrawableObject::set_attributes(QOpenGLShaderProgram* program) const
+{
+    const int locations[3] = {
+        location_vertices_coordinates, location_vertices_colors, location_vertices_normals
+    };
+
+    // setAttributeBuffer() always asks for normalized values: integers end up into [-1,1] or [0,1].
+    for(int location: locations){
+        if( location < 0 )
+            continue;
+
+        AttributeFormat f = attribute_format(location);
+        if( f.size == 0 ){
+            // Constant value, given by show()
+            program->disableAttributeArray(location);
+            continue;
+        }
+
+        program->enableAttributeArray(location);
+        program->setAttributeBuffer(location, f.type, int(f.offset), f.components, int(f.stride));
+    }
+}
+
+/* glCopyBufferSubData: OpenGL 3.1 (or its extension), nullptr otherwise. */
+static CopyBufferSubData
+resolve_copy_buffer_sub_data()
+{
+    QOpenGLContext* context = QOpenGLContext::currentContext();
+    if( context == nullptr )
+        return nullptr;
+
+    QSurfaceFormat surface = context->format();
+    int version = surface.majorVersion() * 10 + surface.minorVersion();
+    if( (context->isOpenGLES() ? version < 30 : version < 31) && !context->hasExtension("GL_ARB_copy_buffer") )
+        return nullptr;
+
+    return reinterpret_cast<CopyBufferSubData>(context->getProcAddress("glCopyBufferSubData"));
+}
+
+/*
+ * Buffers of our own before writing into them, when shared with copies.
+ * Nothing to copy when everything is uploaded again from the raw arrays anyway.
+ * Otherwise the shared buffers are copied on the GPU side (through the CPU before OpenGL 3.1),
+ * and only what changed is written afterwards.
+ */
+bool
+DrawableObject::detach_buffers(QOpenGLShaderProgram* program)
+{
+    if( buffers.use_count() < 2 )
+        return true;
+
+    std::shared_ptr<Buffers> shared = buffers;
+    if( !create_buffers() ){
+        std::cerr << "Failed to create GPU buffers." << std::endl;
+        return false;
+    }
+
+    if( !uploaded || (buffers_outdated && has_cpu_geometry()) ){
+        uploaded = false;
+        return true;
+    }
+
+    QOpenGLContext* context = QOpenGLContext::currentContext();
+    CopyBufferSubData copy_buffer_sub_data = resolve_copy_buffer_sub_data();
+    BindBuffer bind_buffer = reinterpret_cast<BindBuffer>(context->getProcAddress("glBindBuffer"));
+    GetBufferParameteriv get_buffer_parameteriv =
+        reinterpret_cast<GetBufferParameteriv>(context->getProcAddress("glGetBufferParameteriv"));
+
+    if( bind_buffer == nullptr || get_buffer_parameteriv == nullptr )
+        copy_buffer_sub_data = nullptr;
+
+    bool ok = true;
+    vao->bind();
+    GL_STATS_ADD(vao_binds, 1);
+    {
+        // The EBO binding belongs to the VAO: ours last.
+        for(QOpenGLBuffer* buffer: { &shared->ebo, &shared->vbo }){
+            const bool elements = (buffer == &shared->ebo);
+            QOpenGLBuffer* copy = elements ? ebo : vbo;
+
+            if( copy_buffer_sub_data != nullptr ){
+                // Read side on its own target: the VAO never sees the shared EBO.
+                GLint size = 0;
+                bind_buffer(GL_COPY_READ_BUFFER, buffer->bufferId());
+                GL_STATS_ADD(buffer_binds, 1);
+                get_buffer_parameteriv(GL_COPY_READ_BUFFER, GL_BUFFER_SIZE, &size);
+
+                copy->bind();
+                GL_STATS_ADD(buffer_binds, 1);
+                copy->setUsagePattern(QOpenGLBuffer::StaticDraw);
+                copy->allocate(size);
+                copy_buffer_sub_data(GL_COPY_READ_BUFFER, elements ? GL_ELEMENT_ARRAY_BUFFER : GL_ARRAY_BUFFER,
+                                     0, 0, size);
+                GL_STATS_ADD(bytes_written, std::max(size, 0));
+                bind_buffer(GL_COPY_READ_BUFFER, 0);
+                GL_STATS_ADD(buffer_binds, 1);
+            }
+            else {
+                buffer->bind();
+                GL_STATS_ADD(buffer_binds, 1);
+                std::vector<char> data(size_t(std::max(buffer->size(), 0)));
+                ok = ok && buffer->read(0, data.data(), int(data.size()));
+
+                copy->bind();
+                GL_STATS_ADD(buffer_binds, 1);
+                copy->setUsagePattern(QOpenGLBuffer::StaticDraw);
+                copy->allocate(data.data(), int(data.size()));
+                GL_STATS_ADD(bytes_written, data.size());
+            }
+        }
+
+        set_attributes(program);
+    }
+    vao->release();
+    ebo->release();
+    vbo->release();
+    GL_STATS_ADD(vao_binds, 1);
+    GL_STATS_ADD(buffer_binds, 2);
+
+    if( !ok )
+        std::cerr << "Failed to copy the shared buffers." << std::endl;
+
+    return ok;
+}
+
+/*
+ * Type and size of an attribute, for the formats of the last upload.
+ * Every attribute starts on a 4 bytes boundary.
+ */
+DrawableObject::AttributeFormat
+DrawableObject::attribute_type(int shader_location) const
+{
+    AttributeFormat f;
+    f.offset = 0;
+    f.stride = 0;
+    f.type = GL_FLOAT;
+    f.components = int(tuple_size);
+
+    size_t component = sizeof(GLfloat);
+
+    if( shader_location == location_vertices_coordinates ){
+        if( uploaded_format.positions == PositionFormat::Half ){
+            f.type = GL_HALF_FLOAT;
+            component = sizeof(uint16_t);
+        }
+        else
+        if( uploaded_format.positions == PositionFormat::Short ){
+            f.type = GL_SHORT;
+            component = sizeof(GLshort);
+        }
+    }
+    else
+    if( shader_location == location_vertices_colors ){
+        if( uploaded_format.colors == ColorFormat::Uniform ){
+            f.size = 0;
+            return f;
+        }
+
+        if( uploaded_format.colors == ColorFormat::Byte ){
+            f.type = GL_UNSIGNED_BYTE;
+            component = sizeof(GLubyte);
+        }
+    }
+    else
+    if( shader_location == location_vertices_normals ){
+        if( uploaded_format.normals == NormalFormat::Packed ){
+            f.type = GL_INT_2_10_10_10_REV;
+            f.components = 4;
+            f.size = sizeof(GLuint);
+            return f;
+        }
+    }
+
+    f.size = (component * tuple_size + 3) & ~size_t(3);
+    return f;
+}
+
+/*
+ * Where an attribute lives into the VBO, for the layout of the last upload
+ * (attributes order: coordinates, colors then normals).
+ *  - Planar: one block per attribute, xyzxyz... rgbrgb... ijkijk...
+ *  - Interleaved: xyzrgbijk xyzrgbijk ...
+ *  - HotCold: positions alone (every pass reads them), then colors & normals interleaved.
+ * Attributes which are not into the VBO (uniform colors) take no room.
+ */
+DrawableObject::AttributeFormat
+DrawableObject::attribute_format(int shader_location) const
+{
+    const int locations[3] = {
+        location_vertices_coordinates, location_vertices_colors, location_vertices_normals
+    };
+
+    AttributeFormat f = attribute_type(shader_location);
+
+    size_t vertex = 0;      // bytes per vertex, every attribute
+    size_t before = 0;      // bytes per vertex, attributes before this one
+    size_t cold = 0;        // same, colors & normals only
+    size_t cold_before = 0;
+    bool found = false;
+
+    for(int location: locations){
+        if( location < 0 )
+            continue;
+
+        if( location == shader_location )
+            found = true;
+
+        size_t size = attribute_type(location).size;
+        vertex += size;
+        if( !found )
+            before += size;
+
+        if( location != location_vertices_coordinates ){
+            cold += size;
+            if( !found )
+                cold_before += size;
+        }
+    }
+
+    switch( uploaded_layout ){
+    case VertexLayout::Interleaved:
+        f.offset = before;
+        f.stride = vertex;
+        break;
+
+    case VertexLayout::HotCold:
+        if( shader_location == location_vertices_coordinates ){
+            f.offset = 0;
+            f.stride = f.size;
+        }
+        else {
+            size_t hot = (location_vertices_coordinates >= 0) ? attribute_type(location_vertices_coordinates).size : 0;
+            f.offset = hot * nb_vertices + cold_before;
+            f.stride = cold;
+        }
+        break;
+
+    default: // Planar
+        f.offset = before * nb_vertices;
+        f.stride = f.size;
+        break;
+    }
+
+    return f;
+}
+
+/* glDrawElementsBaseVertex: OpenGL 3.2 (or its extension), nullptr otherwise. */
+static DrawElementsBaseVertex
+resolve_draw_elements_base_vertex()
+{
+    QOpenGLContext* context = QOpenGLContext::currentContext();
+    if( context == nullptr )
+        return nullptr;
+
+    QSurfaceFormat surface = context->format();
+    if( surface.majorVersion() < 3
+     || (surface.majorVersion() == 3 && surface.minorVersion() < 2 && !context->hasExtension("GL_ARB_draw_elements_base_vertex")) )
+        return nullptr;
+
+    return reinterpret_cast<DrawElementsBaseVertex>(context->getProcAddress("glDrawElementsBaseVertex"));
+}
+
+/*
+ * 16 bits indices whenever every vertex can be addressed that way.
+ * Larger objects keep 32 bits ones, unless they can be split into chunks (see split_indices()).
+ */
+GLenum
+DrawableObject::resolve_index_type(bool chunks)
+{
+    index_chunks.clear();
+
+    if( nb_vertices <= 65536 )
+        return GL_UNSIGNED_SHORT;
+
+    if( !chunks )
+        return GL_UNSIGNED_INT;
+
+    draw_elements_base_vertex = resolve_draw_elements_base_vertex();
+    if( draw_elements_base_vertex == nullptr || !split_indices() ){
+        index_chunks.clear();
+        return GL_UNSIGNED_INT;
+    }
+
+    return GL_UNSIGNED_SHORT;
+}
+
+/*
+ * Cut the indices into runs whose vertices all lie into 65536 consecutive ones,
+ * drawn as 16 bits indices relative to the lowest vertex of their run.
+ * Runs are made of whole groups of 6 indices, so that they never cut a triangle nor a line,
+ * and never cross the start of a level of detail.
+ * False when the indices are too scattered for chunks to be worth it.
+ */
+bool
+DrawableObject::split_indices()
+{
+    std::vector<GLuint> staging(staging_elements);
+
+    IndexChunk chunk = { 0, 0, 0 };
+    GLuint low = std::numeric_limits<GLuint>::max();
+    GLuint high = 0;
+
+    const size_t nb_levels = nb_detail_levels();
+    size_t level = 0;
+    detail_chunks.assign(1, 0);
+
+    for(size_t first=0; first < nb_elements; first += staging_elements){
+        size_t count = std::min(staging_elements, nb_elements - first);
+        fill_vertices_indices(staging.data(), first, count);
+
+        for(size_t g=0, n=0; g < count; g+=n){
+            // Next level: close the current chunk, whatever its range.
+            if( first + g == detail_offsets[level+1] ){
+                if( chunk.count > 0 ){
+                    chunk.base_vertex = GLint(low);
+                    index_chunks.push_back(chunk);
+                }
+
+                while( level+1 < nb_levels && first + g == detail_offsets[level+1] ){
+                    ++level;
+                    detail_chunks.push_back(index_chunks.size());
+                }
+
+                chunk.first = first + g;
+                chunk.count = 0;
+                low = std::numeric_limits<GLuint>::max();
+                high = 0;
+            }
+
+            n = std::min(std::min(size_t(6), count - g), detail_offsets[level+1] - (first + g));
+            GLuint group_low = staging[g];
+            GLuint group_high = staging[g];
+            for(size_t i=1; i < n; ++i){
+                group_low = std::min(group_low, staging[g+i]);
+                group_high = std::max(group_high, staging[g+i]);
+            }
+
+            if( group_high - group_low > 65535 )
+                return false;
+
+            if( std::max(high, group_high) - std::min(low, group_low) > 65535 ){
+                chunk.base_vertex = GLint(low);
+                index_chunks.push_back(chunk);
+
+                chunk.first = first + g;
+                chunk.count = 0;
+                low = group_low;
+                high = group_high;
+            }
+            else {
+                low = std::min(low, group_low);
+                high = std::max(high, group_high);
+            }
+
+            chunk.count += n;
+        }
+    }
+
+    if( chunk.count > 0 ){
+        chunk.base_vertex = GLint(low);
+        index_chunks.push_back(chunk);
+    }
+
+    while( detail_chunks.size() < nb_levels + 1 )
+        detail_chunks.push_back(index_chunks.size());
+
+    return index_chunks.size() * min_chunk_elements <= nb_elements;
+}
+
+/* Indices into the (mapped) EBO, narrowed to 16 bits through a staging chunk if needed. */
+void
+DrawableObject::write_indices(char* buffer) const
+{
+    if( index_type == GL_UNSIGNED_INT ){
+        fill_vertices_indices(reinterpret_cast<GLuint*>(buffer), 0, nb_elements);
+        return;
+    }
+
+    GLushort* out = reinterpret_cast<GLushort*>(buffer);
+    std::vector<GLuint> staging(staging_elements);
+    std::vector<IndexChunk>::const_iterator chunk = index_chunks.begin();
+
+    for(size_t first=0; first < nb_elements; first += staging_elements){
+        size_t count = std::min(staging_elements, nb_elements - first);
+        fill_vertices_indices(staging.data(), first, count);
+
+        for(size_t i=0; i < count; ++i){
+            GLuint base = 0;
+            if( chunk != index_chunks.end() ){
+                if( first + i >= chunk->first + chunk->count )
+                    ++chunk;
+                base = GLuint(chunk->base_vertex);
+            }
+            out[first + i] = GLushort(staging[i] - base);
+        }
+    }
+}
+
+/* Packed normals need OpenGL 3.3 (or its extension). */
+static bool
+packed_normals_supported()
+{
+    QOpenGLContext* context = QOpenGLContext::currentContext();
+    if( context == nullptr )
+        return false;
+
+    QSurfaceFormat surface = context->format();
+    return surface.majorVersion() > 3
+        || (surface.majorVersion() == 3 && surface.minorVersion() >= 3)
+        || context->hasExtension("GL_ARB_vertex_type_2_10_10_10_rev");
+}
+
+/*
+ * Requested formats, unless this object or the context cannot use them.
+ * Also computes what quantized positions and uniform colors need.
+ */
+VertexFormat
+DrawableObject::resolve_format()
+{
+    VertexFormat f = format;
+
+    if( tuple_size != 3 ){
+        f.positions = PositionFormat::Float;
+        f.normals = NormalFormat::Float;
+    }
+
+    if( f.normals == NormalFormat::Packed && !packed_normals_supported() )
+        f.normals = NormalFormat::Float;
+
+    if( f.colors == ColorFormat::Uniform && (tuple_size > 4 || !uniform_colors(uniform_color)) )
+        f.colors = ColorFormat::Byte;
+
+    if( f.positions != PositionFormat::Float && location_vertices_coordinates >= 0 ){
+        GLfloat min[3], max[3];
+        bounding_box(min, max);
+
+        for(size_t i=0; i < 3; ++i){
+            quantization_center[i] = 0.5f * (min[i] + max[i]);
+            quantization_extent[i] = 0.5f * (max[i] - min[i]);
+
+            // flat (or empty) along that axis
+            if( !(quantization_extent[i] > 0.0f) )
+                quantization_extent[i] = 1.0f;
+        }
+    }
+
+    return f;
+}
+
+void
+DrawableObject::fill_attribute(int shader_location, GLfloat* buffer, size_t stride, size_t first, size_t count) const
+{
+    if( shader_location == location_vertices_coordinates )
+        fill_vertices_coordinates(buffer, stride, first, count);
+    else
+    if( shader_location == location_vertices_colors )
+        fill_vertices_colors(buffer, stride, first, count);
+    else
+    if( shader_location == location_vertices_normals )
+        fill_vertices_normals(buffer, stride, first, count);
+}
+
+/*
+ * Write one attribute of every vertex into the (mapped) VBO.
+ * Floats are written in place; other formats are encoded from a staging chunk
+ * small enough to stay into the CPU cache.
+ */
+void
+DrawableObject::write_attribute(int shader_location, char* buffer) const
+{
+    if( shader_location < 0 )
+        return;
+
+    AttributeFormat f = attribute_format(shader_location);
+    if( f.size == 0 )
+        return;
+
+    write_attribute_range(shader_location, buffer + f.offset, 0, nb_vertices);
+}
+
+/* Same for vertices `first` to `first+count`, `buffer` pointing to the attribute of the first one. */
+void
+DrawableObject::write_attribute_range(int shader_location, char* buffer, size_t first, size_t count) const
+{
+    AttributeFormat f = attribute_format(shader_location);
+
+    if( f.type == GL_FLOAT ){
+        fill_attribute(shader_location, reinterpret_cast<GLfloat*>(buffer), f.stride / sizeof(GLfloat), first, count);
+        return;
+    }
+
+    bool positions = (shader_location == location_vertices_coordinates);
+    std::vector<GLfloat> staging(std::min(staging_vertices, count) * tuple_size);
+
+    for(size_t done=0; done < count; done += staging_vertices){
+        size_t chunk = std::min(staging_vertices, count - done);
+
+        fill_attribute(shader_location, staging.data(), tuple_size, first + done, chunk);
+        if( positions )
+            quantize(staging.data(), chunk, false);
+
+        encode(f, staging.data(), chunk, tuple_size, buffer + done * f.stride);
+    }
+}
+
+/* Positions to (or back from, when `inverse`) the [-1,1] cube of the quantization box. */
+void
+DrawableObject::quantize(GLfloat* data, size_t count, bool inverse) const
+{
+    GLfloat scale[3], offset[3];
+    for(size_t j=0; j < 3; ++j){
+        scale[j] = inverse ? quantization_extent[j] : 1.0f / quantization_extent[j];
+        offset[j] = inverse ? quantization_center[j] : -quantization_center[j] * scale[j];
+    }
+
+    for(size_t i=0; i < count; ++i, data += 3)
+        for(size_t j=0; j < 3; ++j)
+            data[j] = data[j] * scale[j] + offset[j];
+}
+
+static inline float
+clamp(float value, float min, float max)
+{
+    // NaN ends up at min
+    return (value > min) ? ((value < max) ? value : max) : min;
+}
+
+/* IEEE 754 binary16, rounded to nearest. */
+static inline uint16_t
+to_half(float value)
+{
+    uint32_t bits;
+    std::memcpy(&bits, &value, sizeof(bits));
+
+    uint32_t sign = (bits >> 16) & 0x8000;
+    int32_t exponent = int32_t((bits >> 23) & 0xff) - 127 + 15;
+    uint32_t mantissa = bits & 0x7fffff;
+
+    if( exponent <= 0 ){
+        // too small, even for a subnormal
+        if( exponent < -10 )
+            return uint16_t(sign);
+
+        mantissa |= 0x800000;
+        uint32_t shift = uint32_t(14 - exponent);
+        return uint16_t(sign | ((mantissa + (1u << (shift-1))) >> shift));
+    }
+
+    if( exponent >= 31 )
+        return uint16_t(sign | 0x7c00);
+
+    // a rounding carry correctly moves to the exponent
+    return uint16_t(sign | ((uint32_t(exponent) << 10) + ((mantissa + 0x1000) >> 13)));
+}
+
+static inline float
+from_half(uint16_t half)
+{
+    int exponent = (half >> 10) & 0x1f;
+    int mantissa = half & 0x3ff;
+    float value;
+
+    if( exponent == 0 )
+        value = std::ldexp(float(mantissa), -24);
+    else
+    if( exponent == 31 )
+        value = std::numeric_limits<float>::infinity();
+    else
+        value = std::ldexp(float(mantissa | 0x400), exponent - 25);
+
+    return (half & 0x8000) ? -value : value;
+}
+
+/* `count` tightly packed tuples to the VBO format, `f.stride` bytes apart. */
+void
+DrawableObject::encode(const AttributeFormat& f, const GLfloat* data, size_t count, size_t tuple_size, char* buffer)
+{
+    switch( f.type ){
+    case GL_HALF_FLOAT:
+        for(size_t i=0; i < count; ++i, buffer += f.stride, data += tuple_size){
+            uint16_t* out = reinterpret_cast<uint16_t*>(buffer);
+            for(size_t j=0; j < tuple_size; ++j)
+                out[j] = to_half(data[j]);
+        }
+        break;
+
+    case GL_SHORT:
+        for(size_t i=0; i < count; ++i, buffer += f.stride, data += tuple_size){
+            GLshort* out = reinterpret_cast<GLshort*>(buffer);
+            for(size_t j=0; j < tuple_size; ++j)
+                out[j] = GLshort(std::lround(clamp(data[j], -1.0f, 1.0f) * 32767.0f));
+        }
+        break;
+
+    case GL_UNSIGNED_BYTE:
+        for(size_t i=0; i < count; ++i, buffer += f.stride, data += tuple_size){
+            GLubyte* out = reinterpret_cast<GLubyte*>(buffer);
+            for(size_t j=0; j < tuple_size; ++j)
+                out[j] = GLubyte(std::lround(clamp(data[j], 0.0f, 1.0f) * 255.0f));
+        }
+        break;
+
+    case GL_INT_2_10_10_10_REV:
+        // x, y & z on 10 bits signed, w (unused) on the 2 high bits
+        for(size_t i=0; i < count; ++i, buffer += f.stride, data += 3){
+            GLuint packed = 0;
+            for(size_t j=0; j < 3; ++j)
+                packed |= (GLuint(std::lround(clamp(data[j], -1.0f, 1.0f) * 511.0f)) & 0x3ff) << (10*j);
+            *reinterpret_cast<GLuint*>(buffer) = packed;
+        }
+        break;
+
+    default:
+        copy_vertices(reinterpret_cast<GLfloat*>(buffer), f.stride / sizeof(GLfloat), data, count, tuple_size);
+        break;
+    }
+}
+
+/* Back from the VBO format to tightly packed floats (GPU normalization rules). */
+void
+DrawableObject::decode(const AttributeFormat& f, const char* buffer, size_t count, size_t tuple_size, GLfloat* data)
+{
+    switch( f.type ){
+    case GL_HALF_FLOAT:
+        for(size_t i=0; i < count; ++i, buffer += f.stride, data += tuple_size){
+            const uint16_t* in = reinterpret_cast<const uint16_t*>(buffer);
+            for(size_t j=0; j < tuple_size; ++j)
+                data[j] = from_half(in[j]);
+        }
+        break;
+
+    case GL_SHORT:
+        for(size_t i=0; i < count; ++i, buffer += f.stride, data += tuple_size){
+            const GLshort* in = reinterpret_cast<const GLshort*>(buffer);
+            for(size_t j=0; j < tuple_size; ++j)
+                data[j] = std::max(float(in[j]) / 32767.0f, -1.0f);
+        }
+        break;
+
+    case GL_UNSIGNED_BYTE:
+        for(size_t i=0; i < count; ++i, buffer += f.stride, data += tuple_size){
+            const GLubyte* in = reinterpret_cast<const GLubyte*>(buffer);
+            for(size_t j=0; j < tuple_size; ++j)
+                data[j] = float(in[j]) / 255.0f;
+        }
+        break;
+
+    case GL_INT_2_10_10_10_REV:
+        for(size_t i=0; i < count; ++i, buffer += f.stride, data += 3){
+            GLuint packed = *reinterpret_cast<const GLuint*>(buffer);
+            for(size_t j=0; j < 3; ++j){
+                // sign extension of the 10 bits
+                int32_t value = int32_t(packed << (22 - 10*j)) >> 22;
+                data[j] = std::max(float(value) / 511.0f, -1.0f);
+            }
+        }
+        break;
+
+    default:
+        for(size_t i=0; i < count; ++i, buffer += f.stride, data += tuple_size)
+            std::memcpy(data, buffer, sizeof(GLfloat) * tuple_size);
+        break;
+    }
+}
+
+/*
+ * Write the dirty vertices only, into mapped ranges of the VBO:
+ * bytes of the other attributes (interleaved layout) are left as they are.
+ * False when they cannot go into the buffers as they are (uniform colors which are not anymore).
+ */
+bool
+DrawableObject::upload_dirty()
+{
+    const int locations[3] = {
+        location_vertices_coordinates, location_vertices_colors, location_vertices_normals
+    };
+
+    bool ok = true;
+    vbo->bind();
+    GL_STATS_ADD(buffer_binds, 1);
+    for(size_t a=0; a < 3; ++a){
+        std::vector<ElementRange> ranges;
+        ranges.swap(dirty_ranges[a]);
+
+        if( ranges.empty() || locations[a] < 0 || nb_vertices == 0 )
+            continue;
+
+        AttributeFormat f = attribute_format(locations[a]);
+        if( f.size == 0 ){
+            // Uniform color: nothing into the VBO, fine as long as the colors stay constant.
+            ok = ok && uniform_colors(uniform_color);
+            continue;
+        }
+
+        // Sorted, close ones merged
+        std::sort(ranges.begin(), ranges.end(), [](const ElementRange& x, const ElementRange& y){
+            return x.first < y.first;
+        });
+
+        size_t merged = 0;
+        for(size_t r=1; r < ranges.size(); ++r){
+            ElementRange& last = ranges[merged];
+            if( ranges[r].first <= last.first + last.count + dirty_gap )
+                last.count = std::max(last.count, ranges[r].first + ranges[r].count - last.first);
+            else
+                ranges[++merged] = ranges[r];
+        }
+        ranges.resize(merged + 1);
+
+        for(const ElementRange& range: ranges){
+            int offset = int(f.offset + range.first * f.stride);
+            int span = int((range.count - 1) * f.stride + f.size);
+
+            char* mapped = static_cast<char*>(vbo->mapRange(offset, span, QOpenGLBuffer::RangeWrite));
+            if( mapped != nullptr ){
+                write_attribute_range(locations[a], mapped, range.first, range.count);
+                GL_STATS_ADD(bytes_written, span);
+                if( vbo->unmap() )
+                    continue;
+            }
+
+            // Mapping not available: the other attributes in between go back as they were.
+            std::vector<char> bytes(static_cast<size_t>(span));
+            if( f.stride != f.size )
+                vbo->read(offset, bytes.data(), span);
+            write_attribute_range(locations[a], bytes.data(), range.first, range.count);
+            vbo->write(offset, bytes.data(), span);
+            GL_STATS_ADD(bytes_written, span);
+        }
+    }
+    vbo->release();
+    GL_STATS_ADD(buffer_binds, 1);
+
+    if( render_only )
+        free_vertices_colors();
+
+    return ok;
+}
+
+/*
+ * Colors of our own on the CPU side, before changing some of them:
+ * shared ones are copied, streamed ones (child class) or GPU only ones (render-only) fetched.
+ */
+bool
+DrawableObject::own_colors()
+{
+    if( location_vertices_colors < 0 || nb_vertices == 0 )
+        return false;
+
+    if( raw_vertices_colors != nullptr && owned_colors.use_count() < 2 )
+        return true;
+
+    GLfloat* colors = nullptr;
+    if( raw_vertices_colors != nullptr ){
+        colors = new GLfloat[nb_vertices * tuple_size];
+        std::memcpy(colors, raw_vertices_colors, sizeof(GLfloat) * nb_vertices * tuple_size);
+    }
+    else
+    if( has_cpu_geometry() || !uploaded ){
+        colors = new GLfloat[nb_vertices * tuple_size];
+        fill_vertices_colors(colors, tuple_size, 0, nb_vertices);
+    }
+    else
+        colors = read_back(location_vertices_colors);
+
+    if( colors == nullptr )
+        return false;
+
+    free_vertices_colors();
+    raw_vertices_colors = colors;
+    owned_colors = own_array(colors);
+    return true;
+}
+
+bool
+DrawableObject::set_colors(size_t first, size_t count, const GLfloat* colors)
+{
+    if( first + count > nb_vertices || !own_colors() ){
+        std::cerr << "No colors to change for vertices " << first << " to " << first + count << "." << std::endl;
+        return false;
+    }
+
+    std::memcpy(raw_vertices_colors + first * tuple_size, colors, sizeof(GLfloat) * count * tuple_size);
+    mark_dirty(location_vertices_colors, first, count);
+    return true;
+}
+
+void
+DrawableObject::mark_dirty(int shader_location, size_t first, size_t count)
+{
+    if( shader_location < 0 || count == 0 )
+        return;
+
+    const int locations[3] = {
+        location_vertices_coordinates, location_vertices_colors, location_vertices_normals
+    };
+
+    for(size_t a=0; a < 3; ++a)
+        if( locations[a] == shader_location ){
+            ElementRange range = { first, count };
+            dirty_ranges[a].push_back(range);
+        }
+}
+
+/*
+ * Copy an attribute back from the GPU, when no CPU copy exists anymore.
+ * Compressed formats are decoded, up to their precision.
+ * The OpenGL context must be current.
+ */
+GLfloat*
+DrawableObject::read_back(int shader_location) const
+{
+    if( !uploaded || shader_location < 0 || nb_vertices == 0 )
+        return nullptr;
+
+    AttributeFormat f = attribute_format(shader_location);
+    GLfloat* data = new GLfloat[nb_vertices * tuple_size];
+
+    // Never went to the GPU
+    if( f.size == 0 ){
+        fill_vertices(data, tuple_size, uniform_color, nb_vertices, tuple_size);
+        return data;
+    }
+
+    size_t span = (nb_vertices-1) * f.stride + f.size;
+    bool ok;
+
+    vbo->bind();
+    if( f.type == GL_FLOAT && f.stride == f.size ){
+        ok = vbo->read(int(f.offset), data, int(span));
+    }
+    else {
+        char* strided = new char[span];
+        ok = vbo->read(int(f.offset), strided, int(span));
+        if( ok )
+            decode(f, strided, nb_vertices, tuple_size, data);
+        delete [] strided;
+    }
+    vbo->release();
+
+    if( !ok ){
+        std::cerr << "Failed to read vertices back from the GPU." << std::endl;
+        delete [] data;
+        return nullptr;
+    }
+
+    if( shader_location == location_vertices_coordinates && f.type != GL_FLOAT )
+        quantize(data, nb_vertices, true);
+
+    return data;
+}
+
+GLuint*
+DrawableObject::read_back_indices() const
+{
+    if( !uploaded )
+        return nullptr;
+
+    GLuint* data = new GLuint[nb_elements];
+    bool ok;
+
+    // Binding the EBO outside of our VAO would change another VAO's state.
+    vao->bind();
+    if( index_type == GL_UNSIGNED_INT )
+        ok = ebo->read(0, data, int(sizeof(GLuint) * nb_elements));
+    else {
+        GLushort* narrow = new GLushort[nb_elements];
+        ok = ebo->read(0, narrow, int(sizeof(GLushort) * nb_elements));
+
+        for(size_t i=0; ok && i < nb_elements; ++i)
+            data[i] = narrow[i];
+
+        for(const IndexChunk& chunk: index_chunks)
+            for(size_t i=chunk.first; ok && i < chunk.first + chunk.count; ++i)
+                data[i] += GLuint(chunk.base_vertex);
+
+        delete [] narrow;
+    }
+    vao->release();
+
+    if( !ok ){
+        std::cerr << "Failed to read indices back from the GPU." << std::endl;
+        delete [] data;
+        return nullptr;
+    }
+
+    return data;
+}
+
+void
+DrawableObject::set_render_only(bool on)
+{
+    render_only = on;
+    if( render_only && uploaded )
+        release_cpu_data();
+}
+
+bool
+DrawableObject::has_cpu_geometry() const
+{
+    return raw_vertices_coordinates != nullptr && raw_vertices_indices != nullptr;
+}
+
+/* Free every raw array, but keep their sizes: the GPU buffers still hold them. */
+void
+DrawableObject::release_cpu_data()
+{
+    size_t vertices = nb_vertices;
+    size_t elements = nb_elements;
+
+    free_vertices_colors();
+    free_vertices_normals();
+    free_vertices_geometry();
+
+    nb_vertices = vertices;
+    nb_elements = elements;
+}
+
+size_t
+DrawableObject::cpu_memory() const
+{
+    size_t floats = sizeof(GLfloat) * nb_vertices * tuple_size;
+    size_t bytes = 0;
+
+    // Borrowed arrays are counted by their owner.
+    if( owned_coordinates != nullptr && !borrowed_geometry )
+        bytes += floats / size_t(owned_coordinates.use_count());
+
+    if( owned_indices != nullptr && !borrowed_geometry )
+        bytes += sizeof(GLuint) * nb_elements / size_t(owned_indices.use_count());
+
+    if( owned_colors != nullptr )
+        bytes += floats / size_t(owned_colors.use_count());
+
+    if( owned_normals != nullptr && !borrowed_normals )
+        bytes += floats / size_t(owned_normals.use_count());
+
+    bytes += sizeof(GLfloat) * instance_transforms.capacity() + sizeof(GLuint) * instance_order.capacity();
+
+    return bytes;
+}
+
+size_t
+DrawableObject::gpu_memory() const
+{
+    size_t bytes = sizeof(GLfloat) * instance_transforms.size();
+    if( buffers != nullptr )
+        bytes += gpu_bytes / size_t(buffers.use_count());
+    return bytes;
+}
+
+/*
+ * Size `buffer` then let `fill` write into its mapped memory:
+ * data goes straight to the GPU, without any intermediate copy.
+ * The buffer must be bound.
+ */
+void
+DrawableObject::upload(QOpenGLBuffer* buffer, int bytes, const std::function<void(char*)>& fill)
+{
+    buffer->allocate(bytes);
+    if( bytes == 0 )
+        return;
+
+    GL_STATS_ADD(bytes_written, bytes);
+
+    char* mapped = static_cast<char*>(buffer->mapRange(
+        0, bytes, QOpenGLBuffer::RangeWrite | QOpenGLBuffer::RangeInvalidateBuffer
+    ));
+
+    if( mapped != nullptr ){
+        fill(mapped);
+        // false: the buffer content got lost meanwhile (display mode change ...)
+        if( buffer->unmap() )
+            return;
+    }
+
+    // Mapping not available: go through a temporary copy.
+    char* copy = new char[size_t(bytes)];
+    fill(copy);
+    buffer->write(0, copy, bytes);
+    delete [] copy;
+}
+
+
+/* Model matrix as the shader needs it: quantized positions go back from the [-1,1] cube to the bounding box first. */
+const QMatrix4x4&
+DrawableObject::placed_model() const
+{
+    if( matrices_dirty )
+        update_matrices();
+    return placed_matrix;
+}
+
+/* Inverse transpose of the model matrix, for normals */
+const QMatrix4x4&
+DrawableObject::normal_model() const
+{
+    if( matrices_dirty )
+        update_matrices();
+    return normal_matrix;
+}
+
+void
+DrawableObject::update_matrices() const
+{
+    placed_matrix = *model;
+    if( uploaded_format.positions != PositionFormat::Float ){
+        placed_matrix.translate(quantization_center[0], quantization_center[1], quantization_center[2]);
+        placed_matrix.scale(quantization_extent[0], quantization_extent[1], quantization_extent[2]);
     }
 
-    free_vertices_colors();
-    free_vertices_normals();
-    free_vertices_geometry();
-    free_buffers();
+    normal_matrix = model->transposed().inverted();
+    matrices_dirty = false;
 }
 
-DrawableObject::DrawableObject(const DrawableObject& obj)
-    :DrawableObject()
+void
+DrawableObject::show(QOpenGLShaderProgram* program, GLenum mode) const
 {
-    obj.model->copyDataTo(model->data());
+    if( initialized ){
+        // Update uniform values into vertex shader
+        program->setUniformValue(location_model, placed_model()); // shader transformation computation
+        program->setUniformValue(location_model_inverse, normal_model()); // shader light computation
+        GL_STATS_ADD(uniform_sets, (location_model >= 0) + (location_model_inverse >= 0));
+
+        // Not part of the VAO state
+        if( location_vertices_colors >= 0 && uploaded_format.colors == ColorFormat::Uniform )
+            program->setAttributeValue(location_vertices_colors, uniform_color, int(tuple_size), 1);
+
+        if( !instance_transforms.empty() ){
+            show_instances(program, mode);
+            return;
+        }
 
-    obj.copy_geometry_to(this);
-    obj.copy_colors_to(this);
-    obj.copy_normals_to(this);
+        // Only the range (or chunks) of the current level of detail.
+        size_t level = std::min(detail_level, nb_detail_levels() - 1);
 
-    initialize(obj.nb_vertices, obj.nb_elements, obj.tuple_size);
+        vao->bind();
+        GL_STATS_ADD(vao_binds, 1);
+        if( visible_ranges_on && level == 0 ){
+            if( !index_chunks.empty() )
+                for(size_t r=0; r < visible_counts.size(); ++r){
+                    draw_elements_base_vertex(mode, visible_counts[r], GL_UNSIGNED_SHORT, visible_offsets[r], visible_base_vertices[r]);
+                    GL_STATS_DRAW(mode, visible_counts[r], 1);
+                }
+            else
+            if( multi_draw_elements != nullptr ){
+                multi_draw_elements(mode, visible_counts.data(), index_type, visible_offsets.data(), GLsizei(visible_counts.size()));
+                GL_STATS_DRAW(mode, std::accumulate(visible_counts.begin(), visible_counts.end(), size_t(0)), 1);
+            }
+            else
+                for(size_t r=0; r < visible_counts.size(); ++r){
+                    glDrawElements(mode, visible_counts[r], index_type, visible_offsets[r]);
+                    GL_STATS_DRAW(mode, visible_counts[r], 1);
+                }
+        }
+        else
+            draw_level(mode, level, 0);
+        vao->release();
+        GL_STATS_ADD(vao_binds, 1);
+    }
 }
 
-bool
-DrawableObject::update_buffers(QOpenGLShaderProgram* program)
+/* Whole level, `instances` times (0: not instanced). The VAO must be bound. */
+void
+DrawableObject::draw_level(GLenum mode, size_t level, GLsizei instances) const
 {
-    if( !initialized ){
-        std::cerr << "initialize() function was not called." << std::endl;
-        std::cerr << "Cannot proceed to build()" << std::endl;
-        return false;
+    if( index_chunks.empty() ){
+        size_t index_size = (index_type == GL_UNSIGNED_SHORT) ? sizeof(GLushort) : sizeof(GLuint);
+        const void* offset = reinterpret_cast<const void*>(detail_offsets[level] * index_size);
+
+        if( instances > 0 )
+            draw_elements_instanced(mode, GLsizei(detail_level_elements(level)), index_type, offset, instances);
+        else
+            glDrawElements(mode, GLsizei(detail_level_elements(level)), index_type, offset);
+        GL_STATS_DRAW(mode, detail_level_elements(level), std::max(instances, 1));
+        return;
     }
 
-    vao->bind();
-    {
-        ebo->bind();
-        ebo->setUsagePattern(QOpenGLBuffer::StaticDraw);
-        ebo->allocate(raw_vertices_indices, int(sizeof(GLuint) * nb_elements));
+    for(size_t c=detail_chunks[level]; c < detail_chunks[level+1]; ++c){
+        const IndexChunk& chunk = index_chunks[c];
+        const void* offset = reinterpret_cast<const void*>(chunk.first * sizeof(GLushort));
 
-        int offset = 0;
-        int bytes = int(sizeof(GLfloat) * nb_vertices * tuple_size);
+        if( instances > 0 )
+            draw_elements_instanced_base_vertex(mode, GLsizei(chunk.count), GL_UNSIGNED_SHORT, offset, instances, chunk.base_vertex);
+        else
+            draw_elements_base_vertex(mode, GLsizei(chunk.count), GL_UNSIGNED_SHORT, offset, chunk.base_vertex);
+        GL_STATS_DRAW(mode, chunk.count, std::max(instances, 1));
+    }
+}
 
-        vbo->bind();
-        vbo->setUsagePattern(QOpenGLBuffer::StaticDraw);
-        vbo->allocate( int(properties) * bytes );
+/*
+ * Instances come grouped by level of detail into the instance buffer:
+ * each group is one instanced draw, its attributes starting at its first instance.
+ * A coarser current level (e.g. while interacting) applies to every instance.
+ */
+void
+DrawableObject::show_instances(QOpenGLShaderProgram* program, GLenum mode) const
+{
+    const size_t stride = sizeof(GLfloat) * 32;
+    const QMatrix4x4& placed = placed_model();
+    const QMatrix4x4& normal = normal_model();
 
-        if( location_vertices_coordinates >= 0 ){
-            vbo->write(offset, raw_vertices_coordinates, bytes);
-            program->enableAttributeArray(location_vertices_coordinates);
-            program->setAttributeBuffer(location_vertices_coordinates, GL_FLOAT, offset, int(tuple_size), 0);
+    // Only for the draw: the VAO may be shared with copies.
+    vao->bind();
+    GL_STATS_ADD(vao_binds, 1);
+    if( draw_elements_instanced != nullptr ){
+        program->setUniformValue(location_instances_on, true);
+        GL_STATS_ADD(uniform_sets, location_instances_on >= 0);
+        for(int c=0; c < 4; ++c){
+            program->enableAttributeArray(location_instances + c);
+            program->enableAttributeArray(location_instances_normal + c);
+            vertex_attrib_divisor(GLuint(location_instances + c), 1);
+            vertex_attrib_divisor(GLuint(location_instances_normal + c), 1);
         }
+    }
 
-        if( location_vertices_colors >= 0 ){
-            offset += bytes;
-            vbo->write(offset, raw_vertices_colors, bytes);
-            program->enableAttributeArray(location_vertices_colors);
-            program->setAttributeBuffer(location_vertices_colors, GL_FLOAT, offset, int(tuple_size), 0);
-        }
+    size_t first = 0;
+    for(size_t group=0; group < instance_counts.size(); first += instance_counts[group], ++group){
+        const size_t count = instance_counts[group];
+        if( count == 0 )
+            continue;
 
-        if( location_vertices_normals >= 0 ){
-            offset += bytes;
-            vbo->write(offset, raw_vertices_normals, bytes);
-            program->enableAttributeArray(location_vertices_normals);
-            program->setAttributeBuffer(location_vertices_normals, GL_FLOAT, offset, int(tuple_size), 0);
-        }
-    }
-    vao->release();
-    ebo->release();
-    vbo->release();
+        size_t level = std::min(std::max(group, detail_level), nb_detail_levels() - 1);
 
-    return true;
-}
+        if( draw_elements_instanced != nullptr ){
+            instance_vbo->bind();
+            GL_STATS_ADD(buffer_binds, 1);
+            for(int c=0; c < 4; ++c){
+                program->setAttributeBuffer(location_instances + c, GL_FLOAT, int(stride * first + sizeof(GLfloat) * 4 * size_t(c)), 4, int(stride));
+                program->setAttributeBuffer(location_instances_normal + c, GL_FLOAT, int(stride * first + sizeof(GLfloat) * (16 + 4 * size_t(c))), 4, int(stride));
+            }
+            instance_vbo->release();
+            GL_STATS_ADD(buffer_binds, 1);
 
+            draw_level(mode, level, GLsizei(count));
+            continue;
+        }
 
-void
-DrawableObject::show(QOpenGLShaderProgram* program, GLenum mode) const
-{
-    if( initialized ){
-        // Update uniform values into vertex shader
-        program->setUniformValue("model", *model); // shader transformation computation
-        program->setUniformValue("model_inverse", model->transposed().inverted()); // shader light computation
+        // QMatrix4x4(const float*) reads rows: column-major transforms come out transposed.
+        for(size_t i=first; i < first + count; ++i){
+            const GLfloat* transform = instance_transform(instance_order[i]);
+            program->setUniformValue(location_model, QMatrix4x4(transform).transposed() * placed);
+            program->setUniformValue(location_model_inverse, QMatrix4x4(transform + 16).transposed() * normal);
+            GL_STATS_ADD(uniform_sets, (location_model >= 0) + (location_model_inverse >= 0));
+            draw_level(mode, level, 0);
+        }
+    }
 
-        vao->bind();
-        glDrawElements(mode, GLsizei(nb_elements), GL_UNSIGNED_INT, nullptr);
-        vao->release();
+    if( draw_elements_instanced != nullptr ){
+        program->setUniformValue(location_instances_on, false);
+        GL_STATS_ADD(uniform_sets, location_instances_on >= 0);
+        for(int c=0; c < 4; ++c){
+            vertex_attrib_divisor(GLuint(location_instances + c), 0);
+            vertex_attrib_divisor(GLuint(location_instances_normal + c), 0);
+            program->disableAttributeArray(location_instances + c);
+            program->disableAttributeArray(location_instances_normal + c);
+        }
     }
+    vao->release();
+    GL_STATS_ADD(vao_binds, 1);
 }
 
 void
 DrawableObject::translate(float x, float y, float z)
 {
     model->translate(x, y, z);
+    matrices_dirty = true;
 }
 
 void
 DrawableObject::scale(float x, float y, float z)
 {
     model->scale(x, y, z);
+    matrices_dirty = true;
 }
 
 void
 DrawableObject::rotate(float angle, float x, float y, float z)
 {
     model->rotate(angle, x, y, z);
+    matrices_dirty = true;
 }
 
 void
@@ -135,6 +1557,7 @@ DrawableObject::reset_model_matrix()
 {
     model->setToIdentity();
     model->optimize();
+    matrices_dirty = true;
 }
 
 const QMatrix4x4&
@@ -146,73 +1569,236 @@ DrawableObject::model_matrix() const
 
 /*
  * This function which fills the raw_vertices_colors array.
- * It needs to be called before the `build()` function;
+ * It needs to be called before the `update_buffers()` function;
  * Otherwise, the color setup will not be used.
  */
 void
 DrawableObject::use_unique_color(float r, float g, float b)
 {
-    if( raw_vertices_colors == nullptr ){
+    if( location_vertices_colors < 0 ){
         std::cerr << "`set_vertices_colors()` need to be called before." << std::endl;
         return;
     }
 
+    // Colors may be streamed by a child class or shared with copies: ours from now on.
+    // Every value is written below, nothing to copy.
+    if( raw_vertices_colors == nullptr || owned_colors.use_count() > 1 ){
+        free_vertices_colors();
+        raw_vertices_colors = new GLfloat[nb_vertices*3];
+        owned_colors = own_array(raw_vertices_colors);
+    }
+
     for(size_t i=0; i < 3*nb_vertices; i+=3){
         raw_vertices_colors[i] = r;
         raw_vertices_colors[i+1] = g;
         raw_vertices_colors[i+2] = b;
     }
+
+    mark_dirty(location_vertices_colors, 0, nb_vertices);
 }
 
+/*
+ * Raw arrays are shared with `obj` (borrowed ones along with their owner), nothing is copied.
+ * Without raw arrays (render-only mode, streamed attributes) they are read back
+ * from the GPU: in that case the OpenGL context must be current.
+ */
 void
 DrawableObject::copy_geometry_to(DrawableObject* obj) const
 {
-    const GLfloat* positions = get_vertices_coordinates();
-    if( positions != nullptr ){
-        GLfloat* copy_positions = new GLfloat[nb_vertices*tuple_size];
-        for(size_t i=0; i < nb_vertices*tuple_size; ++i)
-            copy_positions[i] = positions[i];
+    std::shared_ptr<GLfloat> positions = owned_coordinates;
+    std::shared_ptr<GLuint> indices = owned_indices;
+    bool borrowed = borrowed_geometry && positions != nullptr && indices != nullptr;
+
+    if( positions == nullptr )
+        positions = own_array(read_back(location_vertices_coordinates));
 
-        const GLuint* indices = get_vertices_indices();
-        GLuint* copy_indices = new GLuint[nb_elements];
-        for(size_t i=0; i < nb_elements; ++i)
-            copy_indices[i] = indices[i];
+    if( indices == nullptr )
+        indices = own_array(read_back_indices());
 
-        obj->set_vertices_geometry(
-            location_vertices_coordinates,
-            copy_positions,
-            copy_indices
-        );
+    if( positions != nullptr && indices != nullptr ){
+        obj->set_vertices_geometry(location_vertices_coordinates, nullptr, nullptr);
+        obj->raw_vertices_coordinates = positions.get();
+        obj->raw_vertices_indices = indices.get();
+        obj->owned_coordinates = positions;
+        obj->owned_indices = indices;
+        obj->borrowed_geometry = borrowed;
     }
 }
 
 void
 DrawableObject::copy_colors_to(DrawableObject* obj) const
 {
-    const GLfloat* colors = get_vertices_colors();
-    if( colors != nullptr ){
-        GLfloat* copy_colors = new GLfloat[nb_vertices*3];
-        for(size_t i=0; i < nb_vertices*tuple_size; ++i)
-            copy_colors[i] = colors[i];
+    std::shared_ptr<GLfloat> colors = owned_colors;
+    if( colors == nullptr )
+        colors = own_array(read_back(location_vertices_colors));
 
-        obj->set_vertices_colors(location_vertices_colors, copy_colors);
+    if( colors != nullptr ){
+        obj->set_vertices_colors(location_vertices_colors, colors.get());
+        obj->owned_colors = colors;
     }
 }
 
 void
 DrawableObject::copy_normals_to(DrawableObject* obj) const
 {
-    const GLfloat* normals = get_vertices_normals();
-    GLfloat* copy_normals = nullptr;
+    std::shared_ptr<GLfloat> normals = owned_normals;
+    bool borrowed = borrowed_normals;
+
+    if( normals == nullptr ){
+        normals = own_array(read_back(location_vertices_normals));
+        borrowed = false;
+    }
 
     if( normals != nullptr ){
-        copy_normals = new GLfloat[nb_vertices*3];
-        for(size_t i=0; i < nb_vertices*tuple_size; ++i)
-            copy_normals[i] = normals[i];
-        obj->set_vertices_normals(location_vertices_normals, copy_normals);
+        obj->set_vertices_normals(location_vertices_normals, nullptr);
+        obj->raw_vertices_normals = normals.get();
+        obj->owned_normals = normals;
+        obj->borrowed_normals = borrowed;
+    }
+}
+
+/* Copy tightly packed tuples to a buffer where two vertices are `stride` floats apart. */
+void
+DrawableObject::copy_vertices(GLfloat* buffer, size_t stride, const GLfloat* data, size_t count, size_t tuple_size)
+{
+    if( stride == tuple_size ){
+        std::memcpy(buffer, data, sizeof(GLfloat) * count * tuple_size);
+        return;
+    }
+
+    for(size_t i=0; i < count; ++i, buffer += stride, data += tuple_size)
+        for(size_t j=0; j < tuple_size; ++j)
+            buffer[j] = data[j];
+}
+
+/* Tuples picked in `order`: buffer vertex i is data vertex order[i]. */
+void
+DrawableObject::gather_vertices(GLfloat* buffer, size_t stride, const GLfloat* data, const GLuint* order, size_t count, size_t tuple_size)
+{
+    for(size_t i=0; i < count; ++i, buffer += stride)
+        for(size_t j=0; j < tuple_size; ++j)
+            buffer[j] = data[order[i]*tuple_size + j];
+}
+
+/* Same value for every vertex. */
+void
+DrawableObject::fill_vertices(GLfloat* buffer, size_t stride, const GLfloat* value, size_t count, size_t tuple_size)
+{
+    for(size_t i=0; i < count; ++i, buffer += stride)
+        for(size_t j=0; j < tuple_size; ++j)
+            buffer[j] = value[j];
+}
+
+/* Objects without normals export zero ones, without colors the default gray. */
+void
+DrawableObject::export_vertices(GLfloat* buffer, size_t stride, size_t first, size_t count) const
+{
+    static const GLfloat zero[3] = { 0.0f, 0.0f, 0.0f };
+    static const GLfloat gray[3] = { 0.5f, 0.5f, 0.5f };
+
+    fill_vertices_coordinates(buffer, stride, first, count);
+
+    if( location_vertices_normals >= 0 )
+        fill_vertices_normals(buffer + 3, stride, first, count);
+    else
+        fill_vertices(buffer + 3, stride, zero, count, 3);
+
+    if( location_vertices_colors >= 0 )
+        fill_vertices_colors(buffer + 6, stride, first, count);
+    else
+        fill_vertices(buffer + 6, stride, gray, count, 3);
+}
+
+void
+DrawableObject::export_indices(GLuint* buffer, GLuint base_vertex) const
+{
+    const size_t count = get_nb_elements();
+    fill_vertices_indices(buffer, detail_offsets[0], count);
+
+    for(size_t i=0; i < count; ++i)
+        buffer[i] += base_vertex;
+}
+
+void
+DrawableObject::fill_vertices_coordinates(GLfloat* buffer, size_t stride, size_t first, size_t count) const
+{
+    if( raw_vertices_coordinates != nullptr )
+        copy_vertices(buffer, stride, raw_vertices_coordinates + first*tuple_size, count, tuple_size);
+}
+
+void
+DrawableObject::fill_vertices_colors(GLfloat* buffer, size_t stride, size_t first, size_t count) const
+{
+    if( raw_vertices_colors != nullptr )
+        copy_vertices(buffer, stride, raw_vertices_colors + first*tuple_size, count, tuple_size);
+}
+
+void
+DrawableObject::fill_vertices_normals(GLfloat* buffer, size_t stride, size_t first, size_t count) const
+{
+    if( raw_vertices_normals != nullptr )
+        copy_vertices(buffer, stride, raw_vertices_normals + first*tuple_size, count, tuple_size);
+}
+
+void
+DrawableObject::fill_vertices_indices(GLuint* buffer, size_t first, size_t count) const
+{
+    if( raw_vertices_indices != nullptr )
+        std::memcpy(buffer, raw_vertices_indices + first, sizeof(GLuint) * count);
+}
+
+/* Goes through the positions the way they are uploaded, chunk by chunk. */
+void
+DrawableObject::bounding_box(GLfloat* min, GLfloat* max) const
+{
+    BoundingBox box;
+    std::vector<GLfloat> staging(staging_vertices * 3);
+
+    for(size_t first=0; first < nb_vertices; first += staging_vertices){
+        size_t count = std::min(staging_vertices, nb_vertices - first);
+        fill_vertices_coordinates(staging.data(), 3, first, count);
+        box.extend(staging.data(), count);
+    }
+
+    for(size_t j=0; j < 3; ++j){
+        min[j] = box.min[j];
+        max[j] = box.max[j];
     }
 }
 
+bool
+DrawableObject::uniform_colors(GLfloat* color) const
+{
+    if( raw_vertices_colors == nullptr || nb_vertices == 0 )
+        return false;
+
+    for(size_t i=tuple_size; i < nb_vertices*tuple_size; i+=tuple_size)
+        for(size_t j=0; j < tuple_size; ++j)
+            if( raw_vertices_colors[i+j] != raw_vertices_colors[j] )
+                return false;
+
+    for(size_t j=0; j < tuple_size; ++j)
+        color[j] = raw_vertices_colors[j];
+
+    return true;
+}
+
+/* Used by the next update_buffers() */
+void
+DrawableObject::set_vertex_layout(VertexLayout _layout)
+{
+    layout = _layout;
+    buffers_outdated = true;
+}
+
+/* Used by the next update_buffers() */
+void
+DrawableObject::set_vertex_format(const VertexFormat& _format)
+{
+    format = _format;
+    buffers_outdated = true;
+}
+
 const GLfloat*
 DrawableObject::get_vertices_coordinates() const
 {
@@ -240,11 +1826,19 @@ DrawableObject::get_vertices_normals() const
 bool
 DrawableObject::initialize(size_t _nb_vertices, size_t _nb_elements, size_t _tuple_size)
 {
+    // New geometry: instances were made for the previous one.
+    clear_instances();
+
     if( create_buffers() ){
         nb_vertices = _nb_vertices;
         nb_elements = _nb_elements;
         tuple_size = _tuple_size;
         initialized = true;
+        buffers_outdated = true;
+
+        detail_offsets.assign(1, 0);
+        detail_offsets.push_back(nb_elements);
+        detail_level = 0;
     }
     else {
         std::cerr << "Failed to create GPU buffers." << std::endl;
@@ -253,8 +1847,236 @@ DrawableObject::initialize(size_t _nb_vertices, size_t _nb_elements, size_t _tup
     return initialized;
 }
 
+bool
+DrawableObject::set_detail_levels(const std::vector<size_t>& elements)
+{
+    std::vector<size_t> offsets(1, 0);
+    for(size_t count: elements)
+        offsets.push_back(offsets.back() + count);
+
+    if( !initialized || elements.empty() || offsets.back() != nb_elements ){
+        std::cerr << "Levels of detail do not match the indices." << std::endl;
+        return false;
+    }
+
+    detail_offsets = offsets;
+    detail_level = 0;
+    return true;
+}
+
+/*
+ * Ranges are turned into draw call arguments once, here, not at every show():
+ * with index chunks, each range is cut where level 0 chunks are.
+ */
+void
+DrawableObject::set_visible_ranges(const std::vector<ElementRange>& ranges)
+{
+    visible_counts.clear();
+    visible_offsets.clear();
+    visible_base_vertices.clear();
+
+    if( !uploaded ){
+        visible_ranges_on = false;
+        return;
+    }
+
+    size_t index_size = (index_type == GL_UNSIGNED_SHORT) ? sizeof(GLushort) : sizeof(GLuint);
+    size_t c = detail_chunks[0];
+
+    for(const ElementRange& range: ranges){
+        if( index_chunks.empty() ){
+            visible_counts.push_back(GLsizei(range.count));
+            visible_offsets.push_back(reinterpret_cast<const void*>(range.first * index_size));
+            continue;
+        }
+
+        // Both are sorted: chunks before this range are before the next ones too.
+        const size_t last = range.first + range.count;
+        while( c < detail_chunks[1] && index_chunks[c].first + index_chunks[c].count <= range.first )
+            ++c;
+
+        for(size_t k=c; k < detail_chunks[1] && index_chunks[k].first < last; ++k){
+            const IndexChunk& chunk = index_chunks[k];
+            size_t first = std::max(range.first, chunk.first);
+            size_t end = std::min(last, chunk.first + chunk.count);
+
+            visible_counts.push_back(GLsizei(end - first));
+            visible_offsets.push_back(reinterpret_cast<const void*>(first * sizeof(GLushort)));
+            visible_base_vertices.push_back(chunk.base_vertex);
+        }
+    }
+
+    visible_ranges_on = true;
+}
+
+void
+DrawableObject::clear_visible_ranges()
+{
+    visible_ranges_on = false;
+}
+
+/* Clamped to the coarsest level. */
+void
+DrawableObject::set_detail_level(size_t level)
+{
+    detail_level = std::min(level, nb_detail_levels() - 1);
+}
+
+/* Instanced draws with per-instance attributes: OpenGL 3.3, OpenGL ES 3.0. */
+static bool
+instancing_supported()
+{
+    QOpenGLContext* context = QOpenGLContext::currentContext();
+    if( context == nullptr )
+        return false;
+
+    QSurfaceFormat surface = context->format();
+    int version = surface.majorVersion() * 10 + surface.minorVersion();
+    return context->isOpenGLES() ? version >= 30 : version >= 33;
+}
+
+bool
+DrawableObject::set_instances(QOpenGLShaderProgram* program, const std::vector<QMatrix4x4>& transforms)
+{
+    clear_instances();
+    if( transforms.empty() )
+        return true;
+
+    if( !uploaded ){
+        std::cerr << "Instances need the buffers: call update_buffers() first." << std::endl;
+        return false;
+    }
+
+    instance_transforms.resize(32 * transforms.size());
+    for(size_t i=0; i < transforms.size(); ++i){
+        GLfloat* t = &instance_transforms[32 * i];
+        std::memcpy(t, transforms[i].constData(), 16 * sizeof(GLfloat));
+        std::memcpy(t + 16, transforms[i].transposed().inverted().constData(), 16 * sizeof(GLfloat));
+    }
+
+    // Every instance at the current level until told otherwise.
+    std::vector<size_t> levels(transforms.size(), 0);
+    instance_counts.clear();
+
+    location_instances = program->attributeLocation("instance_model");
+    location_instances_normal = program->attributeLocation("instance_normal");
+    location_instances_on = program->uniformLocation("instances_on");
+
+    if( instancing_supported() && location_instances >= 0 && location_instances_normal >= 0 ){
+        QOpenGLContext* context = QOpenGLContext::currentContext();
+        draw_elements_instanced = reinterpret_cast<DrawElementsInstanced>(context->getProcAddress("glDrawElementsInstanced"));
+        vertex_attrib_divisor = reinterpret_cast<VertexAttribDivisor>(context->getProcAddress("glVertexAttribDivisor"));
+        draw_elements_instanced_base_vertex = reinterpret_cast<DrawElementsInstancedBaseVertex>(
+            context->getProcAddress("glDrawElementsInstancedBaseVertex"));
+    }
+
+    if( draw_elements_instanced == nullptr || vertex_attrib_divisor == nullptr
+     || (!index_chunks.empty() && draw_elements_instanced_base_vertex == nullptr) ){
+        // One draw per instance
+        draw_elements_instanced = nullptr;
+        set_instance_levels(levels);
+        return true;
+    }
+
+    // Instance attributes are set up by show() only: the VAO may be shared with copies.
+    instance_vbo = new QOpenGLBuffer();
+    if( !instance_vbo->create() ){
+        std::cerr << "Failed to create the instance buffer." << std::endl;
+        clear_instances();
+        return false;
+    }
+
+    instance_vbo->bind();
+    instance_vbo->setUsagePattern(QOpenGLBuffer::DynamicDraw);
+    instance_vbo->allocate(int(sizeof(GLfloat) * instance_transforms.size()));
+    instance_vbo->release();
+
+    set_instance_levels(levels);
+    return true;
+}
+
+void
+DrawableObject::clear_instances()
+{
+    if( instance_vbo != nullptr ){
+        instance_vbo->destroy();
+        delete instance_vbo;
+        instance_vbo = nullptr;
+    }
+
+    instance_transforms.clear();
+    instance_order.clear();
+    instance_counts.clear();
+    draw_elements_instanced = nullptr;
+    draw_elements_instanced_base_vertex = nullptr;
+    vertex_attrib_divisor = nullptr;
+}
+
+/*
+ * Group instances by level. The buffer is only written again when the grouping changed:
+ * a still camera costs no upload at all.
+ */
+void
+DrawableObject::set_instance_levels(const std::vector<size_t>& levels)
+{
+    const size_t nb_levels = nb_detail_levels();
+
+    std::vector<size_t> counts(nb_levels + 1, 0);
+    for(size_t level: levels)
+        ++counts[std::min(level, nb_levels)];
+
+    std::vector<size_t> starts(nb_levels + 1, 0);
+    for(size_t l=1; l <= nb_levels; ++l)
+        starts[l] = starts[l-1] + counts[l-1];
+
+    std::vector<GLuint> order(levels.size());
+    for(size_t i=0; i < levels.size(); ++i)
+        order[starts[std::min(levels[i], nb_levels)]++] = GLuint(i);
+
+    // Culled ones are left at the end, never drawn.
+    order.resize(levels.size() - counts.back());
+    counts.pop_back();
+
+    if( order == instance_order && counts == instance_counts )
+        return;
+
+    instance_order.swap(order);
+    instance_counts.swap(counts);
+
+    if( instance_vbo == nullptr || instance_order.empty() )
+        return;
+
+    std::vector<GLfloat> grouped(32 * instance_order.size());
+    for(size_t i=0; i < instance_order.size(); ++i)
+        std::memcpy(&grouped[32 * i], instance_transform(instance_order[i]), 32 * sizeof(GLfloat));
+
+    instance_vbo->bind();
+    GL_STATS_ADD(buffer_binds, 1);
+    instance_vbo->write(0, grouped.data(), int(sizeof(GLfloat) * grouped.size()));
+    GL_STATS_ADD(bytes_written, sizeof(GLfloat) * grouped.size());
+    instance_vbo->release();
+    GL_STATS_ADD(buffer_binds, 1);
+}
+
+size_t
+DrawableObject::instances_drawn() const
+{
+    return instance_order.size();
+}
+
+/* Elements drawn by all the instances, levels of detail included. */
+size_t
+DrawableObject::instances_elements() const
+{
+    size_t elements = 0;
+    for(size_t group=0; group < instance_counts.size(); ++group)
+        elements += instance_counts[group] * detail_level_elements(std::min(std::max(group, detail_level), nb_detail_levels() - 1));
+    return elements;
+}
+
 void
-DrawableObject::set_vertices_geometry(int shader_location, GLfloat* coordinates, GLuint* indices)
+DrawableObject::set_vertices_geometry(int shader_location, GLfloat* coordinates, GLuint* indices,
+                                      const std::shared_ptr<const void>& owner)
 {
     if( shader_location < 0 )
         return;
@@ -269,6 +2091,17 @@ DrawableObject::set_vertices_geometry(int shader_location, GLfloat* coordinates,
     free_vertices_geometry();
     raw_vertices_coordinates = coordinates;
     raw_vertices_indices = indices;
+    buffers_outdated = true;
+
+    borrowed_geometry = (owner != nullptr);
+    if( borrowed_geometry ){
+        owned_coordinates = borrow_array(coordinates, owner);
+        owned_indices = borrow_array(indices, owner);
+    }
+    else {
+        owned_coordinates = own_array(coordinates);
+        owned_indices = own_array(indices);
+    }
 }
 
 void
@@ -285,10 +2118,12 @@ DrawableObject::set_vertices_colors(int shader_location, GLfloat* colors)
     location_vertices_colors = shader_location;
     free_vertices_colors();
     raw_vertices_colors = colors;
+    owned_colors = own_array(colors);
+    buffers_outdated = true;
 }
 
 void
-DrawableObject::set_vertices_normals(int shader_location, GLfloat* normals)
+DrawableObject::set_vertices_normals(int shader_location, GLfloat* normals, const std::shared_ptr<const void>& owner)
 {
     if( shader_location < 0 )
         return;
@@ -302,20 +2137,21 @@ DrawableObject::set_vertices_normals(int shader_location, GLfloat* normals)
 
     free_vertices_normals();
     raw_vertices_normals = normals;
+    buffers_outdated = true;
+
+    borrowed_normals = (owner != nullptr);
+    owned_normals = borrowed_normals ? borrow_array(normals, owner) : own_array(normals);
 }
 
 void
 DrawableObject::free_vertices_geometry()
 {
-    if( raw_vertices_coordinates != nullptr ){
-        delete [] raw_vertices_coordinates;
-        raw_vertices_coordinates = nullptr;
-    }
-
-    if( raw_vertices_indices != nullptr ){
-        delete [] raw_vertices_indices;
-        raw_vertices_indices = nullptr;
-    }
+    // Freed with their last owner
+    owned_coordinates.reset();
+    owned_indices.reset();
+    borrowed_geometry = false;
+    raw_vertices_coordinates = nullptr;
+    raw_vertices_indices = nullptr;
 
     nb_vertices = 0;
     nb_elements = 0;
@@ -324,51 +2160,35 @@ DrawableObject::free_vertices_geometry()
 void
 DrawableObject::free_vertices_colors()
 {
-    if( raw_vertices_colors != nullptr ){
-        delete [] raw_vertices_colors;
-        raw_vertices_colors = nullptr;
-    }
+    owned_colors.reset();
+    raw_vertices_colors = nullptr;
 }
 
 void
 DrawableObject::free_vertices_normals()
 {
-    if( raw_vertices_normals != nullptr ){
-        delete [] raw_vertices_normals;
-        raw_vertices_normals = nullptr;
-    }
+    owned_normals.reset();
+    borrowed_normals = false;
+    raw_vertices_normals = nullptr;
 }
 
+/* Ours only: copies keep theirs. */
 void
 DrawableObject::free_buffers()
 {
-    if( vao != nullptr ){
-        vao->destroy();
-        delete vao;
-        vao = nullptr;
-    }
-
-    if( ebo != nullptr ){
-        ebo->destroy();
-        delete ebo;
-        ebo = nullptr;
-    }
-
-    if( vbo != nullptr ){
-        vbo->destroy();
-        delete vbo;
-        vbo = nullptr;
-    }
+    buffers.reset();
+    vao = nullptr;
+    ebo = nullptr;
+    vbo = nullptr;
 }
 
 bool
 DrawableObject::create_buffers()
 {
-    free_buffers();
-
-    vao = new QOpenGLVertexArrayObject();
-    ebo = new QOpenGLBuffer(QOpenGLBuffer::IndexBuffer);
-    vbo = new QOpenGLBuffer();
+    buffers = std::make_shared<Buffers>();
+    vao = &buffers->vao;
+    ebo = &buffers->ebo;
+    vbo = &buffers->vbo;
 
     return vao->create() && ebo->create() && vbo->create();
 }
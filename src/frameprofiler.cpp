@@ -0,0 +1,211 @@
+#include "../include/frameprofiler.h"
+
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+#include <iostream>
+
+/* Frames in flight: results usually come back within that many frames. */
+static const size_t ring_queries = 4;
+
+FrameProfiler::FrameProfiler(size_t window):
+    window(std::max(window, size_t(1))),
+    nb_frames(0),
+    next_query(0),
+    query_running(false)
+{
+    frames.resize(this->window, Frame{ 0, 0.0f, -1.0f });
+}
+
+FrameProfiler::~FrameProfiler()
+{
+    destroy();
+}
+
+bool
+FrameProfiler::create()
+{
+    destroy();
+
+    for(size_t q=0; q < ring_queries; ++q){
+        QOpenGLTimerQuery* query = new QOpenGLTimerQuery();
+        if( !query->create() ){
+            delete query;
+            destroy();
+            std::cerr << "Timer queries unavailable, CPU frame times only." << std::endl;
+            return false;
+        }
+
+        queries.push_back(Query{ query, 0, false });
+    }
+    return true;
+}
+
+void
+FrameProfiler::destroy()
+{
+    for(Query& q: queries){
+        q.query->destroy();
+        delete q.query;
+    }
+
+    queries.clear();
+    next_query = 0;
+    query_running = false;
+}
+
+void
+FrameProfiler::reset()
+{
+    nb_frames = 0;
+
+    // Results still to come belong to frames forgotten.
+    for(Query& q: queries)
+        q.frame = size_t(-1);
+}
+
+/* Results available by now, the others stay pending. */
+void
+FrameProfiler::read_results()
+{
+    for(Query& q: queries){
+        if( !q.pending || !q.query->isResultAvailable() )
+            continue;
+
+        GLuint64 ns = q.query->waitForResult(); // available: does not wait
+        q.pending = false;
+
+        if( q.frame < nb_frames && nb_frames - q.frame <= window ){
+            Frame& frame = frames[q.frame % window];
+            frame.gpu = float(double(ns) / 1.0e6);
+        }
+    }
+}
+
+void
+FrameProfiler::begin_frame()
+{
+    frame_start = std::chrono::steady_clock::now();
+    query_running = false;
+
+    if( queries.empty() )
+        return;
+
+    read_results();
+
+    Query& q = queries[next_query];
+    if( q.pending )
+        return;
+
+    q.frame = nb_frames;
+    q.query->begin();
+    query_running = true;
+}
+
+void
+FrameProfiler::end_frame()
+{
+    if( query_running ){
+        Query& q = queries[next_query];
+        q.query->end();
+        q.pending = true;
+        next_query = (next_query + 1) % queries.size();
+        query_running = false;
+    }
+
+    std::chrono::duration<float, std::milli> cpu = std::chrono::steady_clock::now() - frame_start;
+    frames[nb_frames % window] = Frame{ nb_frames, cpu.count(), -1.0f };
+    ++nb_frames;
+}
+
+/* Nearest rank, over the frames kept (those with a GPU time for the GPU). */
+FrameTimes
+FrameProfiler::times(bool gpu) const
+{
+    std::vector<float> ms;
+    ms.reserve(std::min(nb_frames, window));
+
+    for(size_t f=0; f < std::min(nb_frames, window); ++f){
+        float t = gpu ? frames[f].gpu : frames[f].cpu;
+        if( t >= 0.0f )
+            ms.push_back(t);
+    }
+
+    FrameTimes result = FrameTimes{ ms.size(), 0.0f, 0.0f, 0.0f, 0.0f };
+    if( ms.empty() )
+        return result;
+
+    std::sort(ms.begin(), ms.end());
+    auto rank = [&](float p){
+        size_t r = size_t(std::ceil(p * float(ms.size())));
+        return ms[std::min(std::max(r, size_t(1)), ms.size()) - 1];
+    };
+
+    result.p50 = rank(0.50f);
+    result.p95 = rank(0.95f);
+    result.p99 = rank(0.99f);
+    result.max = ms.back();
+    return result;
+}
+
+FrameTimes
+FrameProfiler::cpu_times() const
+{
+    return times(false);
+}
+
+FrameTimes
+FrameProfiler::gpu_times() const
+{
+    return times(true);
+}
+
+bool
+FrameProfiler::dump(const std::string& path) const
+{
+    std::ofstream file(path);
+    if( !file ){
+        std::cerr << "Cannot write frame times to " << path << std::endl;
+        return false;
+    }
+
+    const bool json = path.size() >= 5 && path.compare(path.size() - 5, 5, ".json") == 0;
+    const size_t kept = std::min(nb_frames, window);
+    const size_t first = nb_frames - kept;
+
+    if( !json ){
+        file << "frame,cpu_ms,gpu_ms\n";
+        for(size_t i=first; i < nb_frames; ++i){
+            const Frame& frame = frames[i % window];
+            file << frame.index << "," << frame.cpu << ",";
+            if( frame.gpu >= 0.0f )
+                file << frame.gpu;
+            file << "\n";
+        }
+        return bool(file);
+    }
+
+    auto write_times = [&](const char* name, const FrameTimes& t){
+        file << "  \"" << name << "\": { \"samples\": " << t.samples
+             << ", \"p50\": " << t.p50 << ", \"p95\": " << t.p95
+             << ", \"p99\": " << t.p99 << ", \"max\": " << t.max << " },\n";
+    };
+
+    file << "{\n";
+    file << "  \"frames\": " << nb_frames << ",\n";
+    write_times("cpu_ms", cpu_times());
+    write_times("gpu_ms", gpu_times());
+    file << "  \"samples\": [";
+    for(size_t i=first; i < nb_frames; ++i){
+        const Frame& frame = frames[i % window];
+        file << ((i == first) ? "\n" : ",\n")
+             << "    { \"frame\": " << frame.index << ", \"cpu_ms\": " << frame.cpu << ", \"gpu_ms\": ";
+        if( frame.gpu >= 0.0f )
+            file << frame.gpu;
+        else
+            file << "null";
+        file << " }";
+    }
+    file << "\n  ]\n}\n";
+    return bool(file);
+}
@@ -1,6 +1,24 @@
 #include "../include/light.h"
+#include "../include/glstats.h"
 #include <iostream>
 
+/* LightBlock of the shaders, std140 layout */
+struct LightBlock {
+    GLfloat position[3];
+    GLfloat ambient;
+    GLfloat color[3];
+    GLuint fixed;
+};
+static_assert(sizeof(LightBlock) == 32, "LightBlock must match its std140 layout");
+
+/* Once, when the light is set up: an unused uniform is optimized away by the GLSL compiler. */
+static void
+warn_missing(const char* name, int location, bool block)
+{
+    if( location < 0 && !block )
+        std::cerr << "Warning: " << name << " wasn't found into shader(s)." << std::endl;
+}
+
 Light::Light()
     :position(new QVector3D(0.0f, 0.0f, 0.0f)),
      color(new QVector3D(1.0f, 1.0f, 1.0f)),
@@ -11,7 +29,9 @@ Light::Light()
      uniform_location_color(-1),
      uniform_location_ambient(-1),
      uniform_location_fixed(-1),
-     uniform_location_is_on(-1)
+     uniform_location_is_on(-1),
+     block(nullptr),
+     dirty(true)
 {}
 
 Light::~Light()
@@ -25,12 +45,34 @@ Light::~Light()
         delete color;
         color = nullptr;
     }
+
+    if( block != nullptr ){
+        delete block;
+        block = nullptr;
+    }
+}
+
+bool
+Light::use_block(QOpenGLShaderProgram* program, GLuint binding)
+{
+    if( block == nullptr )
+        block = new UniformBuffer();
+
+    if( !block->create(program, "LightBlock", binding, sizeof(LightBlock)) ){
+        delete block;
+        block = nullptr;
+        return false;
+    }
+
+    dirty = true;
+    return true;
 }
 
 Light*
 Light::set_position(float x, float y, float z, int loc)
 {
     uniform_location_position = loc;
+    warn_missing("light_position", loc, block != nullptr);
     return update_position(x, y, z);
 }
 
@@ -38,6 +80,7 @@ Light*
 Light::set_color(float r, float g, float b, int loc)
 {
     uniform_location_color = loc;
+    warn_missing("light_color", loc, block != nullptr);
     return update_color(r, g, b);
 }
 
@@ -45,6 +88,7 @@ Light*
 Light::set_ambient(float strength, int loc)
 {
     uniform_location_ambient = loc;
+    warn_missing("light_ambient", loc, block != nullptr);
     return update_ambient(strength);
 }
 
@@ -52,6 +96,7 @@ Light*
 Light::set_fixed(bool move, int loc)
 {
     uniform_location_fixed = loc;
+    warn_missing("light_fixed", loc, block != nullptr);
     return update_move_ability(move);
 }
 
@@ -59,7 +104,9 @@ Light*
 Light::enable(int loc)
 {
     uniform_location_is_on = loc;
+    warn_missing("light_on", loc, false);
     is_on = true;
+    dirty = true;
     return this;
 }
 
@@ -77,6 +124,7 @@ Light::update_position(float x, float y, float z)
     position->setX(x);
     position->setY(y);
     position->setZ(z);
+    dirty = true;
     return this;
 }
 
@@ -86,6 +134,7 @@ Light::update_color(float r, float g, float b)
     color->setX(r);
     color->setY(g);
     color->setZ(b);
+    dirty = true;
     return this;
 }
 
@@ -93,6 +142,7 @@ Light*
 Light::update_ambient(float strength)
 {
     ambient = strength;
+    dirty = true;
     return this;
 }
 
@@ -100,6 +150,7 @@ Light*
 Light::update_move_ability(bool move)
 {
     fixed = move;
+    dirty = true;
     return this;
 }
 
@@ -133,50 +184,72 @@ Light::is_fixed() const
     return fixed;
 }
 
-/* Watchout !
- * GLSL compiler is allowed to optimize away any unused uniforms.
- * program->uniformLocation(<string>) returns -1 if it's the case.
- */
+/* Sends what changed since the last call, nothing otherwise. */
 void
-Light::to_gpu(QOpenGLShaderProgram* program) const
-{
-    if( uniform_location_is_on >= 0 ){
-        program->setUniformValue(uniform_location_is_on, is_on);
-
-        if( uniform_location_position >= 0 )
+Light::to_gpu(QOpenGLShaderProgram* program)
+{
+    if( !dirty || uniform_location_is_on < 0 )
+        return;
+
+    program->setUniformValue(uniform_location_is_on, is_on);
+    GL_STATS_ADD(uniform_sets, 1);
+
+    if( block != nullptr ){
+        LightBlock data = {
+            { position->x(), position->y(), position->z() },
+            ambient,
+            { color->x(), color->y(), color->z() },
+            fixed ? 1u : 0u
+        };
+        block->write(0, &data, sizeof(LightBlock));
+    }
+    else {
+        // -1: optimized away by the GLSL compiler, warned about at setup.
+        if( uniform_location_position >= 0 ){
             program->setUniformValue(uniform_location_position, *position);
-        else
-            std::cerr << "Warning: uniform_location_position wasn't found into shader(s)." << std::endl;
+            GL_STATS_ADD(uniform_sets, 1);
+        }
 
-        if( uniform_location_color >= 0 )
+        if( uniform_location_color >= 0 ){
             program->setUniformValue(uniform_location_color, *color);
-        else
-            std::cerr << "Warning: uniform_location_color wasn't found into shader(s)." << std::endl;
+            GL_STATS_ADD(uniform_sets, 1);
+        }
 
-        if( uniform_location_ambient >= 0 )
+        if( uniform_location_ambient >= 0 ){
             program->setUniformValue(uniform_location_ambient, ambient);
-        else
-            std::cerr << "Warning: uniform_location_ambient wasn't found into shader(s)." << std::endl;
+            GL_STATS_ADD(uniform_sets, 1);
+        }
 
-        if( uniform_location_fixed >= 0 )
+        if( uniform_location_fixed >= 0 ){
             program->setUniformValue(uniform_location_fixed, fixed);
-        else
-            std::cerr << "Warning: uniform_location_fixed wasn't found into shader(s)." << std::endl;
+            GL_STATS_ADD(uniform_sets, 1);
+        }
     }
+
+    dirty = false;
 }
 
+/* Right away with a program (context current), at the next to_gpu() otherwise. */
 void
 Light::on(QOpenGLShaderProgram* program)
 {
     is_on = true;
-    if( program && uniform_location_is_on >= 0 )
+    if( program && uniform_location_is_on >= 0 ){
         program->setUniformValue(uniform_location_is_on, is_on);
+        GL_STATS_ADD(uniform_sets, 1);
+    }
+    else
+        dirty = true;
 }
 
 void
 Light::off(QOpenGLShaderProgram* program)
 {
     is_on = false;
-    if( program && uniform_location_is_on >= 0 )
+    if( program && uniform_location_is_on >= 0 ){
         program->setUniformValue(uniform_location_is_on, is_on);
+        GL_STATS_ADD(uniform_sets, 1);
+    }
+    else
+        dirty = true;
 }
@@ -1,4 +1,5 @@
 #include "../include/mainwindow.h"
+#include "../include/trace.h"
 #include <QApplication>
 #include <QSurfaceFormat>
 
@@ -6,6 +7,20 @@ int main(int argc, char *argv[])
 {
     QApplication a(argc, argv);
 
+    // --trace <file> (or --trace=<file>): Chrome trace events, written on exit.
+    const QStringList arguments = a.arguments();
+    for(int i=1; i < arguments.size(); ++i){
+        QString trace;
+        if( arguments[i] == "--trace" && i+1 < arguments.size() )
+            trace = arguments[++i];
+        else
+        if( arguments[i].startsWith("--trace=") )
+            trace = arguments[i].mid(8);
+
+        if( !trace.isEmpty() && Trace::start(trace.toStdString()) )
+            Trace::name_thread("GUI");
+    }
+
     QSurfaceFormat format;
     format.setSwapInterval(0); // disable v-sync
     format.setSwapBehavior(QSurfaceFormat::SwapBehavior::DoubleBuffer);
@@ -15,7 +30,13 @@ int main(int argc, char *argv[])
     format.setRenderableType(QSurfaceFormat::OpenGL);
     QSurfaceFormat::setDefaultFormat(format);
 
-    MainWindow w;
-    w.show();
-    return a.exec();
+    int status;
+    {
+        MainWindow w;
+        w.show();
+        status = a.exec();
+    }
+
+    Trace::stop();
+    return status;
 }
@@ -3,13 +3,34 @@
 #include <QMessageBox>
 #include <QFileDialog>
 #include <QColorDialog>
+#include <QActionGroup>
 
 #include <thread>
 
 MainWindow::MainWindow(QWidget *parent):
-    QMainWindow(parent), ui(new Ui::MainWindow()), save_directory(".")
+    QMainWindow(parent), ui(new Ui::MainWindow()), save_directory("."),
+    loading_progress(nullptr), loading_cancel(nullptr), culling_stats(nullptr),
+    scene_stats(nullptr), frame_stats(nullptr)
 {
     ui->setupUi(this);
+
+    loading_progress = new QProgressBar(this);
+    loading_progress->setRange(0, 100);
+    loading_progress->setMaximumWidth(200);
+    loading_cancel = new QPushButton("Cancel", this);
+    ui->statusBar->addPermanentWidget(loading_progress);
+    ui->statusBar->addPermanentWidget(loading_cancel);
+    show_loading(false);
+
+    culling_stats = new QLabel(this);
+    ui->statusBar->addPermanentWidget(culling_stats);
+
+    scene_stats = new QLabel(this);
+    ui->statusBar->addPermanentWidget(scene_stats);
+
+    frame_stats = new QLabel(this);
+    ui->statusBar->addPermanentWidget(frame_stats);
+
     size_t refresh_rate = size_t(QApplication::primaryScreen()->refreshRate());
     ui->viewer->set_frames_per_second(refresh_rate);
 
@@ -73,6 +94,139 @@ MainWindow::timerEvent(QTimerEvent*)
 {   
     ui->fps->display(int(ui->viewer->get_computed_frames()));
     ui->viewer->reset_computed_frames();
+    show_culling_stats();
+    show_scene_stats();
+    show_frame_stats();
+}
+
+void
+MainWindow::show_loading(bool on)
+{
+    loading_progress->setVisible(on);
+    loading_cancel->setVisible(on);
+}
+
+void
+MainWindow::show_culling_stats()
+{
+    MeshObject* mesh = ui->viewer->get_mesh();
+    if( mesh != nullptr && mesh->nb_instances() > 0 ){
+        culling_stats->setText(
+            "Instances: " + QString::number(mesh->instances_drawn()) +
+            "/" + QString::number(mesh->nb_instances()) +
+            " (" + QString::number(mesh->instances_elements() / 3) + " faces)"
+        );
+        return;
+    }
+
+    if( mesh == nullptr || mesh->culling_stats().clusters == 0 ){
+        culling_stats->clear();
+        return;
+    }
+
+    const CullingStats& stats = mesh->culling_stats();
+    const OcclusionStats& occlusion = mesh->occlusion_stats();
+
+    QString occluded;
+    if( ui->action_occlusion_culling->isChecked() && occlusion.chunks > 0 ){
+        occluded =
+            " | Occluded: " + QString::number(stats.occlusion_culled) +
+            " (" + QString::number(occlusion.occluded) + "/" + QString::number(occlusion.chunks) + " chunks, " +
+            QString::number(occlusion.queries) + " queries)";
+    }
+
+    culling_stats->setText(
+        "Clusters: " + QString::number(stats.clusters - stats.frustum_culled - stats.backface_culled - stats.occlusion_culled) +
+        "/" + QString::number(stats.clusters) +
+        " | Frustum culled: " + QString::number(stats.frustum_culled) +
+        " | Back-face culled: " + QString::number(stats.backface_culled) +
+        occluded +
+        " | Draws: " + QString::number(stats.draws)
+    );
+}
+
+void
+MainWindow::show_frame_stats()
+{
+    const FrameProfiler* profiler = ui->viewer->get_profiler();
+    if( profiler == nullptr || profiler->frames_timed() == 0 ){
+        frame_stats->clear();
+        return;
+    }
+
+    auto percentiles = [](const QString& name, const FrameTimes& t){
+        return name + " ms p50 " + QString::number(double(t.p50), 'f', 2) +
+               " p95 " + QString::number(double(t.p95), 'f', 2) +
+               " p99 " + QString::number(double(t.p99), 'f', 2) +
+               " max " + QString::number(double(t.max), 'f', 2);
+    };
+
+    QString text = percentiles("CPU", profiler->cpu_times());
+    if( profiler->has_gpu_times() ){
+        // Sorts the whole window: once.
+        const FrameTimes gpu = profiler->gpu_times();
+        if( gpu.samples > 0 )
+            text += " | " + percentiles("GPU", gpu);
+    }
+
+    frame_stats->setText(text);
+}
+
+void
+MainWindow::show_scene_stats()
+{
+    Scene* scene = ui->viewer->get_scene();
+    if( scene == nullptr || scene->is_empty() ){
+        scene_stats->clear();
+        return;
+    }
+
+    const double MB = 1024.0 * 1024.0;
+
+    scene_stats->setText(
+        "Scene: " + QString::number(scene->nb_parts()) + " parts" +
+        " | Pools: " + QString::number(scene->nb_pools()) +
+        " | Draws: " + QString::number(scene->last_draw_calls()) +
+        " | GPU: " + QString::number(scene->gpu_memory() / MB, 'f', 1) + " MB"
+    );
+}
+
+/* update status bar */
+void
+MainWindow::show_mesh_infos()
+{
+    MeshObject* mesh = ui->viewer->get_mesh();
+    if( mesh == nullptr )
+        return;
+
+    const double MB = 1024.0 * 1024.0;
+
+    QString vertex_cache;
+    if( mesh->is_vertex_cache_optimized() ){
+        vertex_cache =
+            " | ACMR: " + QString::number(mesh->vertex_cache_before().acmr, 'f', 2) +
+            " -> " + QString::number(mesh->vertex_cache_after().acmr, 'f', 2) +
+            " | ATVR: " + QString::number(mesh->vertex_cache_before().atvr, 'f', 2) +
+            " -> " + QString::number(mesh->vertex_cache_after().atvr, 'f', 2);
+    }
+
+    QString detail_levels;
+    if( mesh->nb_detail_levels() > 1 ){
+        size_t level = mesh->current_detail_level();
+        detail_levels =
+            " | LOD: " + QString::number(level) + "/" + QString::number(mesh->nb_detail_levels() - 1) +
+            " (" + QString::number(mesh->detail_level_elements(level) / 3) + " faces)";
+    }
+
+    ui->statusBar->showMessage(
+        "Mesh: " + QString::fromStdString(mesh->name()) +
+        " | Faces: " + QString::number(mesh->nb_faces()) +
+        " | Vertices: " + QString::number(mesh->nb_vertices()) +
+        " | CPU: " + QString::number(mesh->cpu_memory() / MB, 'f', 1) + " MB" +
+        " | GPU: " + QString::number(mesh->gpu_memory() / MB, 'f', 1) + " MB" +
+        vertex_cache +
+        detail_levels
+    );
 }
 
 void
@@ -90,29 +244,94 @@ MainWindow::connect_signals_and_slots()
 
         if( !file.isEmpty() ){
             ui->viewer->load_mesh_file(file.toStdString());
-            MeshObject* mesh = ui->viewer->get_mesh();
-            if( mesh != nullptr ){
-                /* update status bar */
-                ui->statusBar->showMessage(
-                    "Mesh: " + QString::fromStdString(mesh->name()) +
-                    " | Faces: " + QString::number(mesh->nb_faces()) +
-                    " | Vertices: " + QString::number(mesh->nb_vertices())
-                );
-            }
+            show_loading(true);
+        }
+        else
+            ui->statusBar->showMessage("");
+    });
+
+    // Same, into the scene
+    connect(ui->action_add_to_scene, &QAction::triggered, this, [=](){
+        QString file = QFileDialog::getOpenFileName(
+            this, "Add a Mesh file to the Scene", "..", "Mesh files (*.off *.obj)",
+            nullptr, QFileDialog::DontUseNativeDialog
+        );
+
+        if( !file.isEmpty() ){
+            ui->viewer->add_mesh_file(file.toStdString());
+            show_loading(true);
         }
         else
             ui->statusBar->showMessage("");
     });
 
+    connect(ui->action_clear_scene, &QAction::triggered, this, [=](){
+        ui->viewer->clear_scene();
+        show_scene_stats();
+    });
+
+#ifdef GL_STATS
+    // Counters of the GL calls, only into GL_STATS builds
+    QAction* action_gl_stats = ui->menu_viewer->addAction("GL Stats Overlay");
+    action_gl_stats->setCheckable(true);
+    connect(action_gl_stats, &QAction::toggled, ui->viewer, &MeshViewerWidget::show_hud);
+#endif
+
+    // CSV: one line per frame, JSON: percentiles as well
+    connect(ui->action_dump_frame_times, &QAction::triggered, this, [=](){
+        const FrameProfiler* profiler = ui->viewer->get_profiler();
+        if( profiler == nullptr )
+            return;
+
+        QString file = QFileDialog::getSaveFileName(
+            this, "Dump Frame Times", save_directory + "/frames.csv", "CSV (*.csv);;JSON (*.json)",
+            nullptr, QFileDialog::DontUseNativeDialog
+        );
+
+        if( file.isEmpty() )
+            return;
+
+        if( profiler->dump(file.toStdString()) )
+            ui->statusBar->showMessage("Frame times written to " + file);
+        else
+            ui->statusBar->showMessage("Failed to write " + file);
+    });
+
+    // Mesh loading runs in background, follow it from the status bar
+    connect(ui->viewer, &MeshViewerWidget::mesh_loading, this, [=](int percent, const QString& stage){
+        loading_progress->setValue(percent);
+        ui->statusBar->showMessage(stage + "...");
+    });
+
+    connect(ui->viewer, &MeshViewerWidget::mesh_loaded, this, [=](){
+        show_loading(false);
+        show_mesh_infos();
+        show_scene_stats();
+    });
+
+    connect(ui->viewer, &MeshViewerWidget::mesh_loading_failed, this, [=](const QString& path){
+        show_loading(false);
+        ui->statusBar->showMessage("Failed to load " + path);
+    });
+
+    connect(ui->viewer, &MeshViewerWidget::mesh_loading_aborted, this, [=](){
+        show_loading(false);
+        ui->statusBar->showMessage("Loading cancelled");
+    });
+
+    connect(loading_cancel, &QPushButton::pressed, ui->viewer, &MeshViewerWidget::cancel_loading);
+
     // Fixed Light
     connect(ui->cbox_light_fixed, &QCheckBox::toggled, this, [=](bool move){
         ui->viewer->get_light()->update_move_ability(move);
+        ui->viewer->request_frame();
     });
 
     // Enable Light
     connect(ui->cbox_light_enable, &QCheckBox::toggled, this, [=](bool on){
         Light* l = ui->viewer->get_light();
         on ? l->on() : l->off();
+        ui->viewer->request_frame();
         ui->cbox_light_fixed->setEnabled(on);
     });
 
@@ -182,6 +401,53 @@ MainWindow::connect_signals_and_slots()
             ui->viewer->set_frames_per_second(size_t(framerate));
     });
 
+    // Coarse proxy while the camera moves
+    connect(ui->action_interactive_lod, &QAction::toggled, this, [=](bool on){
+        ui->action_progressive_refine->setEnabled(on);
+        ui->viewer->set_interactive_lod(on);
+    });
+
+    connect(ui->action_progressive_refine, &QAction::toggled, this, [=](bool on){
+        ui->viewer->set_progressive_refine(on);
+    });
+
+    connect(ui->action_interaction_hold, &QAction::triggered, this, [=](){
+        bool ok;
+
+        int hold = QInputDialog::getInt(
+            this, "Idle delay before full detail", "Milliseconds:",
+            ui->viewer->interaction_hold_ms(), 0, 10000, 50, &ok
+        );
+
+        if( ok )
+            ui->viewer->set_interaction_hold(hold);
+    });
+
+    connect(ui->action_target_frame_time, &QAction::triggered, this, [=](){
+        bool ok;
+
+        int frame_time = QInputDialog::getInt(
+            this, "Target frame time while moving", "Milliseconds:",
+            ui->viewer->target_frame_time_ms(), 1, 1000, 1, &ok
+        );
+
+        if( ok )
+            ui->viewer->set_target_frame_time(frame_time);
+    });
+
+    // Copies of the mesh, drawn by instancing
+    connect(ui->action_instances, &QAction::triggered, this, [=](){
+        bool ok;
+
+        int count = QInputDialog::getInt(
+            this, "Instances of the mesh", "Copies (1: the mesh alone):",
+            int(ui->viewer->instances()), 1, 100000, 1, &ok
+        );
+
+        if( ok )
+            ui->viewer->set_instances(count);
+    });
+
     // Reset View Position
     connect(ui->action_reset_view, &QAction::triggered, this, [=](){
         ui->viewer->reset_view();
@@ -226,6 +492,112 @@ MainWindow::connect_signals_and_slots()
         }
     });
 
+    // Memory mode
+    // Next loadings only
+    connect(ui->action_vertex_cache, &QAction::toggled, this, [=](bool on){
+        ui->viewer->set_vertex_cache_optimization(on);
+    });
+
+    QActionGroup* weightings = new QActionGroup(this);
+    weightings->addAction(ui->action_normals_uniform);
+    weightings->addAction(ui->action_normals_area);
+    weightings->addAction(ui->action_normals_angle);
+
+    connect(ui->action_normals_uniform, &QAction::triggered, this, [=](){
+        ui->viewer->set_normal_weighting(NormalWeighting::Uniform);
+    });
+
+    connect(ui->action_normals_area, &QAction::triggered, this, [=](){
+        ui->viewer->set_normal_weighting(NormalWeighting::Area);
+    });
+
+    connect(ui->action_normals_angle, &QAction::triggered, this, [=](){
+        ui->viewer->set_normal_weighting(NormalWeighting::Angle);
+    });
+
+    connect(ui->action_detail_levels, &QAction::toggled, this, [=](bool on){
+        ui->viewer->set_detail_levels(on);
+    });
+
+    connect(ui->action_cluster_culling, &QAction::toggled, this, [=](bool on){
+        ui->viewer->set_cluster_culling(on);
+        show_culling_stats();
+    });
+
+    connect(ui->action_occlusion_culling, &QAction::toggled, this, [=](bool on){
+        ui->viewer->set_occlusion_culling(on);
+        show_culling_stats();
+    });
+
+    connect(ui->viewer, &MeshViewerWidget::detail_level_changed, this, [=](){
+        show_mesh_infos();
+    });
+
+    connect(ui->action_model_normalization, &QAction::toggled, this, [=](bool on){
+        ui->viewer->set_model_normalization(on);
+    });
+
+    connect(ui->action_render_only, &QAction::toggled, this, [=](bool on){
+        ui->action_drop_halfedges->setEnabled(on);
+        ui->viewer->set_render_only(on, ui->action_drop_halfedges->isChecked());
+        show_mesh_infos();
+    });
+
+    connect(ui->action_drop_halfedges, &QAction::toggled, this, [=](bool on){
+        ui->viewer->set_render_only(ui->action_render_only->isChecked(), on);
+        show_mesh_infos();
+    });
+
+    // Vertex layout, one at a time
+    QActionGroup* layouts = new QActionGroup(this);
+    layouts->addAction(ui->action_layout_planar);
+    layouts->addAction(ui->action_layout_interleaved);
+    layouts->addAction(ui->action_layout_hotcold);
+
+    connect(ui->action_layout_planar, &QAction::triggered, this, [=](){
+        ui->viewer->set_vertex_layout(VertexLayout::Planar);
+    });
+
+    connect(ui->action_layout_interleaved, &QAction::triggered, this, [=](){
+        ui->viewer->set_vertex_layout(VertexLayout::Interleaved);
+    });
+
+    connect(ui->action_layout_hotcold, &QAction::triggered, this, [=](){
+        ui->viewer->set_vertex_layout(VertexLayout::HotCold);
+    });
+
+    // Vertex format, read back from every action of the menu
+    QActionGroup* positions = new QActionGroup(this);
+    positions->addAction(ui->action_positions_float);
+    positions->addAction(ui->action_positions_half);
+    positions->addAction(ui->action_positions_short);
+
+    auto apply_vertex_format = [=](){
+        VertexFormat format;
+
+        if( ui->action_positions_half->isChecked() )
+            format.positions = PositionFormat::Half;
+        else
+        if( ui->action_positions_short->isChecked() )
+            format.positions = PositionFormat::Short;
+
+        if( ui->action_packed_normals->isChecked() )
+            format.normals = NormalFormat::Packed;
+
+        // Uniform falls back to bytes when colors differ
+        if( ui->action_compact_colors->isChecked() )
+            format.colors = ColorFormat::Uniform;
+
+        format.index_chunks = ui->action_index_chunks->isChecked();
+
+        ui->viewer->set_vertex_format(format);
+        show_mesh_infos();
+    };
+
+    for(QAction* action: { ui->action_positions_float, ui->action_positions_half, ui->action_positions_short,
+                           ui->action_packed_normals, ui->action_compact_colors, ui->action_index_chunks })
+        connect(action, &QAction::triggered, this, apply_vertex_format);
+
     // Saves or not the sequence w/ default image format quality
     connect(ui->cbox_default_quality, &QCheckBox::toggled, this, [=](bool val){
         ui->spinbox_quality->setEnabled(!val);
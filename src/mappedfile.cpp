@@ -0,0 +1,75 @@
+#include "../include/mappedfile.h"
+
+#include <iostream>
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+MappedFile::MappedFile()
+    :fd(-1), bytes(nullptr), length(0)
+{}
+
+MappedFile::~MappedFile()
+{
+    close();
+}
+
+/*
+ * Map `path` into memory.
+ * `sequential` tells the kernel we are going to read it from start to end,
+ * so it can read ahead aggressively.
+ * `writable` pages are copy-on-write: the file itself is never modified.
+ */
+bool
+MappedFile::open(const std::string& path, bool sequential, bool writable)
+{
+    close();
+
+    fd = ::open(path.c_str(), O_RDONLY);
+    if( fd < 0 ){
+        std::cerr << "Cannot open " << path << std::endl;
+        return false;
+    }
+
+    struct stat infos;
+    if( fstat(fd, &infos) != 0 || infos.st_size <= 0 ){
+        close();
+        return false;
+    }
+
+    length = size_t(infos.st_size);
+
+    // MAP_PRIVATE: pages written by us stay private.
+    int protection = writable ? (PROT_READ | PROT_WRITE) : PROT_READ;
+    void* addr = mmap(nullptr, length, protection, MAP_PRIVATE, fd, 0);
+    if( addr == MAP_FAILED ){
+        std::cerr << "Cannot map " << path << " into memory" << std::endl;
+        close();
+        return false;
+    }
+
+    bytes = static_cast<char*>(addr);
+
+    if( sequential )
+        madvise(addr, length, MADV_SEQUENTIAL);
+
+    return true;
+}
+
+void
+MappedFile::close()
+{
+    if( bytes != nullptr ){
+        munmap(bytes, length);
+        bytes = nullptr;
+    }
+
+    if( fd >= 0 ){
+        ::close(fd);
+        fd = -1;
+    }
+
+    length = 0;
+}
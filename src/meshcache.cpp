@@ -0,0 +1,279 @@
+#include "../include/meshcache.h"
+
+#include <algorithm>
+#include <climits>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cstddef>
+#include <fstream>
+#include <iostream>
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+static const char cache_magic[8] = { 'V', 'I', 'E', 'W', 'C', 'A', 'C', 'H' };
+static const uint32_t cache_version = 6;
+
+/* Arrays start on 16 bytes boundaries. */
+static inline uint64_t
+align(uint64_t offset)
+{
+    return (offset + 15) & ~uint64_t(15);
+}
+
+/* Same file, whatever the way it is designated. */
+static std::string
+absolute_path(const std::string& path)
+{
+    char resolved[PATH_MAX];
+    if( realpath(path.c_str(), resolved) == nullptr )
+        return path;
+    return std::string(resolved);
+}
+
+MeshCache::MeshCache()
+    :header(nullptr)
+{}
+
+std::string
+MeshCache::cache_path(const std::string& source)
+{
+    return source + ".vcache";
+}
+
+/*
+ * 64 bits non-cryptographic hash, reading 8 bytes at a time:
+ * fast enough to be bounded by memory bandwidth.
+ */
+uint64_t
+MeshCache::hash(const char* bytes, size_t length)
+{
+    const uint64_t m1 = 0xff51afd7ed558ccdull;
+    const uint64_t m2 = 0xc4ceb9fe1a85ec53ull;
+
+    uint64_t h = 0x9e3779b97f4a7c15ull ^ uint64_t(length);
+    uint64_t w;
+    size_t i = 0;
+
+    for(; i+8 <= length; i+=8){
+        std::memcpy(&w, bytes+i, 8);
+        w *= m1;
+        w ^= w >> 33;
+        h ^= w;
+        h = ((h << 27) | (h >> 37)) * m2 + 0x52dce729;
+    }
+
+    w = 0;
+    std::memcpy(&w, bytes+i, length-i);
+    h ^= w * m1;
+
+    h ^= h >> 33;
+    h *= m1;
+    h ^= h >> 33;
+    h *= m2;
+    h ^= h >> 33;
+    return h;
+}
+
+bool
+MeshCache::source_stats(const std::string& source, uint64_t& size, int64_t& mtime)
+{
+    struct stat infos;
+    if( stat(source.c_str(), &infos) != 0 )
+        return false;
+
+    size = uint64_t(infos.st_size);
+    mtime = int64_t(infos.st_mtim.tv_sec) * 1000000000ll + int64_t(infos.st_mtim.tv_nsec);
+    return true;
+}
+
+bool
+MeshCache::content_hash(const std::string& source, uint64_t& h)
+{
+    MappedFile content;
+    if( !content.open(source) )
+        return false;
+
+    h = hash(content.data(), content.size());
+    return true;
+}
+
+bool
+MeshCache::valid() const
+{
+    if( file.size() < sizeof(Header) )
+        return false;
+
+    if( std::memcmp(header->magic, cache_magic, sizeof(cache_magic)) != 0 || header->version != cache_version )
+        return false;
+
+    uint64_t floats = header->nb_vertices * 3 * sizeof(float);
+    uint64_t indices = header->nb_indices * sizeof(uint32_t);
+
+    uint64_t levels = 0;
+    if( header->nb_levels < 1 || header->nb_levels > max_detail_levels )
+        return false;
+    for(uint64_t l=0; l < header->nb_levels; ++l)
+        levels += header->level_elements[l];
+    if( levels != header->nb_indices )
+        return false;
+
+    uint64_t meshlets = header->nb_meshlets * sizeof(Meshlet);
+
+    return header->positions_offset + floats <= file.size()
+        && header->normals_offset + floats <= file.size()
+        && header->indices_offset + indices <= file.size()
+        && header->meshlets_offset + meshlets <= file.size();
+}
+
+bool
+MeshCache::open(const std::string& source, uint32_t flags)
+{
+    close();
+
+    uint64_t size = 0;
+    int64_t mtime = 0;
+    if( !source_stats(source, size, mtime) )
+        return false;
+
+    // No cache yet, not an error.
+    std::string path = cache_path(source);
+    if( access(path.c_str(), R_OK) != 0 )
+        return false;
+
+    if( !file.open(path, false, true) )
+        return false;
+
+    header = reinterpret_cast<const Header*>(file.data());
+
+    std::string absolute = absolute_path(source);
+    if( !valid()
+     || header->path_hash != hash(absolute.data(), absolute.size())
+     || header->source_size != size
+     || header->flags != flags ){
+        close();
+        return false;
+    }
+
+    if( header->source_mtime != mtime ){
+        uint64_t h = 0;
+        if( !content_hash(source, h) || h != header->content_hash ){
+            close();
+            return false;
+        }
+
+        // Touched but unchanged: refresh the key so that next time is a fast hit.
+        int fd = ::open(path.c_str(), O_WRONLY);
+        if( fd >= 0 ){
+            if( pwrite(fd, &mtime, sizeof(mtime), offsetof(Header, source_mtime)) != ssize_t(sizeof(mtime)) )
+                std::cerr << "Cannot refresh " << path << std::endl;
+            ::close(fd);
+        }
+    }
+
+    return true;
+}
+
+void
+MeshCache::close()
+{
+    file.close();
+    header = nullptr;
+}
+
+float*
+MeshCache::positions()
+{
+    return reinterpret_cast<float*>(file.data() + header->positions_offset);
+}
+
+float*
+MeshCache::normals()
+{
+    return reinterpret_cast<float*>(file.data() + header->normals_offset);
+}
+
+uint32_t*
+MeshCache::indices()
+{
+    return reinterpret_cast<uint32_t*>(file.data() + header->indices_offset);
+}
+
+const Meshlet*
+MeshCache::meshlets() const
+{
+    return reinterpret_cast<const Meshlet*>(file.data() + header->meshlets_offset);
+}
+
+/*
+ * Written into a temporary file then renamed,
+ * so that a concurrent reader never sees half a cache.
+ * Failing to write (read-only directory ...) is not an error for the caller.
+ */
+bool
+MeshCache::write(const std::string& source, const Content& content)
+{
+    Header h;
+    std::memset(&h, 0, sizeof(h));
+    std::memcpy(h.magic, cache_magic, sizeof(cache_magic));
+    h.version = cache_version;
+    h.flags = content.flags;
+
+    std::string absolute = absolute_path(source);
+    h.path_hash = hash(absolute.data(), absolute.size());
+
+    if( !source_stats(source, h.source_size, h.source_mtime) || !content_hash(source, h.content_hash) )
+        return false;
+
+    uint64_t floats = uint64_t(content.nb_vertices) * 3 * sizeof(float);
+
+    h.nb_vertices = content.nb_vertices;
+    h.nb_indices = content.nb_indices;
+    h.nb_faces = content.nb_faces;
+    std::memcpy(h.bbox_min, content.bbox_min, sizeof(h.bbox_min));
+    std::memcpy(h.bbox_max, content.bbox_max, sizeof(h.bbox_max));
+    std::memcpy(h.acmr, content.acmr, sizeof(h.acmr));
+    std::memcpy(h.atvr, content.atvr, sizeof(h.atvr));
+
+    if( content.nb_levels > max_detail_levels )
+        return false;
+
+    h.nb_levels = std::max(content.nb_levels, size_t(1));
+    h.level_elements[0] = content.nb_indices;
+    for(size_t l=0; l < content.nb_levels; ++l)
+        h.level_elements[l] = content.level_elements[l];
+    h.positions_offset = align(sizeof(Header));
+    h.normals_offset = align(h.positions_offset + floats);
+    h.indices_offset = align(h.normals_offset + floats);
+    h.nb_meshlets = content.nb_meshlets;
+    h.meshlets_offset = align(h.indices_offset + uint64_t(content.nb_indices) * sizeof(uint32_t));
+
+    std::string path = cache_path(source);
+    std::string tmp = path + ".tmp";
+
+    std::ofstream out(tmp, std::ios::binary | std::ios::trunc);
+    if( !out )
+        return false;
+
+    const char padding[16] = {0};
+    auto write_at = [&](uint64_t offset, const void* data, uint64_t bytes){
+        out.write(padding, std::streamsize(offset - uint64_t(out.tellp())));
+        out.write(static_cast<const char*>(data), std::streamsize(bytes));
+    };
+
+    out.write(reinterpret_cast<const char*>(&h), sizeof(h));
+    write_at(h.positions_offset, content.positions, floats);
+    write_at(h.normals_offset, content.normals, floats);
+    write_at(h.indices_offset, content.indices, uint64_t(content.nb_indices) * sizeof(uint32_t));
+    write_at(h.meshlets_offset, content.meshlets, uint64_t(content.nb_meshlets) * sizeof(Meshlet));
+    out.close();
+
+    if( !out || std::rename(tmp.c_str(), path.c_str()) != 0 ){
+        std::remove(tmp.c_str());
+        return false;
+    }
+
+    return true;
+}
@@ -0,0 +1,326 @@
+#include "../include/meshlets.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <utility>
+
+static inline float
+dot(const float* a, const float* b)
+{
+    return a[0]*b[0] + a[1]*b[1] + a[2]*b[2];
+}
+
+/* 10 bits of x, spread over every third bit */
+static inline uint32_t
+spread_bits(uint32_t x)
+{
+    x = (x | (x << 16)) & 0x030000FF;
+    x = (x | (x <<  8)) & 0x0300F00F;
+    x = (x | (x <<  4)) & 0x030C30C3;
+    x = (x | (x <<  2)) & 0x09249249;
+    return x;
+}
+
+void
+Meshlets::build(const float* positions, size_t nb_vertices,
+                const uint32_t* indices, size_t nb_triangles,
+                std::vector<uint32_t>& order, std::vector<Meshlet>& meshlets)
+{
+    const uint32_t none = std::numeric_limits<uint32_t>::max();
+
+    order.clear();
+    order.reserve(nb_triangles);
+    meshlets.clear();
+
+    // Triangles around each vertex
+    std::vector<uint32_t> offsets(nb_vertices + 1, 0);
+    for(size_t i=0; i < 3*nb_triangles; ++i)
+        ++offsets[indices[i] + 1];
+    for(size_t v=0; v < nb_vertices; ++v)
+        offsets[v+1] += offsets[v];
+
+    std::vector<uint32_t> fill(offsets.begin(), offsets.end() - 1);
+    std::vector<uint32_t> adjacency(3*nb_triangles);
+    for(size_t i=0; i < 3*nb_triangles; ++i)
+        adjacency[fill[indices[i]]++] = uint32_t(i / 3);
+
+    std::vector<char> assigned(nb_triangles, 0);
+    std::vector<uint32_t> vertex_cluster(nb_vertices, none);       // last cluster using the vertex
+    std::vector<uint32_t> candidate_cluster(nb_triangles, none);   // last cluster it was a candidate of
+    std::vector<uint32_t> candidates;
+
+    // Centroids, compared again and again while clusters grow.
+    std::vector<float> centroids(3*nb_triangles, 0.0f);
+    for(size_t t=0; t < nb_triangles; ++t)
+        for(size_t k=0; k < 3; ++k)
+            for(size_t j=0; j < 3; ++j)
+                centroids[3*t + j] += positions[3*size_t(indices[3*t + k]) + j] / 3.0f;
+
+    size_t cursor = 0;
+    while( order.size() < nb_triangles ){
+        // Seed: first triangle left, in the current (vertex cache) order.
+        while( assigned[cursor] )
+            ++cursor;
+
+        const uint32_t id = uint32_t(meshlets.size());
+        Meshlet meshlet;
+        meshlet.first = uint32_t(3 * order.size());
+
+        size_t nb_cluster_vertices = 0;
+        size_t nb_cluster_triangles = 0;
+        float sum[3] = { 0.0f, 0.0f, 0.0f };
+
+        candidates.assign(1, uint32_t(cursor));
+        candidate_cluster[cursor] = id;
+
+        while( !candidates.empty() && nb_cluster_triangles < max_triangles ){
+            long best = -1;
+            size_t best_new = 4;
+            float best_distance = std::numeric_limits<float>::max();
+
+            float center[3] = { 0.0f, 0.0f, 0.0f };
+            if( nb_cluster_triangles > 0 )
+                for(size_t j=0; j < 3; ++j)
+                    center[j] = sum[j] / float(nb_cluster_triangles);
+
+            for(size_t i=0; i < candidates.size(); ++i){
+                const uint32_t* tri = indices + 3*size_t(candidates[i]);
+                size_t fresh = 0;
+                for(size_t k=0; k < 3; ++k)
+                    fresh += (vertex_cluster[tri[k]] != id);
+
+                if( nb_cluster_vertices + fresh > max_vertices || fresh > best_new )
+                    continue;
+
+                const float* c = centroids.data() + 3*size_t(candidates[i]);
+                float d[3];
+                for(size_t j=0; j < 3; ++j)
+                    d[j] = c[j] - center[j];
+                float distance = dot(d, d);
+
+                if( fresh < best_new || distance < best_distance ){
+                    best = long(i);
+                    best_new = fresh;
+                    best_distance = distance;
+                }
+            }
+
+            // Full: every candidate would bring too many vertices.
+            if( best < 0 )
+                break;
+
+            uint32_t t = candidates[size_t(best)];
+            candidates[size_t(best)] = candidates.back();
+            candidates.pop_back();
+
+            assigned[t] = 1;
+            order.push_back(t);
+            ++nb_cluster_triangles;
+
+            for(size_t j=0; j < 3; ++j)
+                sum[j] += centroids[3*size_t(t) + j];
+
+            for(size_t k=0; k < 3; ++k){
+                uint32_t v = indices[3*size_t(t) + k];
+                if( vertex_cluster[v] != id ){
+                    vertex_cluster[v] = id;
+                    ++nb_cluster_vertices;
+                }
+
+                for(uint32_t a=offsets[v]; a < offsets[v+1]; ++a){
+                    uint32_t n = adjacency[a];
+                    if( !assigned[n] && candidate_cluster[n] != id ){
+                        candidate_cluster[n] = id;
+                        candidates.push_back(n);
+                    }
+                }
+            }
+        }
+
+        meshlet.count = uint32_t(3 * order.size()) - meshlet.first;
+        bounds(positions, indices, order.data() + meshlet.first / 3, meshlet);
+        meshlets.push_back(meshlet);
+    }
+
+    sort_spatially(order, meshlets);
+}
+
+/*
+ * Clusters along a Morton curve of their centers: neighbours into the EBO are neighbours in space,
+ * so that any run of clusters stays compact (see OcclusionCulling).
+ */
+void
+Meshlets::sort_spatially(std::vector<uint32_t>& order, std::vector<Meshlet>& meshlets)
+{
+    float low[3], high[3];
+    for(size_t j=0; j < 3; ++j){
+        low[j] = std::numeric_limits<float>::max();
+        high[j] = std::numeric_limits<float>::lowest();
+    }
+
+    for(const Meshlet& m: meshlets)
+        for(size_t j=0; j < 3; ++j){
+            low[j] = std::min(low[j], m.center[j]);
+            high[j] = std::max(high[j], m.center[j]);
+        }
+
+    std::vector<std::pair<uint32_t, uint32_t>> keys(meshlets.size());
+    for(size_t i=0; i < meshlets.size(); ++i){
+        uint32_t code = 0;
+        for(size_t j=0; j < 3; ++j){
+            float extent = high[j] - low[j];
+            float x = (extent > 0.0f) ? (meshlets[i].center[j] - low[j]) / extent : 0.0f;
+            code |= spread_bits(uint32_t(std::min(1023.0f, x * 1024.0f))) << j;
+        }
+        keys[i] = std::make_pair(code, uint32_t(i));
+    }
+    std::sort(keys.begin(), keys.end());
+
+    std::vector<uint32_t> sorted_order;
+    std::vector<Meshlet> sorted;
+    sorted_order.reserve(order.size());
+    sorted.reserve(meshlets.size());
+
+    for(const auto& key: keys){
+        Meshlet m = meshlets[key.second];
+        sorted_order.insert(sorted_order.end(), order.begin() + m.first / 3, order.begin() + (m.first + m.count) / 3);
+        m.first = uint32_t(3 * sorted_order.size()) - m.count;
+        sorted.push_back(m);
+    }
+
+    order.swap(sorted_order);
+    meshlets.swap(sorted);
+}
+
+/* Sphere around the box of the vertices, cone around the mean face normal. */
+void
+Meshlets::bounds(const float* positions, const uint32_t* indices, const uint32_t* order, Meshlet& meshlet)
+{
+    const size_t nb_triangles = meshlet.count / 3;
+
+    float low[3], high[3];
+    for(size_t j=0; j < 3; ++j){
+        low[j] = std::numeric_limits<float>::max();
+        high[j] = std::numeric_limits<float>::lowest();
+    }
+
+    std::vector<float> normals(3*nb_triangles, 0.0f);
+    float axis[3] = { 0.0f, 0.0f, 0.0f };
+
+    for(size_t t=0; t < nb_triangles; ++t){
+        const uint32_t* tri = indices + 3*size_t(order[t]);
+        const float* p[3] = { positions + 3*size_t(tri[0]), positions + 3*size_t(tri[1]), positions + 3*size_t(tri[2]) };
+
+        for(size_t k=0; k < 3; ++k)
+            for(size_t j=0; j < 3; ++j){
+                low[j] = std::min(low[j], p[k][j]);
+                high[j] = std::max(high[j], p[k][j]);
+            }
+
+        float e1[3], e2[3];
+        for(size_t j=0; j < 3; ++j){
+            e1[j] = p[1][j] - p[0][j];
+            e2[j] = p[2][j] - p[0][j];
+        }
+
+        float* n = normals.data() + 3*t;
+        n[0] = e1[1]*e2[2] - e1[2]*e2[1];
+        n[1] = e1[2]*e2[0] - e1[0]*e2[2];
+        n[2] = e1[0]*e2[1] - e1[1]*e2[0];
+
+        float length = std::sqrt(dot(n, n));
+        if( length > 0.0f )
+            for(size_t j=0; j < 3; ++j){
+                n[j] /= length;
+                axis[j] += n[j];
+            }
+    }
+
+    meshlet.radius = 0.0f;
+    for(size_t j=0; j < 3; ++j)
+        meshlet.center[j] = 0.5f * (low[j] + high[j]);
+
+    for(size_t t=0; t < nb_triangles; ++t){
+        const uint32_t* tri = indices + 3*size_t(order[t]);
+        for(size_t k=0; k < 3; ++k){
+            const float* p = positions + 3*size_t(tri[k]);
+            float d[3] = { p[0] - meshlet.center[0], p[1] - meshlet.center[1], p[2] - meshlet.center[2] };
+            meshlet.radius = std::max(meshlet.radius, std::sqrt(dot(d, d)));
+        }
+    }
+
+    // Degenerated triangles (zero normals) do not restrict the cone.
+    float length = std::sqrt(dot(axis, axis));
+    meshlet.cone_cos = -1.0f;
+    if( length > 0.0f ){
+        meshlet.cone_cos = 1.0f;
+        for(size_t j=0; j < 3; ++j)
+            axis[j] /= length;
+
+        for(size_t t=0; t < nb_triangles; ++t){
+            const float* n = normals.data() + 3*t;
+            if( dot(n, n) > 0.0f )
+                meshlet.cone_cos = std::min(meshlet.cone_cos, dot(axis, n));
+        }
+    }
+
+    for(size_t j=0; j < 3; ++j)
+        meshlet.axis[j] = axis[j];
+    meshlet.cone_sin = std::sqrt(std::max(0.0f, 1.0f - meshlet.cone_cos * meshlet.cone_cos));
+}
+
+void
+Meshlets::frustum_planes(const float* clip, float planes[6][4])
+{
+    // row(r) of a column-major matrix
+    auto row = [clip](size_t r, size_t c){ return clip[4*c + r]; };
+
+    for(size_t axis=0; axis < 3; ++axis)
+        for(size_t c=0; c < 4; ++c){
+            planes[2*axis][c] = row(3, c) + row(axis, c);      // left, bottom, near
+            planes[2*axis + 1][c] = row(3, c) - row(axis, c);  // right, top, far
+        }
+
+    for(size_t p=0; p < 6; ++p){
+        float length = std::sqrt(dot(planes[p], planes[p]));
+        if( length > 0.0f )
+            for(size_t c=0; c < 4; ++c)
+                planes[p][c] /= length;
+    }
+}
+
+bool
+Meshlets::outside_frustum(const Meshlet& meshlet, const float planes[6][4])
+{
+    for(size_t p=0; p < 6; ++p)
+        if( dot(planes[p], meshlet.center) + planes[p][3] < -meshlet.radius )
+            return true;
+    return false;
+}
+
+/*
+ * Seen from the camera, the sphere spans directions within `beta` of its center (sin(beta) = radius / distance).
+ * Every face is back-facing when all those directions and all the cone normals
+ * are less than 90 degrees apart: angle(axis, center - camera) + angle + beta < 90 degrees.
+ */
+bool
+Meshlets::back_facing(const Meshlet& meshlet, const float* camera)
+{
+    if( meshlet.cone_cos <= 0.0f )
+        return false;
+
+    float v[3] = { meshlet.center[0] - camera[0], meshlet.center[1] - camera[1], meshlet.center[2] - camera[2] };
+    float distance = std::sqrt(dot(v, v));
+    if( distance <= meshlet.radius )
+        return false;
+
+    float sin_beta = meshlet.radius / distance;
+    float cos_beta = std::sqrt(1.0f - sin_beta * sin_beta);
+
+    // cos & sin of (angle + beta)
+    float cos_sum = meshlet.cone_cos * cos_beta - meshlet.cone_sin * sin_beta;
+    float sin_sum = meshlet.cone_sin * cos_beta + meshlet.cone_cos * sin_beta;
+
+    return cos_sum > 0.0f && dot(meshlet.axis, v) > sin_sum * distance;
+}
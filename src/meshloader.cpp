@@ -0,0 +1,82 @@
+#include "../include/meshloader.h"
+#include "../include/trace.h"
+
+MeshLoader::MeshLoader(const std::string& _path, QObject* parent)
+    :QThread(parent), path(_path), cancelled(false), vertex_cache_optimization(true),
+     normal_weighting(NormalWeighting::Uniform), model_normalization(false),
+     detail_levels(true)
+{
+    qRegisterMetaType<MeshObject*>("MeshObject*");
+}
+
+MeshLoader::~MeshLoader()
+{
+    cancel();
+    wait();
+}
+
+void
+MeshLoader::cancel()
+{
+    cancelled = true;
+}
+
+bool
+MeshLoader::is_cancelled() const
+{
+    return cancelled;
+}
+
+void
+MeshLoader::set_vertex_cache_optimization(bool on)
+{
+    vertex_cache_optimization = on;
+}
+
+void
+MeshLoader::set_normal_weighting(NormalWeighting weighting)
+{
+    normal_weighting = weighting;
+}
+
+void
+MeshLoader::set_model_normalization(bool on)
+{
+    model_normalization = on;
+}
+
+void
+MeshLoader::set_detail_levels(bool on)
+{
+    detail_levels = on;
+}
+
+void
+MeshLoader::run()
+{
+    Trace::name_thread("MeshLoader");
+    TRACE_SCOPE("MeshLoader::run");
+
+    MeshObject* mesh = new MeshObject();
+    mesh->set_vertex_cache_optimization(vertex_cache_optimization);
+    mesh->set_normal_weighting(normal_weighting);
+    mesh->set_model_normalization(model_normalization);
+    mesh->set_detail_levels_generation(detail_levels);
+
+    bool ok = mesh->load(path, [this](int percent, const std::string& stage){
+        emit progress(percent, QString::fromStdString(stage));
+        return !is_cancelled();
+    });
+
+    if( ok && !is_cancelled() ){
+        emit loaded(mesh);
+        return;
+    }
+
+    delete mesh;
+
+    if( is_cancelled() )
+        emit aborted();
+    else
+        emit failed(QString::fromStdString(path));
+}
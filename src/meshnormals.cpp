@@ -0,0 +1,138 @@
+#include "../include/meshnormals.h"
+#include "../include/parallel.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <thread>
+#include <vector>
+
+/* Below that, a thread costs more than it saves. */
+static const size_t min_triangles_per_thread = 1 << 15;
+
+/* Vertices [low, high] touched by a range of triangles, and their sums. */
+struct PartialSums {
+    uint32_t low;
+    uint32_t high;
+    std::vector<float> sums;
+};
+
+static inline void
+normalize(float* n)
+{
+    float length = std::sqrt(n[0]*n[0] + n[1]*n[1] + n[2]*n[2]);
+    if( length > 0.0f ){
+        n[0] /= length;
+        n[1] /= length;
+        n[2] /= length;
+    }
+}
+
+static void
+accumulate(const float* positions, const uint32_t* indices, size_t first, size_t last,
+           float* face_normals, NormalWeighting weighting, PartialSums& partial)
+{
+    partial.low = std::numeric_limits<uint32_t>::max();
+    partial.high = 0;
+    for(size_t i=3*first; i < 3*last; ++i){
+        partial.low = std::min(partial.low, indices[i]);
+        partial.high = std::max(partial.high, indices[i]);
+    }
+
+    if( first == last )
+        return;
+
+    partial.sums.assign(3 * (size_t(partial.high - partial.low) + 1), 0.0f);
+
+    for(size_t t=first; t < last; ++t){
+        const uint32_t* v = indices + 3*t;
+        const float* p[3] = { positions + 3*size_t(v[0]), positions + 3*size_t(v[1]), positions + 3*size_t(v[2]) };
+
+        float e1[3], e2[3], n[3];
+        for(size_t j=0; j < 3; ++j){
+            e1[j] = p[1][j] - p[0][j];
+            e2[j] = p[2][j] - p[0][j];
+        }
+
+        // Twice the area, along the normal
+        n[0] = e1[1]*e2[2] - e1[2]*e2[1];
+        n[1] = e1[2]*e2[0] - e1[0]*e2[2];
+        n[2] = e1[0]*e2[1] - e1[1]*e2[0];
+
+        float length = std::sqrt(n[0]*n[0] + n[1]*n[1] + n[2]*n[2]);
+        float unit[3] = { 0.0f, 0.0f, 0.0f };
+        if( length > 0.0f )
+            for(size_t j=0; j < 3; ++j)
+                unit[j] = n[j] / length;
+
+        if( face_normals != nullptr )
+            for(size_t j=0; j < 3; ++j)
+                face_normals[3*t + j] = unit[j];
+
+        float weights[3] = { 1.0f, 1.0f, 1.0f };
+        const float* direction = unit;
+
+        if( weighting == NormalWeighting::Area )
+            direction = n;
+        else
+        if( weighting == NormalWeighting::Angle ){
+            // angle = atan2(|a x b|, a.b), and |a x b| is the same at every corner.
+            for(size_t k=0; k < 3; ++k){
+                const float* o = p[k];
+                const float* a = p[(k+1) % 3];
+                const float* b = p[(k+2) % 3];
+                float dot = (a[0]-o[0])*(b[0]-o[0]) + (a[1]-o[1])*(b[1]-o[1]) + (a[2]-o[2])*(b[2]-o[2]);
+                weights[k] = std::atan2(length, dot);
+            }
+        }
+
+        for(size_t k=0; k < 3; ++k){
+            float* sum = partial.sums.data() + 3*size_t(v[k] - partial.low);
+            for(size_t j=0; j < 3; ++j)
+                sum[j] += weights[k] * direction[j];
+        }
+    }
+}
+
+void
+MeshNormals::compute(const float* positions, size_t nb_vertices,
+                     const uint32_t* indices, size_t nb_triangles,
+                     float* face_normals, float* vertex_normals,
+                     NormalWeighting weighting, unsigned int nb_threads)
+{
+    if( nb_threads == 0 )
+        nb_threads = std::max(1u, std::thread::hardware_concurrency());
+
+    size_t nb_tasks = std::max(size_t(1), std::min(size_t(nb_threads), nb_triangles / min_triangles_per_thread));
+
+    // Faces, and their contributions to the vertices they use.
+    std::vector<PartialSums> partials(nb_tasks);
+    parallel_for(nb_tasks, [&](size_t task){
+        size_t first = nb_triangles * task / nb_tasks;
+        size_t last = nb_triangles * (task+1) / nb_tasks;
+        accumulate(positions, indices, first, last, face_normals, weighting, partials[task]);
+    });
+
+    // Vertices: sum of every partial covering them.
+    parallel_for(nb_tasks, [&](size_t task){
+        size_t first = nb_vertices * task / nb_tasks;
+        size_t last = nb_vertices * (task+1) / nb_tasks;
+
+        for(size_t v=first; v < last; ++v){
+            float* n = vertex_normals + 3*v;
+            n[0] = n[1] = n[2] = 0.0f;
+
+            for(const PartialSums& partial: partials){
+                if( partial.sums.empty() || v < partial.low || v > partial.high )
+                    continue;
+
+                const float* sum = partial.sums.data() + 3*(v - partial.low);
+                n[0] += sum[0];
+                n[1] += sum[1];
+                n[2] += sum[2];
+            }
+
+            normalize(n);
+        }
+    });
+}
@@ -1,34 +1,232 @@
 #include "../include/meshobject.h"
+#include "../include/trace.h"
 
+#include <algorithm>
+#include <cmath>
+#include <cstring>
 #include <iostream>
 
-MeshObject::MeshObject(const std::string& path)
-    :DrawableObject(), _name(""), _nb_faces(0), _nb_vertices(0)
-{
-    if( OpenMesh::IO::read_mesh(mesh, path) ){
-        mesh.request_face_normals();
-        mesh.request_vertex_normals();
+#include <OpenMesh/Tools/Decimater/DecimaterT.hh>
+#include <OpenMesh/Tools/Decimater/ModQuadricT.hh>
 
-        normalize();
+/* Each level of detail aims at a quarter of the faces of the previous one, down to that. */
+static const size_t min_detail_faces = 1024;
 
-        mesh.update_face_normals();
-        mesh.update_vertex_normals();
+/* A level that removes less than that fraction of the previous one's faces is not worth it. */
+static const float min_detail_reduction = 0.25f;
 
-        _name = filename_from_path(path);
-        _nb_faces = mesh.n_faces();
-        _nb_vertices = mesh.n_vertices();
-    }
-    else {
-        std::cerr << "Failed to read " << path << std::endl;
-    }
+/* Triangles drawn per pixel covered by the bounding sphere, about half of them facing the camera. */
+static const float triangles_per_pixel = 1.0f;
+
+MeshObject::MeshObject()
+    :DrawableObject(), _name(""), _nb_faces(0), _nb_vertices(0),
+     cache(std::make_shared<MeshCache>()),
+     packed_indices(nullptr),
+     drop_halfedge_mesh(false),
+     model_normalization(false),
+     vertex_cache_optimization(true),
+     vertex_cache_optimized(false),
+     normal_weighting(NormalWeighting::Uniform),
+     detail_levels_generation(true),
+     meshlets_generation(true),
+     cluster_culling(true),
+     occlusion_culling(false),
+     occlusion(new OcclusionCulling())
+{
+    vertex_cache_stats[0] = vertex_cache_stats[1] = VertexCacheStats{ 0.0f, 0.0f };
+    culling = CullingStats{ 0, 0, 0, 0, 0, 0 };
+}
+
+MeshObject::MeshObject(const std::string& path)
+    :MeshObject()
+{
+    load(path);
 }
 
 MeshObject::~MeshObject()
 {
+    free_packed();
+
+    delete occlusion;
+    occlusion = nullptr;
+
     mesh.release_face_colors();
     mesh.release_vertex_normals();
 }
 
+/*
+ * Everything done here only touches CPU memory,
+ * so it can safely run outside of the GUI thread.
+ */
+bool
+MeshObject::load(const std::string& path, const LoadingCallback& callback)
+{
+    TRACE_SCOPE("MeshObject::load");
+
+    // Report progress to the caller, which may ask us to stop.
+    auto step = [&callback](int progress, const std::string& stage){
+        return !callback || callback(progress, stage);
+    };
+
+    if( !step(0, "Reading") )
+        return false;
+
+    _name = filename_from_path(path);
+
+    uint32_t flags = vertex_cache_optimization ? MeshCache::VertexCacheOptimized : 0;
+    if( normal_weighting == NormalWeighting::Area )
+        flags |= MeshCache::AreaWeightedNormals;
+    else
+    if( normal_weighting == NormalWeighting::Angle )
+        flags |= MeshCache::AngleWeightedNormals;
+    if( model_normalization )
+        flags |= MeshCache::ModelNormalized;
+    if( detail_levels_generation )
+        flags |= MeshCache::DetailLevels;
+    if( meshlets_generation )
+        flags |= MeshCache::Clustered;
+
+    bbox = BoundingBox();
+    detail_indices.clear();
+    detail_elements.clear();
+    meshlets.clear();
+
+    // Same file already loaded (and prepared the same way) once: nothing to compute.
+    // A new mapping: copies may still borrow from the previous one.
+    cache = std::make_shared<MeshCache>();
+
+    bool cached;
+    {
+        TRACE_SCOPE("MeshCache::open");
+        cached = cache->open(path, flags);
+    }
+
+    if( cached ){
+        _nb_faces = cache->nb_faces();
+        _nb_vertices = cache->nb_vertices();
+
+        vertex_cache_optimized = vertex_cache_optimization;
+        for(size_t i=0; i < 2; ++i)
+            vertex_cache_stats[i] = VertexCacheStats{ cache->acmr()[i], cache->atvr()[i] };
+
+        for(size_t i=0; i < 3; ++i){
+            bbox.min[i] = cache->bbox_min()[i];
+            bbox.max[i] = cache->bbox_max()[i];
+        }
+
+        if( model_normalization )
+            normalize_model();
+
+        if( cache->nb_levels() > 1 )
+            for(size_t l=0; l < cache->nb_levels(); ++l)
+                detail_elements.push_back(cache->level_elements(l));
+
+        meshlets.assign(cache->meshlets(), cache->meshlets() + cache->nb_meshlets());
+
+        return step(100, "Uploading");
+    }
+
+    // Fast path for ASCII OBJ/OFF, OpenMesh::IO for everything else.
+    {
+        TRACE_SCOPE("read_mesh");
+        RawMesh raw;
+        if( MeshReader::read(path, raw) ){
+            if( !step(25, "Building mesh") )
+                return false;
+            assign(raw);
+        }
+        else
+        if( !OpenMesh::IO::read_mesh(mesh, path) ){
+            std::cerr << "Failed to read " << path << std::endl;
+            return false;
+        }
+    }
+
+    if( !step(40, "Normalizing") )
+        return false;
+
+    mesh.request_face_normals();
+    mesh.request_vertex_normals();
+
+    {
+        TRACE_SCOPE("normalize");
+        normalize();
+    }
+
+    if( !step(55, "Computing normals") )
+        return false;
+
+    // Flat triangle indices, then every normal at once (written in place into OpenMesh properties).
+    {
+        TRACE_SCOPE("normals");
+        pack();
+        MeshNormals::compute(
+            reinterpret_cast<const float*>(mesh.points()), mesh.n_vertices(),
+            packed_indices, mesh.n_faces(),
+            reinterpret_cast<float*>(mesh.property(mesh.face_normals_pph()).data_vector().data()),
+            reinterpret_cast<float*>(mesh.property(mesh.vertex_normals_pph()).data_vector().data()),
+            normal_weighting
+        );
+    }
+
+    if( vertex_cache_optimization ){
+        if( !step(80, "Optimizing vertex cache") )
+            return false;
+
+        optimize_vertex_cache();
+    }
+
+    if( meshlets_generation ){
+        if( !step(83, "Clustering triangles") )
+            return false;
+
+        build_meshlets();
+    }
+
+    if( detail_levels_generation ){
+        if( !step(85, "Building levels of detail") )
+            return false;
+
+        generate_detail_levels();
+    }
+
+    _nb_faces = mesh.n_faces();
+    _nb_vertices = mesh.n_vertices();
+
+    if( !step(90, "Writing cache") )
+        return false;
+
+    // OpenMesh stores points & normals as contiguous arrays of 3 floats,
+    // the cache wants them in the optimized order (if any).
+    std::vector<GLfloat> positions, normals;
+    MeshCache::Content content = {
+        reinterpret_cast<const float*>(mesh.points()),
+        reinterpret_cast<const float*>(mesh.vertex_normals()),
+        _nb_vertices, packed_indices, _nb_faces*3 + detail_indices.size(), _nb_faces,
+        bbox.min, bbox.max, flags,
+        { vertex_cache_stats[0].acmr, vertex_cache_stats[1].acmr },
+        { vertex_cache_stats[0].atvr, vertex_cache_stats[1].atvr },
+        detail_elements.empty() ? nullptr : detail_elements.data(), detail_elements.size(),
+        meshlets.empty() ? nullptr : meshlets.data(), meshlets.size()
+    };
+
+    if( !vertex_order.empty() ){
+        positions.resize(_nb_vertices*3);
+        normals.resize(_nb_vertices*3);
+        fill_vertices_coordinates(positions.data(), 3, 0, _nb_vertices);
+        fill_vertices_normals(normals.data(), 3, 0, _nb_vertices);
+        content.positions = positions.data();
+        content.normals = normals.data();
+    }
+
+    {
+        TRACE_SCOPE("MeshCache::write");
+        MeshCache::write(path, content);
+    }
+
+    return step(100, "Uploading");
+}
+
 std::string
 MeshObject::filename_from_path(const std::string& path) const
 {
@@ -36,43 +234,264 @@ MeshObject::filename_from_path(const std::string& path) const
     return path.substr(pos+1);
 }
 
-bool
-MeshObject::build(QOpenGLShaderProgram* program)
+/*
+ * Build the halfedge structure from a triangle soup.
+ * Like OpenMesh readers, faces which would make the mesh non-manifold
+ * get their own copy of the vertices.
+ */
+void
+MeshObject::assign(const RawMesh& raw)
+{
+    mesh.clear();
+    mesh.reserve(raw.nb_vertices(), raw.nb_vertices() + raw.nb_triangles(), raw.nb_triangles());
+
+    // Duplicated vertices below do not change it.
+    bbox = raw.bbox;
+
+    std::vector<MyMesh::VertexHandle> handles(raw.nb_vertices());
+    const float* p = raw.positions.data();
+    for(size_t i=0; i < handles.size(); ++i, p+=3)
+        handles[i] = mesh.add_vertex(MyMesh::Point(p[0], p[1], p[2]));
+
+    MyMesh::VertexHandle face[3];
+    for(size_t i=0; i < raw.indices.size(); i+=3){
+        for(size_t j=0; j < 3; ++j)
+            face[j] = handles[raw.indices[i+j]];
+
+        // degenerated
+        if( face[0] == face[1] || face[1] == face[2] || face[0] == face[2] )
+            continue;
+
+        if( !mesh.add_face(face[0], face[1], face[2]).is_valid() ){
+            for(size_t j=0; j < 3; ++j)
+                face[j] = mesh.add_vertex(mesh.point(face[j]));
+            mesh.add_face(face[0], face[1], face[2]);
+        }
+    }
+}
+
+/*
+ * Only indices need to be computed, positions & normals
+ * are streamed from OpenMesh arrays to the GPU by fill_vertices_*().
+ */
+void
+MeshObject::pack()
 {
-    size_t nb_vertices = mesh.n_vertices()*3;
-    size_t nb_indices = mesh.n_faces()*3;
+    free_packed();
+
+    packed_indices = new GLuint[mesh.n_faces()*3 + detail_indices.size()];
+    write_faces(packed_indices, 0, mesh.n_faces()*3);
 
-    GLuint* indices = new GLuint[nb_indices];
-    GLfloat* positions = new GLfloat[nb_vertices];
-    GLfloat* normals = new GLfloat[nb_vertices];
-    GLfloat* colors = new GLfloat[nb_vertices];
+    // Levels of detail right after the full mesh
+    if( !detail_indices.empty() )
+        std::memcpy(packed_indices + mesh.n_faces()*3, detail_indices.data(), sizeof(GLuint) * detail_indices.size());
+}
 
-    MyMesh::Normal normal;
-    MyMesh::Point point;
+/* Indices [first, first+count[ from the halfedge mesh, in the optimized order if any (`first` is a multiple of 3). */
+void
+MeshObject::write_faces(GLuint* buffer, size_t first, size_t count) const
+{
     MyMesh::ConstFaceVertexIter cfv_it;
 
-    size_t i = 0;
-    size_t j = 0;
-
-    for(const auto& cv_it: mesh.vertices()){
-        /* const vertex iterator */
-        normal = mesh.normal(cv_it);
-        point = mesh.point(cv_it);
-        for(j=0; j < 3; ++j, ++i){
-            normals[i] = normal[j];
-            positions[i] = point[j];
-            colors[i] = 0.5f;
+    for(size_t i=0; i < count; i+=3){
+        size_t face = (first + i) / 3;
+        if( !face_order.empty() )
+            face = face_order[face];
+
+        /* const face vertex iterator */
+        cfv_it = mesh.cfv_iter(mesh.face_handle(int(face)));
+        for(size_t j=0; j < 3; ++j, ++cfv_it){
+            GLuint v = static_cast<GLuint>(cfv_it->idx());
+            *buffer++ = vertex_remap.empty() ? v : vertex_remap[v];
         }
     }
+}
 
-    i = 0;
-    for(const auto& cf_it: mesh.faces()){
-        /* const face iterator */
-        cfv_it = mesh.cfv_iter(cf_it);
-        for(j=0; j < 3; ++j, ++i, ++cfv_it)
-            indices[i] = static_cast<GLuint>(cfv_it->idx());
+/*
+ * Triangles are reordered for the post-transform cache,
+ * then vertices numbered by first use; the halfedge mesh is left untouched:
+ * every stream to the GPU goes through the new orders.
+ */
+void
+MeshObject::optimize_vertex_cache()
+{
+    TRACE_SCOPE("optimize_vertex_cache");
+    face_order.clear();
+    vertex_order.clear();
+    vertex_remap.clear();
+
+    pack();
+
+    const size_t nb_indices = mesh.n_faces()*3;
+    const size_t nb_vertices = mesh.n_vertices();
+
+    vertex_cache_stats[0] = VertexCache::measure(packed_indices, nb_indices, nb_vertices);
+
+    VertexCache::reorder_triangles(packed_indices, nb_indices, nb_vertices, face_order);
+
+    std::vector<GLuint> reordered(nb_indices);
+    for(size_t t=0; t < face_order.size(); ++t)
+        for(size_t j=0; j < 3; ++j)
+            reordered[3*t+j] = packed_indices[3*face_order[t]+j];
+
+    VertexCache::reorder_vertices(reordered.data(), nb_indices, nb_vertices, vertex_remap);
+
+    vertex_order.resize(nb_vertices);
+    for(size_t v=0; v < nb_vertices; ++v)
+        vertex_order[vertex_remap[v]] = GLuint(v);
+
+    pack();
+
+    vertex_cache_stats[1] = VertexCache::measure(packed_indices, nb_indices, nb_vertices);
+    vertex_cache_optimized = true;
+}
+
+/*
+ * Triangles are regrouped cluster by cluster, starting from the vertex cache order,
+ * vertices keep their numbering. Clusters only need positions, in that numbering.
+ */
+void
+MeshObject::build_meshlets()
+{
+    TRACE_SCOPE("build_meshlets");
+    pack();
+
+    const size_t nb_vertices = mesh.n_vertices();
+    std::vector<GLfloat> positions(3 * nb_vertices);
+    fill_vertices_coordinates(positions.data(), 3, 0, nb_vertices);
+
+    std::vector<uint32_t> order;
+    Meshlets::build(positions.data(), nb_vertices, packed_indices, mesh.n_faces(), order, meshlets);
+
+    // face_order[new] = old face, through both orders.
+    std::vector<GLuint> composed(order.size());
+    for(size_t t=0; t < order.size(); ++t)
+        composed[t] = face_order.empty() ? GLuint(order[t]) : face_order[order[t]];
+    face_order.swap(composed);
+
+    pack();
+
+    if( vertex_cache_optimized )
+        vertex_cache_stats[1] = VertexCache::measure(packed_indices, mesh.n_faces()*3, nb_vertices);
+}
+
+/*
+ * Quadric error decimation of a single copy of the mesh, each level from the previous one.
+ * Levels are not built in parallel on purpose: a copy per thread multiplied the memory,
+ * and decimating each level from the full mesh redid the work of the finer ones.
+ * Collapses only remove vertices, the remaining ones keep their index & position:
+ * every level is a list of faces over the same vertices (hence the same VBO).
+ */
+void
+MeshObject::generate_detail_levels()
+{
+    TRACE_SCOPE("generate_detail_levels");
+    typedef OpenMesh::Decimater::DecimaterT<MyMesh> Decimater;
+    typedef OpenMesh::Decimater::ModQuadricT<MyMesh>::Handle ModQuadric;
+
+    std::vector<size_t> targets;
+    for(size_t faces = mesh.n_faces() / 4;
+        faces >= min_detail_faces && targets.size() + 1 < MeshCache::max_detail_levels;
+        faces /= 4)
+        targets.push_back(faces);
+
+    detail_indices.clear();
+    detail_elements.clear();
+    if( targets.empty() )
+        return;
+
+    std::vector<std::vector<GLuint>> levels(targets.size());
+
+    // A single copy, each level goes on from the previous one: the whole work is
+    // about the same as decimating once down to the coarsest level.
+    MyMesh copy(mesh);
+    copy.request_vertex_status();
+    copy.request_edge_status();
+    copy.request_face_status();
+
+    Decimater decimater(copy);
+    ModQuadric quadric;
+    decimater.add(quadric);
+    decimater.module(quadric).unset_max_err();
+    decimater.initialize();
+
+    for(size_t l=0; l < targets.size(); ++l){
+        decimater.decimate_to_faces(0, targets[l]);
+
+        std::vector<GLuint>& indices = levels[l];
+        indices.reserve(3 * targets[l]);
+        for(const auto& fh: copy.faces()){
+            if( copy.status(fh).deleted() )
+                continue;
+
+            for(const auto& vh: copy.fv_range(fh)){
+                GLuint v = GLuint(vh.idx());
+                indices.push_back(vertex_remap.empty() ? v : vertex_remap[v]);
+            }
+        }
+
+        // Same treatment as the full mesh for the post-transform cache.
+        if( vertex_cache_optimization ){
+            std::vector<uint32_t> order;
+            VertexCache::reorder_triangles(indices.data(), indices.size(), mesh.n_vertices(), order);
+
+            std::vector<GLuint> reordered(indices.size());
+            for(size_t t=0; t < order.size(); ++t)
+                for(size_t j=0; j < 3; ++j)
+                    reordered[3*t + j] = indices[3*size_t(order[t]) + j];
+            indices.swap(reordered);
+        }
+    }
+
+    // Levels the decimater could not really simplify are left aside.
+    detail_elements.push_back(mesh.n_faces()*3);
+    for(const std::vector<GLuint>& indices: levels){
+        if( indices.empty() || float(indices.size()) > (1.0f - min_detail_reduction) * float(detail_elements.back()) )
+            continue;
+
+        detail_elements.push_back(indices.size());
+        detail_indices.insert(detail_indices.end(), indices.begin(), indices.end());
+    }
+
+    if( detail_elements.size() < 2 ){
+        detail_elements.clear();
+        return;
     }
 
+    pack();
+}
+
+void
+MeshObject::free_packed()
+{
+    delete [] packed_indices;
+    packed_indices = nullptr;
+}
+
+bool
+MeshObject::build(QOpenGLShaderProgram* program)
+{
+    TRACE_SCOPE("MeshObject::build");
+
+    if( cache->is_open() ){
+        set_vertices_geometry(program->attributeLocation("position"), cache->positions(), cache->indices(), cache);
+        set_vertices_colors(program->attributeLocation("color"), nullptr);
+        set_vertices_normals(program->attributeLocation("normal"), cache->normals(), cache);
+
+        if( !initialize(_nb_vertices, cache->nb_indices(), 3) )
+            return false;
+
+        if( !detail_elements.empty() && !set_detail_levels(detail_elements) )
+            return false;
+
+        build_occlusion(program);
+        return true;
+    }
+
+    // load() was given no chance to prepare the indices (or build() is called twice)
+    if( packed_indices == nullptr )
+        pack();
+
     /*
     for(const auto& cf_it: mesh.faces()){
         MyMesh::Normal n = mesh.normal(cf_it);
@@ -81,60 +500,409 @@ MeshObject::build(QOpenGLShaderProgram* program)
         }
     }*/
 
-    set_vertices_geometry(program->attributeLocation("position"), positions, indices);
-    set_vertices_colors(program->attributeLocation("color"), colors);
-    set_vertices_normals(program->attributeLocation("normal"), normals);
+    // Ownership of the indices goes to DrawableObject,
+    // positions, colors & normals are streamed at upload time.
+    set_vertices_geometry(program->attributeLocation("position"), nullptr, packed_indices);
+    set_vertices_colors(program->attributeLocation("color"), nullptr);
+    set_vertices_normals(program->attributeLocation("normal"), nullptr);
+
+    packed_indices = nullptr;
+
+    if( !initialize(mesh.n_vertices(), mesh.n_faces()*3 + detail_indices.size(), 3) )
+        return false;
 
-    return initialize(mesh.n_vertices(), nb_indices, 3);
+    if( !detail_elements.empty() && !set_detail_levels(detail_elements) )
+        return false;
+
+    build_occlusion(program);
+    return true;
 }
 
+/* Queries are optional: without them (or clusters), nothing is ever occluded. */
 void
-MeshObject::normalize()
+MeshObject::build_occlusion(QOpenGLShaderProgram* program)
 {
-    float min_x, min_y, min_z;
-    float max_x, max_y, max_z;
-    float scale;
+    if( !meshlets.empty() && !occlusion->build(meshlets, program) )
+        std::cerr << "Occlusion queries unavailable, occlusion culling disabled." << std::endl;
+}
 
-    min_x = min_y = min_z = std::numeric_limits<float>::max();
-    max_x = max_y = max_z = std::numeric_limits<float>::min();
+void
+MeshObject::fill_vertices_coordinates(GLfloat* buffer, size_t stride, size_t first, size_t count) const
+{
+    if( get_vertices_coordinates() != nullptr )
+        DrawableObject::fill_vertices_coordinates(buffer, stride, first, count);
+    else
+    if( vertex_order.empty() )
+        copy_vertices(buffer, stride, reinterpret_cast<const GLfloat*>(mesh.points() + first), count, 3);
+    else
+        gather_vertices(buffer, stride, reinterpret_cast<const GLfloat*>(mesh.points()), vertex_order.data() + first, count, 3);
+}
 
-    MyMesh::Point p;
-    for(const auto& v_it: mesh.vertices()){
-        p = mesh.point(v_it);
+void
+MeshObject::fill_vertices_normals(GLfloat* buffer, size_t stride, size_t first, size_t count) const
+{
+    if( get_vertices_normals() != nullptr )
+        DrawableObject::fill_vertices_normals(buffer, stride, first, count);
+    else
+    if( vertex_order.empty() )
+        copy_vertices(buffer, stride, reinterpret_cast<const GLfloat*>(mesh.vertex_normals() + first), count, 3);
+    else
+        gather_vertices(buffer, stride, reinterpret_cast<const GLfloat*>(mesh.vertex_normals()), vertex_order.data() + first, count, 3);
+}
 
-        min_x = std::min(min_x, p[0]);
-        min_y = std::min(min_y, p[1]);
-        min_z = std::min(min_z, p[2]);
+void
+MeshObject::fill_vertices_indices(GLuint* buffer, size_t first, size_t count) const
+{
+    if( get_vertices_indices() != nullptr ){
+        DrawableObject::fill_vertices_indices(buffer, first, count);
+        return;
+    }
 
-        max_x = std::max(max_x, p[0]);
-        max_y = std::max(max_y, p[1]);
-        max_z = std::max(max_z, p[2]);
+    // Released by render-only mode, the halfedge mesh still knows them (and levels of detail are kept aside).
+    const size_t full = mesh.n_faces()*3;
+    if( first < full ){
+        size_t n = std::min(count, full - first);
+        write_faces(buffer, first, n);
+        buffer += n;
+        first += n;
+        count -= n;
     }
 
-    MyMesh::Point pos(min_x+max_x, min_y+max_y, min_z+max_z);
-    pos *= 0.5f;
+    if( count > 0 )
+        std::memcpy(buffer, detail_indices.data() + (first - full), sizeof(GLuint) * count);
+}
+
+static const GLfloat default_gray[3] = { 0.5f, 0.5f, 0.5f };
+
+/* Default gray, unless use_unique_color() was called. */
+void
+MeshObject::fill_vertices_colors(GLfloat* buffer, size_t stride, size_t first, size_t count) const
+{
+    if( get_vertices_colors() != nullptr )
+        DrawableObject::fill_vertices_colors(buffer, stride, first, count);
+    else
+        fill_vertices(buffer, stride, default_gray, count, 3);
+}
 
-    MyMesh::Point size = MyMesh::Point(0.0f, 0.0f, 0.0f);
-    MyMesh::Point bboxmin(min_x, min_y, min_z);
-    MyMesh::Point bboxmax(max_x, max_y, max_z);
+bool
+MeshObject::uniform_colors(GLfloat* color) const
+{
+    if( get_vertices_colors() != nullptr )
+        return DrawableObject::uniform_colors(color);
 
     for(size_t i=0; i < 3; ++i)
-        size[i] = std::fabs(bboxmax[i] - bboxmin[i]);
+        color[i] = default_gray[i];
+    return true;
+}
 
-    if( size[0] > size[1] ){
-        if( size[0] > size[2] )
-            scale = 1.0f / size[0];
-        else
-            scale = 1.0f / size[2];
+/* No need to go through the vertices again, it is known since reading. */
+void
+MeshObject::bounding_box(GLfloat* min, GLfloat* max) const
+{
+    if( bbox.is_empty() || get_vertices_coordinates() != nullptr ){
+        DrawableObject::bounding_box(min, max);
+        return;
+    }
+
+    for(size_t i=0; i < 3; ++i){
+        min[i] = bbox.min[i];
+        max[i] = bbox.max[i];
+    }
+}
+
+void
+MeshObject::set_drop_halfedge_mesh(bool on)
+{
+    drop_halfedge_mesh = on;
+}
+
+void
+MeshObject::set_vertex_cache_optimization(bool on)
+{
+    vertex_cache_optimization = on;
+}
+
+void
+MeshObject::set_normal_weighting(NormalWeighting weighting)
+{
+    normal_weighting = weighting;
+}
+
+void
+MeshObject::set_model_normalization(bool on)
+{
+    model_normalization = on;
+}
+
+void
+MeshObject::set_detail_levels_generation(bool on)
+{
+    detail_levels_generation = on;
+}
+
+void
+MeshObject::set_meshlets_generation(bool on)
+{
+    meshlets_generation = on;
+}
+
+void
+MeshObject::set_cluster_culling(bool on)
+{
+    cluster_culling = on;
+}
+
+void
+MeshObject::set_occlusion_culling(bool on)
+{
+    occlusion_culling = on;
+}
+
+void
+MeshObject::select_detail_level(const QMatrix4x4& projection, const QMatrix4x4& view, int viewport_height)
+{
+    if( bbox.is_empty() )
+        return;
+
+    if( nb_instances() > 0 ){
+        select_instance_levels(projection, view, viewport_height);
+        return;
+    }
+
+    if( nb_detail_levels() < 2 )
+        return;
+
+    set_detail_level(detail_level_for(view * model_matrix(), projection, viewport_height, nullptr));
+}
+
+/*
+ * Level of the bounding sphere seen through `model_view`.
+ * With eye space `planes`: nb_detail_levels() when outside the frustum.
+ */
+size_t
+MeshObject::detail_level_for(const QMatrix4x4& model_view, const QMatrix4x4& projection, int viewport_height, const float (*planes)[4]) const
+{
+    // Bounding sphere, into eye space.
+    float center[3];
+    bbox.center(center);
+    float radius = 0.5f * QVector3D(bbox.max[0] - bbox.min[0], bbox.max[1] - bbox.min[1], bbox.max[2] - bbox.min[2]).length();
+
+    QVector3D eye = model_view.map(QVector3D(center[0], center[1], center[2]));
+
+    float scale = 0.0f;
+    for(int i=0; i < 3; ++i)
+        scale = std::max(scale, model_view.column(i).toVector3D().length());
+    radius *= scale;
+
+    if( planes != nullptr )
+        for(size_t p=0; p < 6; ++p)
+            if( planes[p][0] * eye.x() + planes[p][1] * eye.y() + planes[p][2] * eye.z() + planes[p][3] < -radius )
+                return nb_detail_levels();
+
+    float distance = -eye.z();
+    if( distance <= radius )
+        return 0;
+
+    // projection(1,1) = 1 / tan(fov/2)
+    float pixels = radius / distance * projection(1, 1) * 0.5f * float(viewport_height);
+    float budget = float(M_PI) * pixels * pixels * triangles_per_pixel;
+
+    size_t level = 0;
+    while( level+1 < nb_detail_levels() && float(detail_level_elements(level+1) / 3) >= budget )
+        ++level;
+
+    return level;
+}
+
+/*
+ * Each instance gets its own level, or is culled when out of the frustum.
+ * The current level becomes the finest one in use: show() never draws finer than it.
+ */
+void
+MeshObject::select_instance_levels(const QMatrix4x4& projection, const QMatrix4x4& view, int viewport_height)
+{
+    // Eye space frustum
+    float planes[6][4];
+    Meshlets::frustum_planes(projection.constData(), planes);
+
+    std::vector<size_t> levels(nb_instances());
+    size_t finest = nb_detail_levels() - 1;
+
+    for(size_t i=0; i < levels.size(); ++i){
+        // Column-major, QMatrix4x4(const float*) reads rows.
+        QMatrix4x4 transform = QMatrix4x4(instance_transform(i)).transposed();
+
+        levels[i] = detail_level_for(view * transform * model_matrix(), projection, viewport_height, planes);
+        if( levels[i] < nb_detail_levels() )
+            finest = std::min(finest, levels[i]);
+    }
+
+    set_detail_level(finest);
+    set_instance_levels(levels);
+}
+
+/*
+ * Surviving clusters are merged into ranges when consecutive into the EBO,
+ * nothing is culled at all: the whole level is drawn as usual.
+ */
+void
+MeshObject::cull_clusters(const QMatrix4x4& projection, const QMatrix4x4& view, bool back_faces)
+{
+    culling = CullingStats{ 0, 0, 0, 0, 0, 0 };
+
+    const bool occlusion_on = occlusion_culling && occlusion->is_built();
+    if( (!cluster_culling && !occlusion_on) || meshlets.empty() || current_detail_level() != 0 || nb_instances() > 0 ){
+        // Frames drawn meanwhile did not tell what is still hidden.
+        if( occlusion->is_built() )
+            occlusion->reset();
+
+        clear_visible_ranges();
+        return;
     }
-    else {
-        if( size[1] > size[2] )
-            scale = 1.0f / size[1];
+
+    // Both tests are done into object space.
+    QMatrix4x4 model_view = view * model_matrix();
+    QMatrix4x4 clip = projection * model_view;
+    QVector3D camera = model_view.inverted().map(QVector3D(0.0f, 0.0f, 0.0f));
+    const float eye[3] = { camera.x(), camera.y(), camera.z() };
+
+    float planes[6][4];
+    Meshlets::frustum_planes(clip.constData(), planes);
+
+    if( occlusion_on )
+        occlusion->update(planes);
+
+    visible_ranges.clear();
+    culling.clusters = meshlets.size();
+
+    for(size_t m=0; m < meshlets.size(); ++m){
+        const Meshlet& meshlet = meshlets[m];
+
+        if( cluster_culling && Meshlets::outside_frustum(meshlet, planes) ){
+            ++culling.frustum_culled;
+            continue;
+        }
+
+        if( cluster_culling && back_faces && Meshlets::back_facing(meshlet, eye) ){
+            ++culling.backface_culled;
+            continue;
+        }
+
+        if( occlusion_on && occlusion->is_occluded(m) ){
+            ++culling.occlusion_culled;
+            continue;
+        }
+
+        culling.triangles += meshlet.count / 3;
+        if( !visible_ranges.empty() && visible_ranges.back().first + visible_ranges.back().count == meshlet.first )
+            visible_ranges.back().count += meshlet.count;
         else
-            scale = 1.0f / size[2];
+            visible_ranges.push_back(ElementRange{ meshlet.first, meshlet.count });
+    }
+
+    culling.draws = visible_ranges.size();
+
+    if( culling.frustum_culled + culling.backface_culled + culling.occlusion_culled == 0 )
+        clear_visible_ranges();
+    else
+        set_visible_ranges(visible_ranges);
+}
+
+/* Boxes are placed by the model matrix only: clusters bounds come from float positions. */
+void
+MeshObject::query_occlusion(QOpenGLShaderProgram* program)
+{
+    if( occlusion_culling && occlusion->is_built() && current_detail_level() == 0 && nb_instances() == 0 )
+        occlusion->query(program, model_matrix());
+}
+
+bool
+MeshObject::has_cpu_geometry() const
+{
+    return DrawableObject::has_cpu_geometry() || mesh.n_vertices() > 0;
+}
+
+void
+MeshObject::release_cpu_data()
+{
+    DrawableObject::release_cpu_data();
+    free_packed();
+
+    // Ours is not needed anymore, copies keep the mapping alive.
+    cache = std::make_shared<MeshCache>();
+
+    if( drop_halfedge_mesh ){
+        mesh.clear();
+        std::vector<GLuint>().swap(face_order);
+        std::vector<GLuint>().swap(vertex_order);
+        std::vector<GLuint>().swap(vertex_remap);
+        std::vector<GLuint>().swap(detail_indices);
+    }
+}
+
+/* Estimation: raw arrays + halfedge structure (handles & properties) + mapped cache. */
+size_t
+MeshObject::cpu_memory() const
+{
+    const size_t handle = sizeof(int);
+    size_t bytes = DrawableObject::cpu_memory();
+
+    if( packed_indices != nullptr )
+        bytes += sizeof(GLuint) * (3 * mesh.n_faces() + detail_indices.size());
+
+    bytes += mesh.n_vertices() * (handle + sizeof(MyMesh::Point) + sizeof(MyMesh::Normal));
+    bytes += mesh.n_halfedges() * 4 * handle; // face, vertex, next & previous halfedges
+    bytes += mesh.n_faces() * (handle + sizeof(MyMesh::Normal));
+
+    bytes += sizeof(GLuint) * (face_order.capacity() + vertex_order.capacity() + vertex_remap.capacity());
+    bytes += sizeof(GLuint) * detail_indices.capacity();
+    bytes += sizeof(Meshlet) * meshlets.capacity();
+
+    if( cache->is_open() )
+        bytes += cache->mapped_bytes();
+
+    return bytes;
+}
+
+/*
+ * Into the unit box, centered on the origin.
+ * The box comes from the reader (computed while parsing) or from one parallel pass;
+ * then either every point is rewritten, or the model matrix does it at draw time.
+ */
+void
+MeshObject::normalize()
+{
+    float* points = reinterpret_cast<float*>(mesh.property(mesh.points_pph()).data_vector().data());
+
+    if( bbox.is_empty() )
+        bbox = BoundingBox::of(points, mesh.n_vertices());
+
+    if( model_normalization ){
+        normalize_model();
+        return;
     }
 
-    for(auto& v_it: mesh.vertices()){
-        mesh.point(v_it) = (mesh.point(v_it) - pos)*scale;
+    bbox.normalize(points, mesh.n_vertices());
+
+    float center[3];
+    float scale = bbox.normalization_scale();
+    bbox.center(center);
+
+    for(size_t i=0; i < 3; ++i){
+        bbox.min[i] = (bbox.min[i] - center[i])*scale;
+        bbox.max[i] = (bbox.max[i] - center[i])*scale;
     }
 }
+
+/* Positions stay as they are: model = scale * translate(-center). */
+void
+MeshObject::normalize_model()
+{
+    float center[3];
+    float scale = bbox.normalization_scale();
+    bbox.center(center);
+
+    reset_model_matrix();
+    DrawableObject::scale(scale, scale, scale);
+    translate(-center[0], -center[1], -center[2]);
+}
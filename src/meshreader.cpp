@@ -0,0 +1,465 @@
+#include "../include/meshreader.h"
+#include "../include/mappedfile.h"
+#include "../include/parallel.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+#include <thread>
+
+/* Part of the file handled by one thread, always starts at the beginning of a line. */
+struct Chunk {
+    const char* first;
+    const char* last;
+};
+
+/* Under this size, a chunk is not worth a thread. */
+static const size_t min_chunk_size = 1 << 20;
+
+static std::vector<Chunk>
+split_lines(const char* first, const char* last, unsigned int nb_chunks)
+{
+    size_t length = size_t(last - first);
+    nb_chunks = unsigned(std::max<size_t>(1, std::min<size_t>(nb_chunks, length / min_chunk_size)));
+
+    std::vector<Chunk> chunks;
+    const char* begin = first;
+
+    for(unsigned int i=1; i < nb_chunks; ++i){
+        const char* end = std::max(begin, first + (length / nb_chunks) * i);
+        end = static_cast<const char*>(std::memchr(end, '\n', size_t(last - end)));
+        end = (end == nullptr) ? last : end+1;
+
+        chunks.push_back({begin, end});
+        begin = end;
+    }
+
+    chunks.push_back({begin, last});
+    return chunks;
+}
+
+static inline bool
+is_blank(char c)
+{
+    return c == ' ' || c == '\t' || c == '\r';
+}
+
+static inline const char*
+skip_blanks(const char* p, const char* last)
+{
+    while( p < last && is_blank(*p) )
+        ++p;
+    return p;
+}
+
+static inline const char*
+skip_token(const char* p, const char* last)
+{
+    while( p < last && !is_blank(*p) && *p != '\n' )
+        ++p;
+    return p;
+}
+
+static inline const char*
+end_of_line(const char* p, const char* last)
+{
+    const char* eol = static_cast<const char*>(std::memchr(p, '\n', size_t(last - p)));
+    return (eol == nullptr) ? last : eol;
+}
+
+/* A line holding something else than blanks or a comment. */
+static inline bool
+is_data_line(const char* p, const char* eol)
+{
+    p = skip_blanks(p, eol);
+    return p < eol && *p != '#';
+}
+
+/* Parse `n` blank separated floats. */
+static inline const char*
+parse_floats(const char* p, const char* last, float* values, size_t n)
+{
+    for(size_t i=0; i < n && p != nullptr; ++i)
+        p = MeshReader::parse_float(skip_blanks(p, last), last, values[i]);
+    return p;
+}
+
+/* Fan triangulation of a polygon. */
+static inline void
+triangulate(const std::vector<unsigned int>& polygon, std::vector<unsigned int>& triangles)
+{
+    for(size_t k=1; k+1 < polygon.size(); ++k){
+        triangles.push_back(polygon[0]);
+        triangles.push_back(polygon[k]);
+        triangles.push_back(polygon[k+1]);
+    }
+}
+
+/* Concatenate per chunk triangles into the final index buffer. */
+static void
+merge(const std::vector<std::vector<unsigned int>>& triangles, std::vector<unsigned int>& indices)
+{
+    size_t total = 0;
+    for(const auto& t: triangles)
+        total += t.size();
+
+    indices.resize(total);
+
+    size_t offset = 0;
+    for(const auto& t: triangles){
+        if( !t.empty() )
+            std::memcpy(&indices[offset], t.data(), t.size() * sizeof(unsigned int));
+        offset += t.size();
+    }
+}
+
+static std::string
+lower_extension(const std::string& path)
+{
+    size_t pos = path.find_last_of('.');
+    if( pos == std::string::npos )
+        return "";
+
+    std::string ext = path.substr(pos+1);
+    std::transform(ext.begin(), ext.end(), ext.begin(), ::tolower);
+    return ext;
+}
+
+bool
+MeshReader::can_read(const std::string& path)
+{
+    std::string ext = lower_extension(path);
+    return ext == "obj" || ext == "off";
+}
+
+bool
+MeshReader::read(const std::string& path, RawMesh& mesh, unsigned int nb_threads)
+{
+    if( !can_read(path) )
+        return false;
+
+    MappedFile file;
+    if( !file.open(path) )
+        return false;
+
+    if( nb_threads == 0 )
+        nb_threads = std::max(1u, std::thread::hardware_concurrency());
+
+    const char* first = file.data();
+    const char* last = first + file.size();
+
+    mesh.positions.clear();
+    mesh.indices.clear();
+    mesh.bbox = BoundingBox();
+
+    if( lower_extension(path) == "obj" )
+        return read_obj(first, last, mesh, nb_threads);
+
+    return read_off(first, last, mesh, nb_threads);
+}
+
+/*
+ * Decimal floats as written by mesh exporters: [+-]digits[.digits][(e|E)[+-]digits]
+ * Much faster than strtof(), which also depends on the current locale.
+ */
+const char*
+MeshReader::parse_float(const char* p, const char* last, float& value)
+{
+    static const double powers[] = {
+        1e0,  1e1,  1e2,  1e3,  1e4,  1e5,  1e6,  1e7,
+        1e8,  1e9,  1e10, 1e11, 1e12, 1e13, 1e14, 1e15,
+        1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+    };
+
+    bool negative = false;
+    if( p < last && (*p == '-' || *p == '+') ){
+        negative = (*p == '-');
+        ++p;
+    }
+
+    uint64_t mantissa = 0;
+    int exponent = 0;
+    bool digits = false;
+
+    // Only the 18 first significant digits matter for a float.
+    for(; p < last && *p >= '0' && *p <= '9'; ++p, digits = true){
+        if( mantissa < 100000000000000000ull )
+            mantissa = mantissa*10 + uint64_t(*p - '0');
+        else
+            ++exponent;
+    }
+
+    if( p < last && *p == '.' ){
+        for(++p; p < last && *p >= '0' && *p <= '9'; ++p, digits = true){
+            if( mantissa < 100000000000000000ull ){
+                mantissa = mantissa*10 + uint64_t(*p - '0');
+                --exponent;
+            }
+        }
+    }
+
+    if( !digits )
+        return nullptr;
+
+    if( p < last && (*p == 'e' || *p == 'E') ){
+        long e = 0;
+        const char* q = parse_int(p+1, last, e);
+        if( q == nullptr )
+            return nullptr;
+        exponent += int(std::max(-400l, std::min(400l, e)));
+        p = q;
+    }
+
+    double result = double(mantissa);
+    if( exponent < 0 ){
+        result = (exponent >= -22) ? result / powers[-exponent] : result * std::pow(10.0, exponent);
+    }
+    else if( exponent > 0 ){
+        result = (exponent <= 22) ? result * powers[exponent] : result * std::pow(10.0, exponent);
+    }
+
+    value = float(negative ? -result : result);
+    return p;
+}
+
+const char*
+MeshReader::parse_int(const char* p, const char* last, long& value)
+{
+    bool negative = false;
+    if( p < last && (*p == '-' || *p == '+') ){
+        negative = (*p == '-');
+        ++p;
+    }
+
+    const char* digits = p;
+    long result = 0;
+    for(; p < last && *p >= '0' && *p <= '9'; ++p){
+        if( result < 100000000000000l ) // garbage anyway, but never overflow
+            result = result*10 + (*p - '0');
+    }
+
+    if( p == digits )
+        return nullptr;
+
+    value = negative ? -result : result;
+    return p;
+}
+
+/*
+ * OBJ: "v x y z" and "f a b c ..." where every corner is "v", "v/t", "v//n" or "v/t/n".
+ * Indices start at 1 and negative ones are relative to the last vertex read.
+ *
+ * First pass counts vertices per chunk, so that every chunk knows the index of its
+ * first vertex, the second one parses everything in place.
+ */
+bool
+MeshReader::read_obj(const char* first, const char* last, RawMesh& mesh, unsigned int nb_threads)
+{
+    std::vector<Chunk> chunks = split_lines(first, last, nb_threads);
+    size_t nb_chunks = chunks.size();
+
+    std::vector<size_t> vertices(nb_chunks+1, 0);
+    parallel_for(nb_chunks, [&](size_t c){
+        size_t count = 0;
+        for(const char* p = chunks[c].first; p < chunks[c].last; ){
+            const char* eol = end_of_line(p, chunks[c].last);
+            p = skip_blanks(p, eol);
+            if( eol - p > 1 && p[0] == 'v' && is_blank(p[1]) )
+                ++count;
+            p = eol+1;
+        }
+        vertices[c+1] = count;
+    });
+
+    // vertices[c] becomes the index of the first vertex of chunk c
+    for(size_t c=0; c < nb_chunks; ++c)
+        vertices[c+1] += vertices[c];
+
+    const long nb_vertices = long(vertices[nb_chunks]);
+    mesh.positions.resize(size_t(nb_vertices)*3);
+
+    std::vector<std::vector<unsigned int>> triangles(nb_chunks);
+    std::vector<BoundingBox> boxes(nb_chunks);
+    std::vector<char> failed(nb_chunks, 0);
+
+    parallel_for(nb_chunks, [&](size_t c){
+        std::vector<unsigned int> polygon;
+        float* out = mesh.positions.data() + vertices[c]*3;
+        long current = long(vertices[c]); // vertices read so far
+
+        for(const char* p = chunks[c].first; p < chunks[c].last; ){
+            const char* eol = end_of_line(p, chunks[c].last);
+            p = skip_blanks(p, eol);
+
+            if( eol - p > 1 && p[0] == 'v' && is_blank(p[1]) ){
+                if( parse_floats(p+2, eol, out, 3) == nullptr ){
+                    failed[c] = 1;
+                    return;
+                }
+                boxes[c].extend(out);
+                out += 3;
+                ++current;
+            }
+            else
+            if( eol - p > 1 && p[0] == 'f' && is_blank(p[1]) ){
+                polygon.clear();
+                for(p = skip_blanks(p+2, eol); p < eol; p = skip_blanks(p, eol)){
+                    long index = 0;
+                    p = parse_int(p, eol, index);
+                    if( p == nullptr || index == 0 ){
+                        failed[c] = 1;
+                        return;
+                    }
+
+                    index = (index > 0) ? index-1 : current+index;
+                    if( index < 0 || index >= nb_vertices ){
+                        failed[c] = 1;
+                        return;
+                    }
+
+                    polygon.push_back(unsigned(index));
+                    p = skip_token(p, eol); // texture & normal indices
+                }
+                triangulate(polygon, triangles[c]);
+            }
+
+            p = eol+1;
+        }
+    });
+
+    if( std::find(failed.begin(), failed.end(), 1) != failed.end() )
+        return false;
+
+    for(const BoundingBox& box: boxes)
+        mesh.bbox.extend(box);
+
+    merge(triangles, mesh.indices);
+    return nb_vertices > 0;
+}
+
+/*
+ * OFF: a header ("OFF", "COFF", "NOFF" or "CNOFF"), then "nv nf ne",
+ * then nv vertex lines and nf face lines "n i0 i1 ... [color]".
+ *
+ * The kind of a line only depends on its rank among data lines,
+ * so the first pass counts data lines per chunk.
+ */
+bool
+MeshReader::read_off(const char* first, const char* last, RawMesh& mesh, unsigned int nb_threads)
+{
+    const char* p = first;
+    const char* eol = first;
+
+    // Header keyword
+    while( p < last && !is_data_line(p, eol = end_of_line(p, last)) )
+        p = eol+1;
+
+    p = skip_blanks(p, eol);
+    const char* keyword = p;
+    p = skip_token(p, eol);
+
+    std::string header(keyword, p);
+    if( header != "OFF" && header != "COFF" && header != "NOFF" && header != "CNOFF" )
+        return false;
+
+    if( std::string(p, eol).find("BINARY") != std::string::npos )
+        return false;
+
+    // Counts, either on the keyword line or on the next data line.
+    p = skip_blanks(p, eol);
+    if( p == eol || *p == '#' ){
+        for(p = eol+1; p < last && !is_data_line(p, eol = end_of_line(p, last)); )
+            p = eol+1;
+    }
+
+    long nb_vertices = 0;
+    long nb_faces = 0;
+    p = parse_int(skip_blanks(p, eol), eol, nb_vertices);
+    if( p != nullptr )
+        p = parse_int(skip_blanks(p, eol), eol, nb_faces);
+
+    if( p == nullptr || nb_vertices <= 0 || nb_faces < 0 )
+        return false;
+
+    const char* body = std::min(eol+1, last);
+    std::vector<Chunk> chunks = split_lines(body, last, nb_threads);
+    size_t nb_chunks = chunks.size();
+
+    std::vector<long> lines(nb_chunks+1, 0);
+    parallel_for(nb_chunks, [&](size_t c){
+        long count = 0;
+        for(const char* q = chunks[c].first; q < chunks[c].last; ){
+            const char* end = end_of_line(q, chunks[c].last);
+            if( is_data_line(q, end) )
+                ++count;
+            q = end+1;
+        }
+        lines[c+1] = count;
+    });
+
+    for(size_t c=0; c < nb_chunks; ++c)
+        lines[c+1] += lines[c];
+
+    // Truncated file
+    if( lines[nb_chunks] < nb_vertices + nb_faces )
+        return false;
+
+    mesh.positions.resize(size_t(nb_vertices)*3);
+
+    std::vector<std::vector<unsigned int>> triangles(nb_chunks);
+    std::vector<BoundingBox> boxes(nb_chunks);
+    std::vector<char> failed(nb_chunks, 0);
+
+    parallel_for(nb_chunks, [&](size_t c){
+        std::vector<unsigned int> polygon;
+        long line = lines[c];
+
+        for(const char* q = chunks[c].first; q < chunks[c].last && line < nb_vertices + nb_faces; ){
+            const char* end = end_of_line(q, chunks[c].last);
+
+            if( is_data_line(q, end) ){
+                if( line < nb_vertices ){
+                    if( parse_floats(q, end, &mesh.positions[size_t(line)*3], 3) == nullptr ){
+                        failed[c] = 1;
+                        return;
+                    }
+                    boxes[c].extend(&mesh.positions[size_t(line)*3]);
+                }
+                else {
+                    long n = 0;
+                    q = parse_int(skip_blanks(q, end), end, n);
+                    if( q == nullptr || n < 0 ){
+                        failed[c] = 1;
+                        return;
+                    }
+
+                    polygon.clear();
+                    for(long k=0; k < n; ++k){
+                        long index = 0;
+                        q = parse_int(skip_blanks(q, end), end, index);
+                        if( q == nullptr || index < 0 || index >= nb_vertices ){
+                            failed[c] = 1;
+                            return;
+                        }
+                        polygon.push_back(unsigned(index));
+                    }
+                    triangulate(polygon, triangles[c]);
+                }
+                ++line;
+            }
+
+            q = end+1;
+        }
+    });
+
+    if( std::find(failed.begin(), failed.end(), 1) != failed.end() )
+        return false;
+
+    for(const BoundingBox& box: boxes)
+        mesh.bbox.extend(box);
+
+    merge(triangles, mesh.indices);
+    return true;
+}
@@ -1,9 +1,11 @@
+#include <algorithm>
+#include <cmath>
 #include <iostream>
-#include <thread>
 #include <future>
 
 #include "../include/meshviewerwidget.h"
 #include "../include/mainwindow.h"
+#include "../include/trace.h"
 
 MeshViewerWidget::MeshViewerWidget(QWidget* parent)
     :QOpenGLWidget(parent)
@@ -17,16 +19,61 @@ MeshViewerWidget::MeshViewerWidget(QWidget* parent)
     fill_on = true;
     smooth_on = true;
     axis_on = true;
+    back_faces_on = true;
+
+    render_only_on = false;
+    drop_halfedges_on = false;
+    vertex_cache_on = true;
+    normal_weighting = NormalWeighting::Uniform;
+    model_normalization_on = false;
+    detail_levels_on = true;
+    cluster_culling_on = true;
+    occlusion_culling_on = false;
+    nb_instances = 1;
+
+    interactive_lod_on = true;
+    progressive_refine_on = true;
+    interacting = false;
+    interaction_hold = 300;
+    target_frame_time = 25000;
+    proxy_level = 0;
+    last_interaction = Clock::now();
+
+    frame_start = Clock::now();
+    frame_triangles = 0;
+    frame_cost = 0.0f;
+    profiler = nullptr;
+
+#ifdef GL_STATS
+    hud = new QLabel(this);
+    hud->setStyleSheet("background-color: rgba(0, 0, 0, 160); color: white; padding: 4px;");
+    hud->setAttribute(Qt::WA_TransparentForMouseEvents);
+    hud->move(8, 8);
+    hud->hide();
+#endif
+
+    vertex_layout = VertexLayout::Planar;
+    vertex_format = VertexFormat();
 
     frames = 0;
     lap = Clock::now();
 
+    frame_timer = new QTimer(this);
+    frame_timer->setSingleShot(true);
+    frame_timer->setTimerType(Qt::PreciseTimer);
+    connect(frame_timer, &QTimer::timeout, this, [=](){ update(); });
+    connect(this, &QOpenGLWidget::frameSwapped, this, &MeshViewerWidget::frame_swapped);
+
+    renderer = nullptr;
     program = nullptr;
+    camera_dirty = true;
 
     arcball = nullptr;
-    light = nullptr;
     axis = nullptr;
     mesh = nullptr;
+    scene = nullptr;
+    loader = nullptr;
+    loading_into_scene = false;
 }
 
 /*
@@ -37,22 +84,31 @@ MeshViewerWidget::MeshViewerWidget(QWidget* parent)
 */
 MeshViewerWidget::~MeshViewerWidget()
 {
+    // Stop background loading, the loader (child object) waits for its thread.
+    if( loader != nullptr ){
+        disconnect(loader, nullptr, this, nullptr);
+        loader->cancel();
+    }
+
+    // GL objects go away with the context current.
+    makeCurrent();
+
+    if( profiler != nullptr ){
+        delete profiler;
+        profiler = nullptr;
+    }
+
     if( arcball == nullptr ){
         delete arcball;
         arcball = nullptr;
     }
 
-    if( program != nullptr ){
-        program->removeAllShaders();
-        delete program;
+    if( renderer != nullptr ){
+        delete renderer;
+        renderer = nullptr;
         program = nullptr;
     }
 
-    if( light != nullptr ){
-        delete light;
-        light = nullptr;
-    }
-
     if( axis != nullptr ){
         delete axis;
         axis = nullptr;
@@ -62,6 +118,13 @@ MeshViewerWidget::~MeshViewerWidget()
         delete mesh;
         mesh = nullptr;
     }
+
+    if( scene != nullptr ){
+        delete scene;
+        scene = nullptr;
+    }
+
+    doneCurrent();
 }
 
 /* Update the view matrix
@@ -74,6 +137,7 @@ MeshViewerWidget::update_view()
     view.setToIdentity();
     view.translate(position);
     view *= rotation;
+    camera_dirty = true;
 }
 
 /* Update the projection matrix
@@ -88,6 +152,7 @@ MeshViewerWidget::update_projection()
         window_ratio,
         zNear, zFar
     );
+    camera_dirty = true;
 }
 
 /* Load default values for the view matrix + update */
@@ -129,6 +194,8 @@ MeshViewerWidget::default_ModelViewPosition()
 void
 MeshViewerWidget::initializeGL()
 {
+    TRACE_SCOPE("initializeGL");
+
     // Check if OpenGL context was successfully initialized
     if( !isValid() ){
         std::cerr << "Failed to init OpenGL context" << std::endl;
@@ -139,20 +206,18 @@ MeshViewerWidget::initializeGL()
 
     // Create Object(s) :
     axis = new Axis();
+    scene = new Scene();
+
+    profiler = new FrameProfiler();
+    profiler->create();
+
+    renderer = new Renderer();
+    renderer->create("../shaders");
+    program = renderer->get_program();
+    camera_dirty = true;
 
-    program = new QOpenGLShaderProgram();
-    program->addShaderFromSourceFile(QOpenGLShader::Vertex, "../shaders/simple.vert.glsl");
-    program->addShaderFromSourceFile(QOpenGLShader::Fragment, "../shaders/simple.frag.glsl");
-    program->link();
     program->bind();
     {
-        light = new Light();
-        light->set_position(0.0f, 100.0f, 200.0f, program->uniformLocation("light_position"))
-             ->set_color(0.9f, 0.9f, 0.9f, program->uniformLocation("light_color"))
-             ->set_ambient(0.4f, program->uniformLocation("light_ambient"))
-             ->set_fixed(true, program->uniformLocation("light_fixed"))
-             ->enable(program->uniformLocation("light_on"));
-
         axis->build(program);
         axis->update_buffers(program);
     }
@@ -164,9 +229,6 @@ MeshViewerWidget::initializeGL()
     glPolygonMode(GL_FRONT_AND_BACK, GL_FILL);
 
     default_ModelViewPosition();
-
-    // IDLE Function
-    timer_id_0 = startTimer(0);
 }
 
 /* When window (this widget) is resized */
@@ -177,43 +239,71 @@ MeshViewerWidget::resizeGL(int width, int height)
     window_ratio = width/float(height);
     arcball->update_window_size(width, height);
     update_projection();
-    update();
+    request_frame();
 }
 
 /* RENDER TIME */
 void
 MeshViewerWidget::paintGL()
 {
-    // Wait refresh-rate setup by user before painting
-    long mcs = MeshViewerWidget::microseconds_diff(Clock::now(), lap);
-    if( mcs < frequency ){
-        std::this_thread::sleep_for(
-            std::chrono::microseconds(frequency - (mcs + 100))
-        );
-    }
+    TRACE_SCOPE("paintGL");
 
+    // Paced by request_frame(), nothing to wait for here.
     update_lap(); // increment FPS counter
+    frame_start = Clock::now();
+    profiler->begin_frame();
 
     glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-    program->bind();
-    {
-        // send light parameters to shaders
-        light->to_gpu(program);
-
-        // push projection & views matrix to the GPU
-        program->setUniformValue("projection", projection);
-        program->setUniformValue("view", view);
-        program->setUniformValue("view_inverse", view.transposed().inverted());
 
+    // light & camera (projection & views matrix) pushed to the GPU, when they changed
+    const bool view_changed = camera_dirty;
+    renderer->begin_frame(projection, view, camera_dirty);
+    camera_dirty = false;
+    {
         if( axis_on )
             draw_axis(program);
 
-        // In case user imported a mesh into the viewer, display it.
+        // In case user imported a mesh into the viewer, display it, then the scene.
+        size_t level = 0;
         if( mesh != nullptr ){
-            mesh->show(program, GL_TRIANGLES);
+            level = mesh->current_detail_level();
+            update_proxy_level();
+        }
+
+        renderer->draw(mesh, scene, projection, view, height(), interacting ? proxy_level : 0, !back_faces_on);
+        frame_triangles = renderer->triangles();
+
+        if( mesh != nullptr && mesh->current_detail_level() != level )
+            emit detail_level_changed(mesh->current_detail_level());
+
+        // More frames without input: refinement after interaction,
+        // occlusion results read by the next frame until they change nothing.
+        bool occlusion_pending = false;
+        if( mesh != nullptr && occlusion_culling_on ){
+            const OcclusionStats& occlusion = mesh->occlusion_stats();
+            occlusion_pending = view_changed || occlusion.pending > 0 || occlusion.changed > 0;
         }
+
+        if( interacting || occlusion_pending )
+            request_frame();
     }
-    program->release();
+    renderer->end_frame();
+
+    profiler->end_frame();
+
+    GL_STATS_END_FRAME();
+    update_hud();
+}
+
+/* The frame is on screen: its cost, from paintGL() to now, per triangle drawn. */
+void
+MeshViewerWidget::frame_swapped()
+{
+    if( frame_triangles == 0 )
+        return;
+
+    float cost = float(MeshViewerWidget::microseconds_diff(Clock::now(), frame_start)) / float(frame_triangles);
+    frame_cost = (frame_cost == 0.0f) ? cost : 0.8f * frame_cost + 0.2f * cost;
 }
 
 /* When mouse is moving inside the widget */
@@ -236,9 +326,12 @@ MeshViewerWidget::mouseMoveEvent(QMouseEvent* event)
         position.setY(position.y() + ((pos.y() - mouse.y())*step));
     }
 
+    if( mouse_pressed || wheel_pressed )
+        interaction();
+
     mouse = pos;
     update_view();
-    update();
+    request_frame();
 }
 
 void
@@ -265,17 +358,6 @@ MeshViewerWidget::mouseReleaseEvent(QMouseEvent* event)
         wheel_pressed = false;
 }
 
-// IDLE Function: when no user inputs repaint
-void
-MeshViewerWidget::timerEvent(QTimerEvent* event)
-{
-    int id = event->timerId();
-
-    if( id == timer_id_0 ){
-        update();
-    }
-}
-
 /*
  * Make sure that position.z()
  * stay between ]zNear+step & zFar-step[
@@ -287,8 +369,9 @@ MeshViewerWidget::wheelEvent(QWheelEvent* event)
     float step = (event->delta() * speed) * (position.z() / (zFar-zNear));
 
     position.setZ(position.z() - step);
+    interaction();
     update_view();
-    update();
+    request_frame();
 }
 
 void
@@ -318,7 +401,8 @@ MeshViewerWidget::handle_key_events(QKeyEvent* event)
         break;
     }
 
-    update();
+    interaction();
+    request_frame();
 }
 
 void
@@ -327,6 +411,23 @@ MeshViewerWidget::set_frames_per_second(size_t fps)
     frequency = long(1.0f/fps * 1000000);
 }
 
+/*
+ * Right away when the last frame started `frequency` ago, once it has otherwise:
+ * the event loop keeps running meanwhile, requests made until then end up into the same frame.
+ */
+void
+MeshViewerWidget::request_frame()
+{
+    if( frame_timer->isActive() )
+        return;
+
+    long wait = frequency - MeshViewerWidget::microseconds_diff(Clock::now(), lap);
+    if( wait <= 0 )
+        update();
+    else
+        frame_timer->start(int((wait + 999) / 1000));
+}
+
 size_t
 MeshViewerWidget::get_computed_frames() const
 {
@@ -346,9 +447,115 @@ MeshViewerWidget::update_lap()
     lap = Clock::now();
 }
 
+/* The camera moved: the proxy stays until input has been idle for interaction_hold ms. */
+void
+MeshViewerWidget::interaction()
+{
+    last_interaction = Clock::now();
+
+    if( !interactive_lod_on || mesh == nullptr || mesh->nb_detail_levels() < 2 )
+        return;
+
+    if( !interacting ){
+        interacting = true;
+        proxy_level = budget_detail_level();
+    }
+}
+
+/*
+ * Finest level expected to fit into target_frame_time,
+ * assuming the cost of a frame follows its number of triangles.
+ * Going finer asks for some margin, so that levels do not flicker frame after frame.
+ */
+size_t
+MeshViewerWidget::budget_detail_level() const
+{
+    if( frame_cost == 0.0f )
+        return proxy_level;
+
+    auto expected = [&](size_t level){
+        return frame_cost * float(mesh->detail_level_elements(level) / 3);
+    };
+
+    size_t level = 0;
+    while( level+1 < mesh->nb_detail_levels() ){
+        float budget = (level < proxy_level) ? 0.75f * float(target_frame_time) : float(target_frame_time);
+        if( expected(level) <= budget )
+            break;
+        ++level;
+    }
+    return level;
+}
+
+/* Once per frame: follow the frame time while moving, refine when idle. */
+void
+MeshViewerWidget::update_proxy_level()
+{
+    if( !interacting )
+        return;
+
+    if( !interactive_lod_on || mesh->nb_detail_levels() < 2 ){
+        interacting = false;
+        proxy_level = 0;
+        return;
+    }
+
+    long idle = microseconds_diff(Clock::now(), last_interaction) / 1000;
+    if( idle < interaction_hold ){
+        proxy_level = budget_detail_level();
+        return;
+    }
+
+    // Idle: one level finer per frame, or full detail at once.
+    if( progressive_refine_on && proxy_level > 0 )
+        --proxy_level;
+    else
+        proxy_level = 0;
+
+    interacting = (proxy_level > 0);
+}
+
+void
+MeshViewerWidget::show_hud(bool on)
+{
+#ifdef GL_STATS
+    hud->setVisible(on);
+    update_hud();
+#else
+    (void)on;
+#endif
+}
+
+/* Once a frame is drawn, its counters as they were */
+void
+MeshViewerWidget::update_hud()
+{
+#ifdef GL_STATS
+    if( !hud->isVisible() )
+        return;
+
+    const GLCounters& c = GLStats::last();
+    QString text =
+        "Draws: " + QString::number(qulonglong(c.draws)) +
+        "\nTriangles: " + QString::number(qulonglong(c.triangles)) +
+        "\nVAO binds: " + QString::number(qulonglong(c.vao_binds)) +
+        "\nProgram binds: " + QString::number(qulonglong(c.program_binds)) +
+        "\nBuffer binds: " + QString::number(qulonglong(c.buffer_binds)) +
+        "\nUniform sets: " + QString::number(qulonglong(c.uniform_sets)) +
+        "\nBytes written: " + QString::number(qulonglong(c.bytes_written));
+
+    // Same counts frame after frame: no need to repaint the label.
+    if( text != hud->text() ){
+        hud->setText(text);
+        hud->adjustSize();
+    }
+#endif
+}
+
 void
 MeshViewerWidget::draw_axis(QOpenGLShaderProgram* program)
 {
+    Light* light = renderer->get_light();
     bool light_on = light->enabled();
     if( light_on ) light->off(program);
     axis->show(program, GL_LINES);
@@ -359,16 +566,18 @@ void
 MeshViewerWidget::show_axis(bool mode)
 {
     axis_on = mode;
-    update();
+    request_frame();
 }
 
 void
 MeshViewerWidget::draw_back_faces(bool mode)
 {
+    back_faces_on = mode;
+
     makeCurrent();
     mode ? glDisable(GL_CULL_FACE) : glEnable(GL_CULL_FACE);
     doneCurrent();
-    update();
+    request_frame();
 }
 
 void
@@ -381,14 +590,14 @@ MeshViewerWidget::draw_wireframe(bool mode)
     glPolygonMode(GL_FRONT_AND_BACK, GL_FILL);
 
     doneCurrent();
-    update();
+    request_frame();
 }
 
 void
 MeshViewerWidget::smooth_render(bool on)
 {
     smooth_on = on;
-    update();
+    request_frame();
 }
 
 // The delay between two time in microseconds
@@ -404,14 +613,14 @@ void
 MeshViewerWidget::display_wireframe(bool mode)
 {
     wireframe_on = mode;
-    update();
+    request_frame();
 }
 
 void
 MeshViewerWidget::display_fill(bool mode)
 {
     fill_on = mode;
-    update();
+    request_frame();
 }
 
 void
@@ -419,31 +628,174 @@ MeshViewerWidget::reset_view()
 {
     default_view();
     update_view();
-    update();
+    request_frame();
 }
 
-/* Load OBJ or OFF mesh from disk */
+/*
+ * Load OBJ or OFF mesh from disk.
+ * Reading happens into a MeshLoader thread, the current mesh keeps being
+ * rendered until the new one is uploaded by swap_mesh().
+ */
 void
 MeshViewerWidget::load_mesh_file(const std::string& str)
 {
-    MeshObject* mesh = new MeshObject(str);
+    start_loading(str, false);
+}
+
+/* Same loading, the mesh becomes a new part of the scene. */
+void
+MeshViewerWidget::add_mesh_file(const std::string& str)
+{
+    start_loading(str, true);
+}
 
-    if( mesh != nullptr ){
+void
+MeshViewerWidget::start_loading(const std::string& str, bool into_scene)
+{
+    // Only the latest request matters.
+    cancel_loading();
+    loading_into_scene = into_scene;
+
+    loader = new MeshLoader(str, this);
+    loader->set_vertex_cache_optimization(vertex_cache_on);
+    loader->set_normal_weighting(normal_weighting);
+    loader->set_model_normalization(model_normalization_on);
+    loader->set_detail_levels(detail_levels_on && !into_scene); // parts are always drawn in full
+
+    connect(loader, &MeshLoader::progress, this, &MeshViewerWidget::mesh_loading);
+    connect(loader, &MeshLoader::loaded, this, &MeshViewerWidget::swap_mesh);
+    connect(loader, &MeshLoader::failed, this, &MeshViewerWidget::mesh_loading_failed);
+    connect(loader, &MeshLoader::aborted, this, &MeshViewerWidget::mesh_loading_aborted);
+    connect(loader, &QThread::finished, this, &MeshViewerWidget::loader_finished);
+
+    loader->start();
+}
+
+/* Stop the current loading (if any), the displayed mesh stays as it is. */
+void
+MeshViewerWidget::cancel_loading()
+{
+    if( loader == nullptr )
+        return;
+
+    // A cancelled loader may still deliver queued signals: forget about them.
+    disconnect(loader, nullptr, this, nullptr);
+    connect(loader, &QThread::finished, loader, &QObject::deleteLater);
+    connect(loader, &MeshLoader::loaded, loader, [](MeshObject* mesh){ delete mesh; });
+
+    loader->cancel();
+    if( !loader->isRunning() )
+        loader->deleteLater();
+
+    loader = nullptr;
+    emit mesh_loading_aborted();
+}
+
+/* GUI thread: upload a loaded part into the scene, on a grid of 10 per row, each normalized in its cell. */
+void
+MeshViewerWidget::add_to_scene(MeshObject* mesh)
+{
+    TRACE_SCOPE("add_to_scene");
+
+    makeCurrent();
+    {
+        program->bind();
+        bool ok = mesh->build(program);
+        if( ok ){
+            const size_t i = scene->nb_parts();
+            QMatrix4x4 placement;
+            placement.translate(1.25f * float(i % 10), 0.0f, -1.25f * float(i / 10));
+
+            // Takes the mesh over
+            ok = scene->add(mesh, program, placement * mesh->model_matrix());
+        }
+        else
+            delete mesh;
+        program->release();
+
+        if( !ok ){
+            doneCurrent();
+            emit mesh_loading_failed(QString::fromStdString(loader->file_path()));
+            return;
+        }
+    }
+    doneCurrent();
+
+    request_frame();
+    emit mesh_loaded();
+}
+
+void
+MeshViewerWidget::clear_scene()
+{
+    makeCurrent();
+    scene->clear();
+    doneCurrent();
+
+    request_frame();
+}
+
+/* GUI thread: upload the freshly loaded mesh then replace the old one. */
+void
+MeshViewerWidget::swap_mesh(MeshObject* mesh)
+{
+    TRACE_SCOPE("swap_mesh");
+
+    // Delivered after a cancellation: drop it.
+    if( loader == nullptr || sender() != loader ){
+        delete mesh;
+        return;
+    }
+
+    if( loading_into_scene ){
+        add_to_scene(mesh);
+        return;
+    }
+
+    mesh->set_render_only(render_only_on);
+    mesh->set_drop_halfedge_mesh(drop_halfedges_on);
+    mesh->set_vertex_layout(vertex_layout);
+    mesh->set_vertex_format(vertex_format);
+    mesh->set_cluster_culling(cluster_culling_on);
+    mesh->set_occlusion_culling(occlusion_culling_on);
+
+    makeCurrent();
+    {
+        program->bind();
+        bool ok = mesh->build(program) && mesh->update_buffers(program) && apply_instances(mesh);
+        program->release();
+
+        if( !ok ){
+            delete mesh;
+            doneCurrent();
+            emit mesh_loading_failed(QString::fromStdString(loader->file_path()));
+            return;
+        }
+
+        // GPU buffers of the previous mesh are destroyed while the context is current.
         if( this->mesh != nullptr )
             delete this->mesh;
 
         this->mesh = mesh;
+    }
+    doneCurrent();
 
-        makeCurrent();
-        {
-            program->bind();
-            {
-                this->mesh->build(program);
-                this->mesh->update_buffers(program);
-            }
-            program->release();
-        }
-        doneCurrent();
+    // Frame costs of the previous mesh say nothing about this one.
+    interacting = false;
+    proxy_level = 0;
+    frame_triangles = 0;
+    frame_cost = 0.0f;
+
+    request_frame();
+    emit mesh_loaded();
+}
+
+void
+MeshViewerWidget::loader_finished()
+{
+    if( loader != nullptr && sender() == loader ){
+        loader->deleteLater();
+        loader = nullptr;
     }
 }
 
@@ -457,6 +809,183 @@ MeshViewerWidget::flip_back_faces(bool mode)
 
     program->release();
     doneCurrent();
+    request_frame();
+}
+
+/*
+ * Render-only: CPU copies of the meshes are freed once uploaded.
+ * Applies to the current mesh right away (they cannot come back) and to the next ones.
+ */
+void
+MeshViewerWidget::set_render_only(bool on, bool drop_halfedges)
+{
+    render_only_on = on;
+    drop_halfedges_on = on && drop_halfedges;
+
+    if( mesh != nullptr ){
+        mesh->set_drop_halfedge_mesh(drop_halfedges_on);
+        mesh->set_render_only(render_only_on);
+    }
+}
+
+/*
+ * Re-upload the current mesh with another VBO layout.
+ * Without CPU copies (render-only) the mesh keeps its layout until the next load.
+ */
+void
+MeshViewerWidget::set_vertex_layout(VertexLayout layout)
+{
+    vertex_layout = layout;
+
+    if( mesh == nullptr )
+        return;
+
+    makeCurrent();
+    program->bind();
+
+    mesh->set_vertex_layout(layout);
+    mesh->update_buffers(program);
+
+    program->release();
+    doneCurrent();
+    request_frame();
+}
+
+/* Used by the next loadings; meshes already optimized stay as they are. */
+void
+MeshViewerWidget::set_vertex_cache_optimization(bool on)
+{
+    vertex_cache_on = on;
+}
+
+/* Used by the next loadings too. */
+void
+MeshViewerWidget::set_normal_weighting(NormalWeighting weighting)
+{
+    normal_weighting = weighting;
+}
+
+/* Same: the current mesh keeps the normalization it was loaded with. */
+void
+MeshViewerWidget::set_model_normalization(bool on)
+{
+    model_normalization_on = on;
+}
+
+void
+MeshViewerWidget::set_cluster_culling(bool on)
+{
+    cluster_culling_on = on;
+
+    if( mesh != nullptr )
+        mesh->set_cluster_culling(on);
+
+    request_frame();
+}
+
+void
+MeshViewerWidget::set_occlusion_culling(bool on)
+{
+    occlusion_culling_on = on;
+
+    if( mesh != nullptr )
+        mesh->set_occlusion_culling(on);
+
+    request_frame();
+}
+
+void
+MeshViewerWidget::set_instances(int count)
+{
+    nb_instances = size_t(std::max(count, 1));
+
+    if( mesh != nullptr ){
+        makeCurrent();
+        program->bind();
+        apply_instances(mesh);
+        program->release();
+        doneCurrent();
+    }
+
+    request_frame();
+}
+
+/*
+ * Copies on a cube grid filling the place of the mesh alone, scaled down to their cell.
+ * The program must be bound.
+ */
+bool
+MeshViewerWidget::apply_instances(MeshObject* mesh)
+{
+    std::vector<QMatrix4x4> transforms;
+    if( nb_instances > 1 ){
+        size_t side = size_t(std::ceil(std::cbrt(double(nb_instances))));
+        float cell = 2.0f / float(side);
+
+        transforms.resize(nb_instances);
+        for(size_t i=0; i < nb_instances; ++i){
+            transforms[i].translate(
+                -1.0f + cell * (float(i % side) + 0.5f),
+                -1.0f + cell * (float(i / side % side) + 0.5f),
+                -1.0f + cell * (float(i / (side * side)) + 0.5f)
+            );
+            transforms[i].scale(0.45f * cell);
+        }
+    }
+
+    return mesh->set_instances(program, transforms);
+}
+
+void
+MeshViewerWidget::set_interactive_lod(bool on)
+{
+    interactive_lod_on = on;
+    request_frame();
+}
+
+void
+MeshViewerWidget::set_progressive_refine(bool on)
+{
+    progressive_refine_on = on;
+}
+
+void
+MeshViewerWidget::set_interaction_hold(int hold_ms)
+{
+    interaction_hold = std::max(0, hold_ms);
+}
+
+void
+MeshViewerWidget::set_target_frame_time(int frame_ms)
+{
+    target_frame_time = long(std::max(1, frame_ms)) * 1000;
+}
+
+/* Decimation happens at loading time: used by the next loadings. */
+void
+MeshViewerWidget::set_detail_levels(bool on)
+{
+    detail_levels_on = on;
+}
+
+/* Same for the attributes formats (compressed or not). */
+void
+MeshViewerWidget::set_vertex_format(const VertexFormat& format)
+{
+    vertex_format = format;
+
+    if( mesh == nullptr )
+        return;
+
+    makeCurrent();
+    program->bind();
+
+    mesh->set_vertex_format(format);
+    mesh->update_buffers(program);
+
+    program->release();
+    doneCurrent();
+    request_frame();
 }
 
 void
@@ -473,11 +1002,14 @@ MeshViewerWidget::update_mesh_color(float r, float g, float b)
 
     program->release();
     doneCurrent();
+    request_frame();
 }
 
 void
 MeshViewerWidget::take_screenshots(int width, int height, Qt::AspectRatioMode aspect, int nimages, int quality, int format, QString dir, QProgressBar* pb)
 {
+    TRACE_SCOPE("take_screenshots");
+
     // Possible images formats
     const char* extension[2] = {
         ".jpg", ".png"
@@ -519,6 +1051,7 @@ MeshViewerWidget::take_screenshots(int width, int height, Qt::AspectRatioMode as
 
     makeCurrent();
     for(int i=0; i < nimages; ++i){
+        TRACE_SCOPE("screenshot");
         degree = degrees(mt_generator);
         do {
             x = axes(mt_generator);
@@ -537,8 +1070,11 @@ MeshViewerWidget::take_screenshots(int width, int height, Qt::AspectRatioMode as
 
         // Save current framebuffer to disk
         QImage image = grabFramebuffer();
-        image = image.scaled(width, height, aspect, Qt::SmoothTransformation);
-        image.save(filename, nullptr, quality);
+        {
+            TRACE_SCOPE("screenshot save");
+            image = image.scaled(width, height, aspect, Qt::SmoothTransformation);
+            image.save(filename, nullptr, quality);
+        }
         pb->setValue(i); // ++ UI progressBar
     }
     doneCurrent();
@@ -0,0 +1,300 @@
+#include "../include/occlusionculling.h"
+#include "../include/glstats.h"
+
+#include <QOpenGLContext>
+
+#include <algorithm>
+#include <limits>
+
+#ifndef GL_SAMPLES_PASSED
+#define GL_SAMPLES_PASSED 0x8914
+#endif
+
+#ifndef GL_ANY_SAMPLES_PASSED
+#define GL_ANY_SAMPLES_PASSED 0x8C2F
+#endif
+
+#ifndef GL_QUERY_RESULT
+#define GL_QUERY_RESULT 0x8866
+#endif
+
+#ifndef GL_QUERY_RESULT_AVAILABLE
+#define GL_QUERY_RESULT_AVAILABLE 0x8867
+#endif
+
+/* Chunks gather consecutive meshlets up to that many triangles: fewer queries, coarser culling. */
+static const size_t chunk_triangles = 4096;
+
+/* Visible chunks are tested again once every that many frames, at different frames for each. */
+static const size_t visible_query_interval = 4;
+
+/* Corners (bit 0: x, bit 1: y, bit 2: z of the max) of the 12 triangles of a box */
+static const int box_corners[36] = {
+    0, 2, 1,  1, 2, 3,   4, 5, 6,  5, 7, 6,
+    0, 1, 4,  1, 5, 4,   2, 6, 3,  3, 6, 7,
+    0, 4, 2,  2, 4, 6,   1, 3, 5,  3, 7, 5
+};
+
+OcclusionCulling::OcclusionCulling():
+    target(GL_SAMPLES_PASSED),
+    gen_queries(nullptr),
+    delete_queries(nullptr),
+    begin_query(nullptr),
+    end_query(nullptr),
+    get_query_object(nullptr),
+    vao(nullptr),
+    vbo(nullptr),
+    location_model(-1),
+    frame(0)
+{
+    stats = OcclusionStats{ 0, 0, 0, 0, 0 };
+    for(size_t c=0; c < 4; ++c)
+        near_plane[c] = 0.0f;
+}
+
+OcclusionCulling::~OcclusionCulling()
+{
+    free();
+}
+
+void
+OcclusionCulling::free()
+{
+    if( delete_queries != nullptr )
+        for(const Chunk& chunk: chunks)
+            delete_queries(1, &chunk.query);
+
+    chunks.clear();
+    meshlet_chunk.clear();
+
+    if( vao != nullptr ){
+        vao->destroy();
+        delete vao;
+        vao = nullptr;
+    }
+
+    if( vbo != nullptr ){
+        vbo->destroy();
+        delete vbo;
+        vbo = nullptr;
+    }
+}
+
+bool
+OcclusionCulling::build(const std::vector<Meshlet>& meshlets, QOpenGLShaderProgram* program)
+{
+    free();
+
+    QOpenGLContext* context = QOpenGLContext::currentContext();
+    if( context == nullptr || meshlets.empty() )
+        return false;
+
+    // Occlusion queries: OpenGL 1.5, OpenGL ES 3.0 (any samples only).
+    QSurfaceFormat surface = context->format();
+    int version = surface.majorVersion() * 10 + surface.minorVersion();
+    if( context->isOpenGLES() ? version < 30 : version < 15 )
+        return false;
+
+    target = (context->isOpenGLES() || version >= 33) ? GL_ANY_SAMPLES_PASSED : GL_SAMPLES_PASSED;
+
+    gen_queries = reinterpret_cast<GenQueries>(context->getProcAddress("glGenQueries"));
+    delete_queries = reinterpret_cast<DeleteQueries>(context->getProcAddress("glDeleteQueries"));
+    begin_query = reinterpret_cast<BeginQuery>(context->getProcAddress("glBeginQuery"));
+    end_query = reinterpret_cast<EndQuery>(context->getProcAddress("glEndQuery"));
+    get_query_object = reinterpret_cast<GetQueryObjectuiv>(context->getProcAddress("glGetQueryObjectuiv"));
+
+    if( gen_queries == nullptr || delete_queries == nullptr || begin_query == nullptr
+     || end_query == nullptr || get_query_object == nullptr ){
+        delete_queries = nullptr;
+        return false;
+    }
+
+    // Meshlets are sorted along a Morton curve: consecutive ones make compact chunks.
+    meshlet_chunk.resize(meshlets.size());
+    for(size_t m=0; m < meshlets.size(); ){
+        Chunk chunk;
+        chunk.first_meshlet = m;
+        chunk.pending = false;
+        chunk.visible = true;
+        chunk.in_frustum = true;
+        for(size_t j=0; j < 3; ++j){
+            chunk.min[j] = std::numeric_limits<float>::max();
+            chunk.max[j] = std::numeric_limits<float>::lowest();
+        }
+
+        size_t triangles = 0;
+        for(; m < meshlets.size() && triangles < chunk_triangles; ++m){
+            const Meshlet& meshlet = meshlets[m];
+            for(size_t j=0; j < 3; ++j){
+                chunk.min[j] = std::min(chunk.min[j], meshlet.center[j] - meshlet.radius);
+                chunk.max[j] = std::max(chunk.max[j], meshlet.center[j] + meshlet.radius);
+            }
+
+            triangles += meshlet.count / 3;
+            meshlet_chunk[m] = chunks.size();
+        }
+
+        chunk.nb_meshlets = m - chunk.first_meshlet;
+        gen_queries(1, &chunk.query);
+        chunks.push_back(chunk);
+    }
+
+    std::vector<GLfloat> boxes(chunks.size() * 36 * 3);
+    GLfloat* p = boxes.data();
+    for(const Chunk& chunk: chunks)
+        for(int corner: box_corners){
+            *p++ = (corner & 1) ? chunk.max[0] : chunk.min[0];
+            *p++ = (corner & 2) ? chunk.max[1] : chunk.min[1];
+            *p++ = (corner & 4) ? chunk.max[2] : chunk.min[2];
+        }
+
+    vao = new QOpenGLVertexArrayObject();
+    vbo = new QOpenGLBuffer();
+    if( !vao->create() || !vbo->create() ){
+        free();
+        return false;
+    }
+
+    // Positions only: colors & normals are of no use without color writes.
+    vao->bind();
+    {
+        vbo->bind();
+        vbo->setUsagePattern(QOpenGLBuffer::StaticDraw);
+        vbo->allocate(boxes.data(), int(sizeof(GLfloat) * boxes.size()));
+
+        for(const char* name: { "color", "normal" }){
+            int location = program->attributeLocation(name);
+            if( location >= 0 )
+                program->disableAttributeArray(location);
+        }
+
+        int location = program->attributeLocation("position");
+        program->enableAttributeArray(location);
+        program->setAttributeBuffer(location, GL_FLOAT, 0, 3, 0);
+    }
+    vao->release();
+    vbo->release();
+
+    location_model = program->uniformLocation("model");
+    frame = 0;
+    stats = OcclusionStats{ chunks.size(), 0, 0, 0, 0 };
+    return true;
+}
+
+void
+OcclusionCulling::update(const float planes[6][4])
+{
+    ++frame;
+    stats = OcclusionStats{ chunks.size(), 0, 0, 0, 0 };
+
+    // The near one is planes[4], see Meshlets::frustum_planes()
+    for(size_t c=0; c < 4; ++c)
+        near_plane[c] = planes[4][c];
+
+    for(Chunk& chunk: chunks){
+        // Farthest corner along each plane normal
+        chunk.in_frustum = true;
+        for(size_t p=0; p < 6 && chunk.in_frustum; ++p){
+            float d = planes[p][3];
+            for(size_t j=0; j < 3; ++j)
+                d += planes[p][j] * ((planes[p][j] > 0.0f) ? chunk.max[j] : chunk.min[j]);
+            chunk.in_frustum = (d >= 0.0f);
+        }
+
+        if( chunk.pending ){
+            GLuint available = 0;
+            get_query_object(chunk.query, GL_QUERY_RESULT_AVAILABLE, &available);
+
+            if( available ){
+                GLuint samples = 0;
+                get_query_object(chunk.query, GL_QUERY_RESULT, &samples);
+                chunk.pending = false;
+                if( chunk.visible != (samples > 0) )
+                    ++stats.changed;
+                chunk.visible = (samples > 0);
+            }
+            else
+                ++stats.pending;
+        }
+
+        // Coming back into the frustum: drawn until told otherwise.
+        if( !chunk.in_frustum )
+            chunk.visible = true;
+
+        if( !chunk.visible )
+            ++stats.occluded;
+    }
+}
+
+void
+OcclusionCulling::reset()
+{
+    for(Chunk& chunk: chunks)
+        chunk.visible = true;
+    stats.occluded = 0;
+    stats.pending = 0;
+    stats.changed = 0;
+}
+
+/*
+ * Boxes are drawn with color & depth writes off, back faces included:
+ * the camera may well stand into one. The caller's masks, culling & polygon mode are restored. Boxes crossing the near plane
+ * would lose their front faces to clipping, they are never tested.
+ */
+void
+OcclusionCulling::query(QOpenGLShaderProgram* program, const QMatrix4x4& model)
+{
+    if( chunks.empty() )
+        return;
+
+    GLboolean cull_face = glIsEnabled(GL_CULL_FACE);
+    GLint polygon_mode[2];
+    glGetIntegerv(GL_POLYGON_MODE, polygon_mode);
+    GLboolean color_mask[4];
+    glGetBooleanv(GL_COLOR_WRITEMASK, color_mask);
+    GLboolean depth_mask;
+    glGetBooleanv(GL_DEPTH_WRITEMASK, &depth_mask);
+
+    glColorMask(GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE);
+    glDepthMask(GL_FALSE);
+    glDisable(GL_CULL_FACE);
+    glPolygonMode(GL_FRONT_AND_BACK, GL_FILL);
+
+    program->setUniformValue(location_model, model);
+    GL_STATS_ADD(uniform_sets, location_model >= 0);
+
+    vao->bind();
+    GL_STATS_ADD(vao_binds, 1);
+    for(size_t c=0; c < chunks.size(); ++c){
+        Chunk& chunk = chunks[c];
+        if( !chunk.in_frustum || chunk.pending )
+            continue;
+
+        if( chunk.visible && (frame + c) % visible_query_interval != 0 )
+            continue;
+
+        float d = near_plane[3];
+        for(size_t j=0; j < 3; ++j)
+            d += near_plane[j] * ((near_plane[j] > 0.0f) ? chunk.min[j] : chunk.max[j]);
+        if( d < 0.0f ){
+            chunk.visible = true;
+            continue;
+        }
+
+        begin_query(target, chunk.query);
+        glDrawArrays(GL_TRIANGLES, GLint(36 * c), 36);
+        GL_STATS_DRAW(GL_TRIANGLES, 36, 1);
+        end_query(target);
+
+        chunk.pending = true;
+        ++stats.queries;
+    }
+    vao->release();
+    GL_STATS_ADD(vao_binds, 1);
+
+    glColorMask(color_mask[0], color_mask[1], color_mask[2], color_mask[3]);
+    glDepthMask(depth_mask);
+    glPolygonMode(GL_FRONT_AND_BACK, GLenum(polygon_mode[0]));
+    if( cull_face )
+        glEnable(GL_CULL_FACE);
+}
@@ -0,0 +1,137 @@
+#include "../include/renderer.h"
+#include "../include/glstats.h"
+#include "../include/trace.h"
+
+#include <algorithm>
+#include <iostream>
+
+Renderer::Renderer():
+    program(nullptr),
+    camera_block(nullptr),
+    location_view_projection(-1),
+    location_view(-1),
+    location_view_inverse(-1),
+    light(nullptr),
+    nb_triangles(0)
+{
+
+}
+
+Renderer::~Renderer()
+{
+    delete light;
+    delete camera_block;
+
+    if( program != nullptr ){
+        program->removeAllShaders();
+        delete program;
+    }
+}
+
+bool
+Renderer::create(const std::string& shaders_dir)
+{
+    program = new QOpenGLShaderProgram();
+    if( !program->addShaderFromSourceFile(QOpenGLShader::Vertex, QString::fromStdString(shaders_dir + "/simple.vert.glsl"))
+     || !program->addShaderFromSourceFile(QOpenGLShader::Fragment, QString::fromStdString(shaders_dir + "/simple.frag.glsl"))
+     || !program->link() ){
+        std::cerr << "Failed to build the shaders of " << shaders_dir << std::endl;
+        return false;
+    }
+
+    program->bind();
+    {
+        // Uniform blocks when available, at binding points 0 & 1.
+        camera_block = new UniformBuffer();
+        if( !camera_block->create(program, "Camera", 0, sizeof(GLfloat) * 48) ){
+            location_view_projection = program->uniformLocation("view_projection");
+            location_view = program->uniformLocation("view");
+            location_view_inverse = program->uniformLocation("view_inverse");
+        }
+
+        light = new Light();
+        light->use_block(program, 1);
+        light->set_position(0.0f, 100.0f, 200.0f, program->uniformLocation("light_position"))
+             ->set_color(0.9f, 0.9f, 0.9f, program->uniformLocation("light_color"))
+             ->set_ambient(0.4f, program->uniformLocation("light_ambient"))
+             ->set_fixed(true, program->uniformLocation("light_fixed"))
+             ->enable(program->uniformLocation("light_on"));
+    }
+    program->release();
+
+    return true;
+}
+
+void
+Renderer::begin_frame(const QMatrix4x4& projection, const QMatrix4x4& view, bool camera_changed)
+{
+    program->bind();
+    GL_STATS_ADD(program_binds, 1);
+
+    light->to_gpu(program);
+
+    if( camera_changed )
+        upload_camera(projection, view);
+}
+
+void
+Renderer::draw(MeshObject* mesh, Scene* scene, const QMatrix4x4& projection, const QMatrix4x4& view,
+               int height, size_t min_level, bool cull_back_faces)
+{
+    TRACE_SCOPE("Renderer::draw");
+
+    nb_triangles = 0;
+
+    if( mesh != nullptr ){
+        // Moving camera: the proxy, unless the mesh is already coarser on screen.
+        mesh->select_detail_level(projection, view, height);
+        if( min_level > mesh->current_detail_level() )
+            mesh->set_detail_level(min_level);
+
+        // Culled faces are not worth testing clusters for their orientation.
+        mesh->cull_clusters(projection, view, cull_back_faces);
+
+        mesh->show(program, GL_TRIANGLES);
+        mesh->query_occlusion(program);
+        if( mesh->nb_instances() > 0 )
+            nb_triangles = mesh->instances_elements() / 3;
+        else
+        if( mesh->culling_stats().clusters > 0 )
+            nb_triangles = mesh->culling_stats().triangles;
+        else
+            nb_triangles = mesh->detail_level_elements(mesh->current_detail_level()) / 3;
+    }
+
+    if( scene != nullptr ){
+        scene->show(program, GL_TRIANGLES);
+        nb_triangles += scene->triangles();
+    }
+}
+
+void
+Renderer::end_frame()
+{
+    program->release();
+    GL_STATS_ADD(program_binds, 1);
+}
+
+void
+Renderer::upload_camera(const QMatrix4x4& projection, const QMatrix4x4& view)
+{
+    const QMatrix4x4 matrices[3] = { projection * view, view, view.transposed().inverted() };
+
+    if( camera_block->is_created() ){
+        // std140: column-major mat4, one after the other
+        GLfloat data[48];
+        for(size_t m=0; m < 3; ++m)
+            std::copy(matrices[m].constData(), matrices[m].constData() + 16, data + 16 * m);
+        camera_block->write(0, data, sizeof(data));
+    }
+    else {
+        program->setUniformValue(location_view_projection, matrices[0]);
+        program->setUniformValue(location_view, matrices[1]);
+        program->setUniformValue(location_view_inverse, matrices[2]);
+        // Qt skips locations at -1
+        GL_STATS_ADD(uniform_sets, (location_view_projection >= 0) + (location_view >= 0) + (location_view_inverse >= 0));
+    }
+}
@@ -0,0 +1,345 @@
+#include "../include/scene.h"
+#include "../include/glstats.h"
+
+#include <QOpenGLContext>
+
+#include <algorithm>
+#include <cstring>
+#include <iostream>
+#include <numeric>
+
+#ifndef GL_RGBA32F
+#define GL_RGBA32F 0x8814
+#endif
+
+/* Pools are made for that many vertices & indices, larger parts get a pool of their own. */
+static const size_t pool_vertices = 1 << 20;
+static const size_t pool_indices = 6 << 20;
+
+/* Position, normal, color then part index */
+static const size_t vertex_floats = 10;
+
+/* Parts are copied through a staging chunk of that many vertices. */
+static const size_t staging_vertices = 16384;
+
+/* Texels per part: 4 columns of the model matrix, 4 of its inverse transpose. */
+static const size_t transform_texels = 8;
+
+/* glMultiDrawElements: every desktop OpenGL since 1.4, not OpenGL ES. */
+static MultiDrawElements
+resolve_multi_draw_elements()
+{
+    QOpenGLContext* context = QOpenGLContext::currentContext();
+    if( context == nullptr || context->isOpenGLES() )
+        return nullptr;
+
+    return reinterpret_cast<MultiDrawElements>(context->getProcAddress("glMultiDrawElements"));
+}
+
+Scene::Scene():
+    ranges_dirty(false),
+    transforms_texture(0),
+    transforms_capacity(0),
+    location_scene_on(-1),
+    location_part_transforms(-1),
+    multi_draw_elements(nullptr),
+    draw_calls(0),
+    nb_triangles(0)
+{
+
+}
+
+Scene::~Scene()
+{
+    clear();
+}
+
+void
+Scene::clear()
+{
+    for(Pool& pool: pools){
+        pool.vao->destroy();
+        pool.vbo->destroy();
+        pool.ebo->destroy();
+        delete pool.vao;
+        delete pool.vbo;
+        delete pool.ebo;
+    }
+
+    if( transforms_texture != 0 )
+        glDeleteTextures(1, &transforms_texture);
+
+    pools.clear();
+    parts.clear();
+    transforms.clear();
+    transforms_texture = 0;
+    transforms_capacity = 0;
+    draw_calls = 0;
+    nb_triangles = 0;
+}
+
+bool
+Scene::create_pool(QOpenGLShaderProgram* program, size_t vertices, size_t indices)
+{
+    Pool pool;
+    pool.vao = new QOpenGLVertexArrayObject();
+    pool.vbo = new QOpenGLBuffer();
+    pool.ebo = new QOpenGLBuffer(QOpenGLBuffer::IndexBuffer);
+    pool.vertex_capacity = vertices;
+    pool.index_capacity = indices;
+    pool.nb_vertices = 0;
+    pool.nb_indices = 0;
+
+    if( !pool.vao->create() || !pool.vbo->create() || !pool.ebo->create() ){
+        std::cerr << "Failed to create the buffers of a scene pool." << std::endl;
+        delete pool.vao;
+        delete pool.vbo;
+        delete pool.ebo;
+        return false;
+    }
+
+    pool.vao->bind();
+    {
+        pool.ebo->bind();
+        pool.ebo->setUsagePattern(QOpenGLBuffer::StaticDraw);
+        pool.ebo->allocate(int(sizeof(GLuint) * indices));
+
+        pool.vbo->bind();
+        pool.vbo->setUsagePattern(QOpenGLBuffer::StaticDraw);
+        pool.vbo->allocate(int(sizeof(GLfloat) * vertex_floats * vertices));
+
+        const char* names[4] = { "position", "normal", "color", "part" };
+        const int components[4] = { 3, 3, 3, 1 };
+        for(size_t a=0, offset=0; a < 4; offset += size_t(components[a]), ++a){
+            int location = program->attributeLocation(names[a]);
+            if( location < 0 )
+                continue;
+
+            program->enableAttributeArray(location);
+            program->setAttributeBuffer(location, GL_FLOAT, int(sizeof(GLfloat) * offset),
+                                        components[a], int(sizeof(GLfloat) * vertex_floats));
+        }
+    }
+    pool.vao->release();
+    pool.vbo->release();
+    pool.ebo->release();
+
+    pools.push_back(pool);
+    return true;
+}
+
+bool
+Scene::add(DrawableObject* object, QOpenGLShaderProgram* program, const QMatrix4x4& transform)
+{
+    const size_t vertices = object->get_nb_vertices();
+    const size_t indices = object->get_nb_elements();
+
+    // One texture row per part
+    GLint max_parts = 0;
+    glGetIntegerv(GL_MAX_TEXTURE_SIZE, &max_parts);
+    if( parts.size() >= size_t(max_parts) ){
+        std::cerr << "Scene is full: " << max_parts << " parts at most." << std::endl;
+        delete object;
+        return false;
+    }
+
+    if( pools.empty() ){
+        multi_draw_elements = resolve_multi_draw_elements();
+        location_scene_on = program->uniformLocation("scene_on");
+        location_part_transforms = program->uniformLocation("part_transforms");
+    }
+
+    // Only the last pool is ever filled: finding room costs the same whatever the number of parts.
+    if( pools.empty()
+     || pools.back().nb_vertices + vertices > pools.back().vertex_capacity
+     || pools.back().nb_indices + indices > pools.back().index_capacity ){
+        if( !create_pool(program, std::max(vertices, pool_vertices), std::max(indices, pool_indices)) ){
+            delete object;
+            return false;
+        }
+    }
+
+    Pool& pool = pools.back();
+    const GLfloat part_index = GLfloat(parts.size());
+
+    pool.vbo->bind();
+    GL_STATS_ADD(buffer_binds, 1);
+    std::vector<GLfloat> staging(vertex_floats * std::min(vertices, staging_vertices));
+    for(size_t first=0; first < vertices; first += staging_vertices){
+        size_t count = std::min(staging_vertices, vertices - first);
+        object->export_vertices(staging.data(), vertex_floats, first, count);
+        for(size_t v=0; v < count; ++v)
+            staging[vertex_floats*v + 9] = part_index;
+
+        pool.vbo->write(int(sizeof(GLfloat) * vertex_floats * (pool.nb_vertices + first)),
+                        staging.data(), int(sizeof(GLfloat) * vertex_floats * count));
+        GL_STATS_ADD(bytes_written, sizeof(GLfloat) * vertex_floats * count);
+    }
+    pool.vbo->release();
+    GL_STATS_ADD(buffer_binds, 1);
+
+    // The EBO binding belongs to the VAO.
+    std::vector<GLuint> elements(indices);
+    object->export_indices(elements.data(), GLuint(pool.nb_vertices));
+
+    pool.vao->bind();
+    GL_STATS_ADD(vao_binds, 1);
+    pool.ebo->bind();
+    GL_STATS_ADD(buffer_binds, 1);
+    pool.ebo->write(int(sizeof(GLuint) * pool.nb_indices), elements.data(), int(sizeof(GLuint) * indices));
+    GL_STATS_ADD(bytes_written, sizeof(GLuint) * indices);
+    pool.vao->release();
+    GL_STATS_ADD(vao_binds, 1);
+
+    Part part = { pools.size() - 1, pool.nb_indices, indices, true };
+    parts.push_back(part);
+
+    pool.nb_vertices += vertices;
+    pool.nb_indices += indices;
+    nb_triangles += indices / 3;
+    ranges_dirty = true;
+
+    delete object;
+
+    transforms.resize(transform_texels * 4 * parts.size());
+    set_transform(parts.size() - 1, transform);
+    return true;
+}
+
+void
+Scene::set_transform(size_t part, const QMatrix4x4& transform)
+{
+    // Column-major, as the shader reads them
+    GLfloat* row = transforms.data() + transform_texels * 4 * part;
+    std::memcpy(row, transform.constData(), 16 * sizeof(GLfloat));
+    std::memcpy(row + 16, transform.transposed().inverted().constData(), 16 * sizeof(GLfloat));
+
+    // Whole texture again when it grows (doubling), this row only otherwise.
+    if( parts.size() > transforms_capacity ){
+        GLint max_rows = 0;
+        glGetIntegerv(GL_MAX_TEXTURE_SIZE, &max_rows);
+
+        transforms_capacity = std::min(size_t(max_rows), std::max(size_t(64), 2 * transforms_capacity));
+        upload_transforms(0, parts.size(), true);
+    }
+    else
+        upload_transforms(part, 1, false);
+}
+
+void
+Scene::upload_transforms(size_t first, size_t count, bool resize)
+{
+    if( transforms_texture == 0 )
+        glGenTextures(1, &transforms_texture);
+
+    glBindTexture(GL_TEXTURE_2D, transforms_texture);
+
+    if( resize ){
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA32F, GLsizei(transform_texels), GLsizei(transforms_capacity), 0, GL_RGBA, GL_FLOAT, nullptr);
+    }
+
+    glTexSubImage2D(GL_TEXTURE_2D, 0, 0, GLint(first), GLsizei(transform_texels), GLsizei(count), GL_RGBA, GL_FLOAT,
+                    transforms.data() + transform_texels * 4 * first);
+    GL_STATS_ADD(bytes_written, sizeof(GLfloat) * 4 * transform_texels * count);
+    glBindTexture(GL_TEXTURE_2D, 0);
+}
+
+void
+Scene::set_visible(size_t part, bool visible)
+{
+    if( parts[part].visible != visible ){
+        parts[part].visible = visible;
+        ranges_dirty = true;
+    }
+}
+
+/* Parts follow each other into their pool: visible neighbours make a single range. */
+void
+Scene::update_ranges()
+{
+    for(Pool& pool: pools){
+        pool.counts.clear();
+        pool.offsets.clear();
+    }
+
+    nb_triangles = 0;
+    const Part* last = nullptr;
+    for(const Part& part: parts){
+        if( !part.visible )
+            continue;
+
+        Pool& pool = pools[part.pool];
+        if( last != nullptr && last->pool == part.pool && last->first + last->count == part.first )
+            pool.counts.back() += GLsizei(part.count);
+        else {
+            pool.counts.push_back(GLsizei(part.count));
+            pool.offsets.push_back(reinterpret_cast<const void*>(sizeof(GLuint) * part.first));
+        }
+
+        last = &part;
+        nb_triangles += part.count / 3;
+    }
+
+    ranges_dirty = false;
+}
+
+void
+Scene::show(QOpenGLShaderProgram* program, GLenum mode)
+{
+    if( parts.empty() )
+        return;
+
+    if( ranges_dirty )
+        update_ranges();
+
+    // Model matrices from the texture, not from the "model" uniform.
+    program->setUniformValue(location_scene_on, true);
+    program->setUniformValue(location_part_transforms, 0);
+    GL_STATS_ADD(uniform_sets, (location_scene_on >= 0) + (location_part_transforms >= 0));
+    glBindTexture(GL_TEXTURE_2D, transforms_texture);
+
+    draw_calls = 0;
+    for(const Pool& pool: pools){
+        if( pool.counts.empty() )
+            continue;
+
+        pool.vao->bind();
+        GL_STATS_ADD(vao_binds, 1);
+        if( pool.counts.size() == 1 ){
+            glDrawElements(mode, pool.counts[0], GL_UNSIGNED_INT, pool.offsets[0]);
+            GL_STATS_DRAW(mode, pool.counts[0], 1);
+            ++draw_calls;
+        }
+        else
+        if( multi_draw_elements != nullptr ){
+            multi_draw_elements(mode, pool.counts.data(), GL_UNSIGNED_INT, pool.offsets.data(), GLsizei(pool.counts.size()));
+            GL_STATS_DRAW(mode, std::accumulate(pool.counts.begin(), pool.counts.end(), size_t(0)), 1);
+            ++draw_calls;
+        }
+        else {
+            for(size_t r=0; r < pool.counts.size(); ++r){
+                glDrawElements(mode, pool.counts[r], GL_UNSIGNED_INT, pool.offsets[r]);
+                GL_STATS_DRAW(mode, pool.counts[r], 1);
+            }
+            draw_calls += pool.counts.size();
+        }
+        pool.vao->release();
+        GL_STATS_ADD(vao_binds, 1);
+    }
+
+    glBindTexture(GL_TEXTURE_2D, 0);
+    program->setUniformValue(location_scene_on, false);
+    GL_STATS_ADD(uniform_sets, location_scene_on >= 0);
+}
+
+/* Bytes allocated on the GPU, pools as a whole */
+size_t
+Scene::gpu_memory() const
+{
+    size_t bytes = sizeof(GLfloat) * 4 * transform_texels * transforms_capacity;
+    for(const Pool& pool: pools)
+        bytes += sizeof(GLfloat) * vertex_floats * pool.vertex_capacity + sizeof(GLuint) * pool.index_capacity;
+    return bytes;
+}
@@ -0,0 +1,102 @@
+#include "../include/trace.h"
+
+#include <fstream>
+#include <iostream>
+
+std::atomic<bool> Trace::on(false);
+std::mutex Trace::mutex;
+std::vector<Trace::Event> Trace::events;
+std::vector<std::pair<int, std::string>> Trace::thread_names;
+std::string Trace::file_path;
+std::chrono::steady_clock::time_point Trace::origin;
+
+bool
+Trace::start(const std::string& path)
+{
+    std::ofstream file(path);
+    if( !file ){
+        std::cerr << "Cannot write the trace to " << path << std::endl;
+        return false;
+    }
+
+    std::lock_guard<std::mutex> lock(mutex);
+    file_path = path;
+    events.clear();
+    events.reserve(1 << 16);
+    origin = std::chrono::steady_clock::now();
+    on.store(true);
+    return true;
+}
+
+int
+Trace::thread_id()
+{
+    static std::atomic<int> next(1);
+    static thread_local int id = next++;
+    return id;
+}
+
+void
+Trace::name_thread(const std::string& name)
+{
+    if( !enabled() )
+        return;
+
+    std::lock_guard<std::mutex> lock(mutex);
+    thread_names.push_back(std::make_pair(thread_id(), name));
+}
+
+void
+Trace::record(const char* name, std::chrono::steady_clock::time_point begin,
+              std::chrono::steady_clock::time_point end)
+{
+    using std::chrono::duration_cast;
+    using std::chrono::microseconds;
+
+    Event event = {
+        name, thread_id(),
+        duration_cast<microseconds>(begin - origin).count(),
+        duration_cast<microseconds>(end - begin).count()
+    };
+
+    std::lock_guard<std::mutex> lock(mutex);
+    if( on.load() )
+        events.push_back(event);
+}
+
+/* Complete events ("ph": "X"), thread names as metadata events. */
+bool
+Trace::stop()
+{
+    if( !on.exchange(false) )
+        return false;
+
+    std::lock_guard<std::mutex> lock(mutex);
+    std::ofstream file(file_path);
+    if( !file ){
+        std::cerr << "Cannot write the trace to " << file_path << std::endl;
+        return false;
+    }
+
+    file << "{\"traceEvents\":[\n";
+    bool first = true;
+    for(const std::pair<int, std::string>& thread: thread_names){
+        file << (first ? "" : ",\n")
+             << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":" << thread.first
+             << ",\"args\":{\"name\":\"" << thread.second << "\"}}";
+        first = false;
+    }
+
+    for(const Event& event: events){
+        file << (first ? "" : ",\n")
+             << "{\"name\":\"" << event.name << "\",\"ph\":\"X\",\"pid\":1,\"tid\":" << event.thread
+             << ",\"ts\":" << event.begin << ",\"dur\":" << event.duration << "}";
+        first = false;
+    }
+    file << "\n],\"displayTimeUnit\":\"ms\"}\n";
+
+    events.clear();
+    thread_names.clear();
+    std::cerr << "Trace written to " << file_path << std::endl;
+    return bool(file);
+}
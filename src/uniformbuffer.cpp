@@ -0,0 +1,126 @@
+#include "../include/uniformbuffer.h"
+#include "../include/glstats.h"
+
+#include <QOpenGLContext>
+
+#include <iostream>
+
+#ifndef GL_UNIFORM_BUFFER
+#define GL_UNIFORM_BUFFER 0x8A11
+#endif
+
+#ifndef GL_INVALID_INDEX
+#define GL_INVALID_INDEX 0xFFFFFFFFu
+#endif
+
+#ifndef GL_DYNAMIC_DRAW
+#define GL_DYNAMIC_DRAW 0x88E8
+#endif
+
+UniformBuffer::UniformBuffer():
+    buffer(0),
+    binding(0),
+    size(0),
+    gen_buffers(nullptr),
+    delete_buffers(nullptr),
+    bind_buffer(nullptr),
+    buffer_data(nullptr),
+    buffer_sub_data(nullptr),
+    bind_buffer_base(nullptr)
+{
+
+}
+
+UniformBuffer::~UniformBuffer()
+{
+    destroy();
+}
+
+/* Core since OpenGL 3.1 and OpenGL ES 3.0 */
+bool
+UniformBuffer::is_supported()
+{
+    QOpenGLContext* context = QOpenGLContext::currentContext();
+    if( context == nullptr )
+        return false;
+
+    QSurfaceFormat surface = context->format();
+    int version = surface.majorVersion() * 10 + surface.minorVersion();
+    if( context->isOpenGLES() )
+        return version >= 30;
+
+    return version >= 31 || context->hasExtension("GL_ARB_uniform_buffer_object");
+}
+
+bool
+UniformBuffer::create(QOpenGLShaderProgram* program, const char* block, GLuint binding_point, size_t bytes)
+{
+    destroy();
+    if( !is_supported() )
+        return false;
+
+    QOpenGLContext* context = QOpenGLContext::currentContext();
+    GetUniformBlockIndex get_uniform_block_index =
+        reinterpret_cast<GetUniformBlockIndex>(context->getProcAddress("glGetUniformBlockIndex"));
+    UniformBlockBinding uniform_block_binding =
+        reinterpret_cast<UniformBlockBinding>(context->getProcAddress("glUniformBlockBinding"));
+
+    gen_buffers = reinterpret_cast<GenBuffers>(context->getProcAddress("glGenBuffers"));
+    delete_buffers = reinterpret_cast<DeleteBuffers>(context->getProcAddress("glDeleteBuffers"));
+    bind_buffer = reinterpret_cast<BindBuffer>(context->getProcAddress("glBindBuffer"));
+    buffer_data = reinterpret_cast<BufferData>(context->getProcAddress("glBufferData"));
+    buffer_sub_data = reinterpret_cast<BufferSubData>(context->getProcAddress("glBufferSubData"));
+    bind_buffer_base = reinterpret_cast<BindBufferBase>(context->getProcAddress("glBindBufferBase"));
+
+    if( get_uniform_block_index == nullptr || uniform_block_binding == nullptr
+     || gen_buffers == nullptr || delete_buffers == nullptr || bind_buffer == nullptr
+     || buffer_data == nullptr || buffer_sub_data == nullptr || bind_buffer_base == nullptr )
+        return false;
+
+    // Compiled without the extension, or optimized away: plain uniforms then.
+    GLuint index = get_uniform_block_index(program->programId(), block);
+    if( index == GL_INVALID_INDEX )
+        return false;
+
+    uniform_block_binding(program->programId(), index, binding_point);
+
+    gen_buffers(1, &buffer);
+    if( buffer == 0 ){
+        std::cerr << "Failed to create the uniform buffer of " << block << "." << std::endl;
+        return false;
+    }
+
+    binding = binding_point;
+    size = bytes;
+
+    bind_buffer(GL_UNIFORM_BUFFER, buffer);
+    buffer_data(GL_UNIFORM_BUFFER, GLsizeiptr(size), nullptr, GL_DYNAMIC_DRAW);
+    bind_buffer(GL_UNIFORM_BUFFER, 0);
+
+    // Nothing else uses that binding point: it stays attached.
+    bind_buffer_base(GL_UNIFORM_BUFFER, binding, buffer);
+    return true;
+}
+
+void
+UniformBuffer::destroy()
+{
+    if( buffer != 0 )
+        delete_buffers(1, &buffer);
+
+    buffer = 0;
+    size = 0;
+}
+
+void
+UniformBuffer::write(size_t offset, const void* data, size_t bytes)
+{
+    if( buffer == 0 || offset + bytes > size )
+        return;
+
+    bind_buffer(GL_UNIFORM_BUFFER, buffer);
+    buffer_sub_data(GL_UNIFORM_BUFFER, GLintptr(offset), GLsizeiptr(bytes), data);
+    GL_STATS_ADD(bytes_written, bytes);
+    bind_buffer(GL_UNIFORM_BUFFER, 0);
+    GL_STATS_ADD(buffer_binds, 2);
+}
@@ -0,0 +1,192 @@
+#include "../include/vertexcache.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+/* Forsyth's scoring constants */
+static const float cache_decay_power = 1.5f;
+static const float last_triangle_score = 0.75f;
+static const float valence_boost_scale = 2.0f;
+static const float valence_boost_power = 0.5f;
+
+/* Valences above that are scored on the fly. */
+static const size_t max_valence_table = 32;
+
+VertexCacheStats
+VertexCache::measure(const uint32_t* indices, size_t nb_indices, size_t nb_vertices)
+{
+    VertexCacheStats stats = { 0.0f, 0.0f };
+    if( nb_indices < 3 || nb_vertices == 0 )
+        return stats;
+
+    // A vertex is into the FIFO while less than fifo_size misses happened since its own.
+    std::vector<size_t> stamp(nb_vertices, 0);
+    size_t misses = 0;
+    size_t clock = fifo_size + 1;
+
+    for(size_t i=0; i < nb_indices; ++i){
+        uint32_t v = indices[i];
+        if( clock - stamp[v] > fifo_size ){
+            stamp[v] = clock++;
+            ++misses;
+        }
+    }
+
+    stats.acmr = float(misses) / float(nb_indices / 3);
+    stats.atvr = float(misses) / float(nb_vertices);
+    return stats;
+}
+
+void
+VertexCache::reorder_triangles(const uint32_t* indices, size_t nb_indices, size_t nb_vertices,
+                               std::vector<uint32_t>& order)
+{
+    const size_t nb_triangles = nb_indices / 3;
+    const size_t cache_size = fifo_size;
+
+    order.clear();
+    order.reserve(nb_triangles);
+
+    // Score tables: by position into the cache, by number of triangles left.
+    float position_score[fifo_size];
+    for(size_t i=0; i < cache_size; ++i){
+        if( i < 3 )
+            position_score[i] = last_triangle_score;
+        else
+            position_score[i] = std::pow(1.0f - float(i - 3) / float(cache_size - 3), cache_decay_power);
+    }
+
+    float valence_score[max_valence_table];
+    for(size_t i=1; i < max_valence_table; ++i)
+        valence_score[i] = valence_boost_scale * std::pow(float(i), -valence_boost_power);
+
+    auto score = [&](int position, uint32_t remaining){
+        if( remaining == 0 )
+            return -1.0f;
+
+        float s = (position >= 0) ? position_score[position] : 0.0f;
+        if( remaining < max_valence_table )
+            return s + valence_score[remaining];
+        return s + valence_boost_scale * std::pow(float(remaining), -valence_boost_power);
+    };
+
+    // Triangles around each vertex, the ones still to add first.
+    std::vector<uint32_t> offsets(nb_vertices + 1, 0);
+    for(size_t i=0; i < 3*nb_triangles; ++i)
+        ++offsets[indices[i] + 1];
+    for(size_t v=0; v < nb_vertices; ++v)
+        offsets[v+1] += offsets[v];
+
+    std::vector<uint32_t> remaining(nb_vertices, 0);
+    std::vector<uint32_t> adjacency(3*nb_triangles);
+    for(size_t i=0; i < 3*nb_triangles; ++i){
+        uint32_t v = indices[i];
+        adjacency[offsets[v] + remaining[v]++] = uint32_t(i / 3);
+    }
+
+    std::vector<int> position(nb_vertices, -1);
+    std::vector<float> vertex_score(nb_vertices);
+    for(size_t v=0; v < nb_vertices; ++v)
+        vertex_score[v] = score(-1, remaining[v]);
+
+    std::vector<float> triangle_score(nb_triangles);
+    std::vector<char> added(nb_triangles, 0);
+    for(size_t t=0; t < nb_triangles; ++t)
+        triangle_score[t] = vertex_score[indices[3*t]] + vertex_score[indices[3*t+1]] + vertex_score[indices[3*t+2]];
+
+    // The 3 vertices of the new triangle in front, then the previous cache.
+    uint32_t cache[fifo_size + 3];
+    uint32_t next_cache[fifo_size + 3];
+    size_t cache_count = 0;
+
+    size_t cursor = 0;
+    long best = -1;
+
+    while( order.size() < nb_triangles ){
+        // Nothing usable around the cache: start again from the first triangle left.
+        if( best < 0 ){
+            while( added[cursor] )
+                ++cursor;
+            best = long(cursor);
+        }
+
+        const uint32_t* triangle = indices + 3*size_t(best);
+        order.push_back(uint32_t(best));
+        added[best] = 1;
+
+        size_t next_count = 0;
+        for(size_t k=0; k < 3; ++k){
+            uint32_t v = triangle[k];
+
+            // Move `best` out of the triangles left around v.
+            uint32_t* first = adjacency.data() + offsets[v];
+            uint32_t* last = first + remaining[v];
+            for(uint32_t* t = first; t != last; ++t)
+                if( *t == uint32_t(best) ){
+                    *t = *(last-1);
+                    *(last-1) = uint32_t(best);
+                    break;
+                }
+            --remaining[v];
+
+            bool known = false;
+            for(size_t i=0; i < next_count; ++i)
+                known = known || (next_cache[i] == v);
+            if( !known )
+                next_cache[next_count++] = v;
+        }
+
+        for(size_t i=0; i < cache_count; ++i){
+            uint32_t v = cache[i];
+            if( v != triangle[0] && v != triangle[1] && v != triangle[2] )
+                next_cache[next_count++] = v;
+        }
+
+        // Vertices past the cache size have just been evicted.
+        for(size_t i=0; i < next_count; ++i){
+            uint32_t v = next_cache[i];
+            position[v] = (i < cache_size) ? int(i) : -1;
+            vertex_score[v] = score(position[v], remaining[v]);
+        }
+
+        // Only triangles around the cache got new scores, the best of them comes next.
+        best = -1;
+        float best_score = -1.0f;
+        for(size_t i=0; i < next_count; ++i){
+            uint32_t v = next_cache[i];
+            for(uint32_t j=offsets[v]; j < offsets[v] + remaining[v]; ++j){
+                uint32_t t = adjacency[j];
+                const uint32_t* around = indices + 3*size_t(t);
+                triangle_score[t] = vertex_score[around[0]] + vertex_score[around[1]] + vertex_score[around[2]];
+
+                if( triangle_score[t] > best_score ){
+                    best_score = triangle_score[t];
+                    best = long(t);
+                }
+            }
+        }
+
+        cache_count = std::min(next_count, cache_size);
+        for(size_t i=0; i < cache_count; ++i)
+            cache[i] = next_cache[i];
+    }
+}
+
+void
+VertexCache::reorder_vertices(const uint32_t* indices, size_t nb_indices, size_t nb_vertices,
+                              std::vector<uint32_t>& remap)
+{
+    const uint32_t unused = std::numeric_limits<uint32_t>::max();
+
+    remap.assign(nb_vertices, unused);
+    uint32_t next = 0;
+
+    for(size_t i=0; i < nb_indices; ++i)
+        if( remap[indices[i]] == unused )
+            remap[indices[i]] = next++;
+
+    for(size_t v=0; v < nb_vertices; ++v)
+        if( remap[v] == unused )
+            remap[v] = next++;
+}